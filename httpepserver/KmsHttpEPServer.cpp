@@ -14,14 +14,22 @@
  */
 
 #include <time.h>
+#include <sys/socket.h>
 #include <libsoup/soup.h>
 #include <uuid/uuid.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <nice/interfaces.h>
 
 #include "KmsHttpEPServer.h"
 #include "KmsHttpPost.h"
+#include "KmsHttpSegmentCache.h"
+#include "KmsHttpTimerQueue.h"
 #include "kms-enumtypes.h"
 #include "kms-marshal.h"
 
@@ -37,28 +45,95 @@
 #define KEY_GOT_CHUNK_HANDLER_ID "kms-got-chunk-handler-id"
 #define KEY_FINISHED_HANDLER_ID "kms-finish-handler-id"
 #define KEY_EOS_HANDLER_ID "kms-eos-handler-id"
-#define KEY_TIMEOUT_ID "kms-timeout-id"
+#define KEY_TIMER "kms-timer"
 #define KEY_FINISHED "kms-finish"
 #define KEY_BOUNDARY "kms-boundary"
 #define KEY_MESSAGE "kms-message"
 #define KEY_COOKIE "kms-cookie"
+#define KEY_WORKER "kms-worker"
+#define KEY_SOCKET "kms-socket"
+#define KEY_BROADCAST "kms-broadcast"
+#define KEY_SEGMENTER "kms-segmenter"
+#define KEY_CALLBACKS "kms-callbacks"
+#define KEY_COALESCER "kms-coalescer"
 
 #define KEY_PARAM_TIMEOUT "kms-param-timeout"
+#define KEY_PARAM_COALESCE_SIZE "kms-param-coalesce-size"
+#define KEY_PARAM_COALESCE_LATENCY "kms-param-coalesce-latency"
+
+#ifndef SOUP_CHECK_VERSION
+#define SOUP_CHECK_VERSION(major, minor, micro) 0
+#endif
 
 #define GST_CAT_DEFAULT kms_http_ep_server_debug_category
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define KMS_HTTP_EP_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), KMS_TYPE_HTTP_EP_SERVER, KmsHttpEPServerPrivate))
+
+/* Traffic counters of a worker. They are only written from the thread */
+/* running the worker, so updating them needs neither locks nor atomic */
+/* read-modify-write operations. Readers may get slightly stale values */
+typedef struct _KmsHttpEPStats {
+  gint64 get_sessions;
+  gint64 post_sessions;
+  guint64 requests;
+  guint64 bytes_sent;
+  guint64 bytes_received;
+} KmsHttpEPStats;
+
+#define KMS_HTTP_EP_STATS_ADD(worker, field, val)                       \
+  __atomic_store_n (&(worker)->stats.field,                             \
+      __atomic_load_n (&(worker)->stats.field, __ATOMIC_RELAXED) + (val), \
+      __ATOMIC_RELAXED)
+
+#define KMS_HTTP_EP_STATS_GET(worker, field)                            \
+  __atomic_load_n (&(worker)->stats.field, __ATOMIC_RELAXED)
+
+#define CACHE_LINE_SIZE 64
+
+/* Each worker owns one SoupServer and the main context it is dispatched */
+/* from. Legacy mode uses a single worker running in the default context */
+typedef struct _KmsHttpEPWorker {
+  KmsHttpEPServer *self;
+  SoupServer *server;
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+  KmsHttpEPStats stats;
+  /* Keep counters of different workers in different cache lines */
+  gchar padding[CACHE_LINE_SIZE];
+} KmsHttpEPWorker;
+
 struct _KmsHttpEPServerPrivate {
   GHashTable *handlers;
-  SoupServer *server;
+  GHashTable *files;
+  GMutex mutex;
+  KmsHttpEPWorker *workers;
+  guint n_workers;
+  guint threads;
+  GMainContext *context;
   gchar *announcedAddr;
   gchar *iface;
   gint port;
   GRand *rand;
+  KmsHttpSegmentCache *cache;
+  KmsHttpTimerQueue *timers;
+  guint cache_size;
+  guint segment_duration;
+  guint coalesce_size;
+  guint coalesce_latency;
+  GRecMutex metrics_mutex;
+  KmsHttpEPServerMetricsFunc metrics_func;
+  gpointer metrics_data;
+  GDestroyNotify metrics_notify;
+  volatile gint pending_emits;
+  volatile gint expirations;
 };
 
-static GType http_t = G_TYPE_INVALID;
+#define KMS_HTTP_EP_SERVER_LOCK(obj) (g_mutex_lock (&(obj)->priv->mutex))
+#define KMS_HTTP_EP_SERVER_UNLOCK(obj) (g_mutex_unlock (&(obj)->priv->mutex))
+
+static volatile gsize http_t = G_TYPE_INVALID;
 
 #define KMS_IS_EXPECTED_TYPE(obj, objtype) (G_TYPE_CHECK_INSTANCE_TYPE((obj),(objtype)))
 
@@ -76,6 +151,11 @@ enum {
   PROP_KMS_HTTP_EP_SERVER_PORT,
   PROP_KMS_HTTP_EP_SERVER_INTERFACE,
   PROP_KMS_HTTP_EP_SERVER_ANNOUNCED_ADDRESS,
+  PROP_KMS_HTTP_EP_SERVER_WORKERS,
+  PROP_KMS_HTTP_EP_SERVER_SEGMENT_DURATION,
+  PROP_KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE,
+  PROP_KMS_HTTP_EP_SERVER_COALESCE_SIZE,
+  PROP_KMS_HTTP_EP_SERVER_COALESCE_LATENCY,
 
   N_PROPERTIES
 };
@@ -83,6 +163,15 @@ enum {
 #define KMS_HTTP_EP_SERVER_DEFAULT_PORT 0
 #define KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE NULL
 #define KMS_HTTP_EP_SERVER_DEFAULT_ANNOUNCED_ADDRESS KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE
+#define KMS_HTTP_EP_SERVER_DEFAULT_WORKERS 0
+#define KMS_HTTP_EP_SERVER_MAX_WORKERS 64
+#define KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_DURATION 4 /* seconds */
+#define KMS_HTTP_EP_SERVER_MAX_SEGMENT_DURATION 60 /* seconds */
+#define KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_CACHE_SIZE (64 * 1024 * 1024)
+/* Coalescing adds latency, so end points have to ask for it */
+#define KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_SIZE 0
+#define KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_LATENCY 20 /* milliseconds */
+#define KMS_HTTP_EP_SERVER_MAX_COALESCE_LATENCY 1000 /* milliseconds */
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
@@ -106,6 +195,138 @@ struct sample_data {
   GstSample *sample;
 };
 
+/* Per end point callbacks. They are invalidated under the lock, so once */
+/* an end point has cleared its callbacks they will never be called again */
+typedef struct _KmsHttpEPCallbacks {
+  volatile gint ref_count;
+  GRecMutex mutex;
+  KmsHttpEPServerCallbacks callbacks;
+  gboolean valid;
+  gpointer data;
+  GDestroyNotify notify;
+} KmsHttpEPCallbacks;
+
+struct emit_data {
+  KmsHttpEPServer *server;
+  KmsHttpEPCallbacks *callbacks;
+  guint signal;
+  gchar *path;
+  KmsHttpEndPointAction action;
+};
+
+/* Upper bound for the data kept since the last key frame. If a stream */
+/* goes beyond it new viewers just wait for the next key frame */
+#define BROADCAST_MAX_GOP_SIZE (16 * 1024 * 1024)
+/* Upper bound for the data queued to a viewer and not yet written. */
+/* Slower viewers skip media until the next key frame once they reach it */
+#define BROADCAST_MAX_VIEWER_BACKLOG (4 * 1024 * 1024)
+
+/* Shared state of an end point registered in broadcast mode. Every */
+/* encoded buffer is wrapped once in a SoupBuffer and then referenced */
+/* from the response body of each viewer */
+typedef struct _KmsHttpEPBroadcast {
+  GRecMutex mutex;
+  gchar *uri;
+  GList *headers;
+  gboolean headers_done;
+  GQueue gop;
+  gsize gop_size;
+  gboolean gop_valid;
+  guint64 seq;
+  GSList *viewers;
+} KmsHttpEPBroadcast;
+
+typedef struct _KmsHttpEPViewer {
+  SoupMessage *msg;
+  KmsHttpEPWorker *worker;
+  guint64 first_seq;
+  gboolean synced;
+  gsize backlog;
+} KmsHttpEPViewer;
+
+struct broadcast_data {
+  GstElement *httpep;
+  KmsHttpEPWorker *worker;
+  SoupBuffer *chunk;
+  guint64 seq;
+  gboolean header;
+  gboolean keyframe;
+};
+
+struct buffer_map {
+  GstBuffer *buffer;
+  GstMapInfo info;
+};
+
+#define SEGMENTED_PLAYLIST "index.m3u8"
+#define SEGMENTED_PLAYLIST_TYPE "application/vnd.apple.mpegurl"
+#define SEGMENTED_INIT "init"
+#define SEGMENTED_PREFIX "seg"
+/* Segments listed in the live playlist */
+#define SEGMENTED_WINDOW 6
+/* Playlist requests are expected at least every target duration, so */
+/* the session does not expire until some of them have been missed */
+#define SEGMENTED_EXPIRATION_FACTOR 3
+/* Segments are never modified once they are published */
+#define SEGMENTED_CACHE_CONTROL "public, max-age=3600"
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+
+/* A finished file served as is, without any media pipeline. Each */
+/* response reads it in chunks as the client takes them, so a file that */
+/* changes on disk only ends responses early */
+typedef struct _KmsHttpEPFile {
+  volatile gint ref_count;
+  gchar *path;
+  gchar *content_type;
+} KmsHttpEPFile;
+
+#define FILE_CHUNK_SIZE (64 * 1024)
+
+typedef struct _KmsHttpEPFileReader {
+  gint fd;
+  goffset remaining;
+  SoupSocket *socket;
+} KmsHttpEPFileReader;
+
+/* Media written to a GET response is held back until there is enough */
+/* of it or the oldest byte has waited for too long, so that small */
+/* samples do not end up in a chunk and a write of their own */
+typedef struct _KmsHttpEPCoalescer {
+  GByteArray *data;
+  GSource *timer;
+  guint max_size;
+  guint max_latency;
+} KmsHttpEPCoalescer;
+
+typedef struct _KmsHttpEPSegment {
+  guint seq;
+  GstClockTime duration;
+} KmsHttpEPSegment;
+
+/* Cuts the muxed output of an end point in segments starting on key */
+/* frames. Header buffers make up the initialization segment and media */
+/* segments are encoded once and then served from the LRU cache */
+typedef struct _KmsHttpEPSegmenter {
+  GMutex mutex;
+  KmsHttpSegmentCache *cache;
+  gchar *base;
+  const gchar *ext;
+  const gchar *content_type;
+  GstClockTime target;
+  GByteArray *init;
+  SoupBuffer *init_segment;
+  gboolean headers_done;
+  GByteArray *current;
+  gboolean current_valid;
+  GstClockTime start;
+  GstClockTime last;
+  guint seq;
+  gboolean ended;
+  gboolean requested;
+  GQueue window;
+} KmsHttpEPSegmenter;
+
 static gchar *
 get_address ()
 {
@@ -152,17 +373,12 @@ get_address ()
 static void
 remove_timeout (GstElement *httpep)
 {
-  guint *timeout_id;
-
-  /* Remove timeout if there is any */
-  timeout_id = (guint *) g_object_get_data (G_OBJECT (httpep), KEY_TIMEOUT_ID);
+  KmsHttpTimer *timer;
 
-  if (timeout_id == NULL)
-    return;
+  timer = (KmsHttpTimer *) g_object_get_data (G_OBJECT (httpep), KEY_TIMER);
 
-  GST_DEBUG ("Remove timeout %d", *timeout_id);
-  g_source_remove (*timeout_id);
-  g_object_set_data_full (G_OBJECT (httpep), KEY_TIMEOUT_ID, NULL, NULL);
+  if (timer != NULL && kms_http_timer_cancel (timer) )
+    GST_DEBUG ("Remove timeout of %s", GST_ELEMENT_NAME (httpep) );
 }
 
 static gboolean
@@ -175,16 +391,292 @@ msg_has_finished (SoupMessage *msg)
   return *finished;
 }
 
+static KmsHttpEPWorker *
+msg_get_worker (SoupMessage *msg)
+{
+  return (KmsHttpEPWorker *) g_object_get_data (G_OBJECT (msg), KEY_WORKER);
+}
+
 static GstElement *
-kms_http_ep_server_get_ep_from_msg (KmsHttpEPServer *self, SoupMessage *msg)
+kms_http_ep_server_lookup_end_point (KmsHttpEPServer *self, const gchar *uri)
+{
+  GstElement *httpep = NULL;
+
+  if (uri == NULL)
+    return NULL;
+
+  KMS_HTTP_EP_SERVER_LOCK (self);
+
+  if (self->priv->handlers != NULL)
+    httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
+
+  if (httpep != NULL)
+    g_object_ref (httpep);
+
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  return httpep;
+}
+
+static KmsHttpEPCallbacks *
+kms_http_ep_callbacks_ref (KmsHttpEPCallbacks *callbacks)
 {
-  SoupURI *suri = soup_message_get_uri (msg);
-  const char *uri = soup_uri_get_path (suri);
+  g_atomic_int_inc (&callbacks->ref_count);
 
-  if (uri == NULL || self->priv->handlers == NULL)
+  return callbacks;
+}
+
+static void
+kms_http_ep_callbacks_unref (KmsHttpEPCallbacks *callbacks)
+{
+  if (!g_atomic_int_dec_and_test (&callbacks->ref_count) )
+    return;
+
+  g_rec_mutex_clear (&callbacks->mutex);
+  g_slice_free (KmsHttpEPCallbacks, callbacks);
+}
+
+static void
+kms_http_ep_callbacks_invalidate (KmsHttpEPCallbacks *callbacks)
+{
+  g_rec_mutex_lock (&callbacks->mutex);
+
+  if (callbacks->valid) {
+    callbacks->valid = FALSE;
+
+    if (callbacks->notify != NULL)
+      callbacks->notify (callbacks->data);
+  }
+
+  g_rec_mutex_unlock (&callbacks->mutex);
+}
+
+static void
+destroy_callbacks (KmsHttpEPCallbacks *callbacks)
+{
+  kms_http_ep_callbacks_invalidate (callbacks);
+  kms_http_ep_callbacks_unref (callbacks);
+}
+
+static gpointer
+dup_callbacks (gpointer data, gpointer user_data)
+{
+  if (data == NULL)
     return NULL;
 
-  return (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
+  return kms_http_ep_callbacks_ref ( (KmsHttpEPCallbacks *) data);
+}
+
+static KmsHttpEPCallbacks *
+get_callbacks (GstElement *httpep)
+{
+  if (httpep == NULL)
+    return NULL;
+
+  /* Reference is taken atomically in case callbacks are being replaced */
+  return (KmsHttpEPCallbacks *) g_object_dup_data (G_OBJECT (httpep),
+         KEY_CALLBACKS, dup_callbacks, NULL);
+}
+
+static void
+kms_http_ep_server_dispatch (KmsHttpEPServer *self,
+                             KmsHttpEPCallbacks *callbacks, guint signal, const gchar *path,
+                             KmsHttpEndPointAction action)
+{
+  if (callbacks != NULL) {
+    KmsHttpEPServerCallbacks *cb = &callbacks->callbacks;
+
+    /* Only the end point registered for this path gets called */
+    g_rec_mutex_lock (&callbacks->mutex);
+
+    if (!callbacks->valid) {
+      /* End point is gone */
+    } else if (signal == ACTION_REQUESTED) {
+      if (cb->action_requested != NULL)
+        cb->action_requested (self, path, action, callbacks->data);
+    } else if (signal == URL_REMOVED) {
+      if (cb->url_removed != NULL)
+        cb->url_removed (self, path, callbacks->data);
+    } else if (signal == URL_EXPIRED) {
+      if (cb->url_expired != NULL)
+        cb->url_expired (self, path, callbacks->data);
+    }
+
+    g_rec_mutex_unlock (&callbacks->mutex);
+  }
+
+  /* Signals are still emitted for listeners interested in every url */
+  if (signal == ACTION_REQUESTED)
+    g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
+                   action);
+  else
+    g_signal_emit (G_OBJECT (self), obj_signals[signal], 0, path);
+}
+
+static gboolean
+emit_signal_cb (gpointer data)
+{
+  struct emit_data *edata = (struct emit_data *) data;
+
+  kms_http_ep_server_dispatch (edata->server, edata->callbacks, edata->signal,
+                               edata->path, edata->action);
+
+  return FALSE;
+}
+
+static void
+destroy_emit_data (gpointer data)
+{
+  struct emit_data *edata = (struct emit_data *) data;
+
+  if (edata->callbacks != NULL)
+    kms_http_ep_callbacks_unref (edata->callbacks);
+
+  g_atomic_int_add (&edata->server->priv->pending_emits, -1);
+  g_object_unref (edata->server);
+  g_free (edata->path);
+
+  g_slice_free (struct emit_data, edata);
+}
+
+static void
+kms_http_ep_server_emit (KmsHttpEPServer *self, GstElement *httpep,
+                         guint signal, const gchar *path, KmsHttpEndPointAction action)
+{
+  struct emit_data *edata;
+
+  /* Signals are always emitted from the context the server was started */
+  /* in, so listeners never run inside a worker thread. When the caller */
+  /* already owns that context the signal is emitted right away */
+  edata = g_slice_new (struct emit_data);
+  edata->server = KMS_HTTP_EP_SERVER (g_object_ref (self) );
+  edata->callbacks = get_callbacks (httpep);
+  edata->signal = signal;
+  edata->path = g_strdup (path);
+  edata->action = action;
+
+  g_atomic_int_inc (&self->priv->pending_emits);
+  g_main_context_invoke_full (self->priv->context, G_PRIORITY_HIGH_IDLE,
+                              emit_signal_cb, edata, destroy_emit_data);
+}
+
+static void
+kms_http_ep_coalescer_free (KmsHttpEPCoalescer *coalescer)
+{
+  if (coalescer->timer != NULL) {
+    g_source_destroy (coalescer->timer);
+    g_source_unref (coalescer->timer);
+  }
+
+  g_byte_array_unref (coalescer->data);
+  g_slice_free (KmsHttpEPCoalescer, coalescer);
+}
+
+/* Must be called from the worker serving @msg */
+static void
+kms_http_ep_coalescer_flush (SoupMessage *msg)
+{
+  KmsHttpEPCoalescer *coalescer;
+  guint len;
+
+  coalescer = (KmsHttpEPCoalescer *) g_object_get_data (G_OBJECT (msg),
+              KEY_COALESCER);
+
+  if (coalescer == NULL)
+    return;
+
+  if (coalescer->timer != NULL) {
+    g_source_destroy (coalescer->timer);
+    g_source_unref (coalescer->timer);
+    coalescer->timer = NULL;
+  }
+
+  len = coalescer->data->len;
+
+  if (len == 0)
+    return;
+
+  soup_message_body_append_take (msg->response_body,
+                                 g_byte_array_free (coalescer->data, FALSE), len);
+  coalescer->data = g_byte_array_sized_new (coalescer->max_size);
+
+  KMS_HTTP_EP_STATS_ADD (msg_get_worker (msg), bytes_sent, len);
+  soup_server_unpause_message (msg_get_worker (msg)->server, msg);
+}
+
+static gboolean
+coalescer_timeout_cb (gpointer data)
+{
+  SoupMessage *msg = SOUP_MESSAGE (data);
+
+  if (!msg_has_finished (msg) )
+    kms_http_ep_coalescer_flush (msg);
+
+  return FALSE;
+}
+
+static void
+kms_http_ep_coalescer_push (SoupMessage *msg, KmsHttpEPCoalescer *coalescer,
+                            const guint8 *data, gsize size)
+{
+  g_byte_array_append (coalescer->data, data, size);
+
+  if (coalescer->data->len >= coalescer->max_size) {
+    kms_http_ep_coalescer_flush (msg);
+    return;
+  }
+
+  if (coalescer->timer != NULL)
+    return;
+
+  /* First bytes waiting, they will not wait longer than max latency */
+  coalescer->timer = g_timeout_source_new (coalescer->max_latency);
+  g_source_set_callback (coalescer->timer, coalescer_timeout_cb,
+                         g_object_ref (msg), g_object_unref);
+  g_source_attach (coalescer->timer, msg_get_worker (msg)->context);
+}
+
+static gpointer
+dup_guint (gpointer data, gpointer user_data)
+{
+  if (data != NULL)
+    * (guint *) user_data = * (guint *) data;
+
+  return NULL;
+}
+
+/* Coalescing parameters may be replaced from any thread at any time */
+static guint
+get_guint_param (GstElement *httpep, const gchar *name)
+{
+  guint val = 0;
+
+  g_object_dup_data (G_OBJECT (httpep), name, dup_guint, &val);
+
+  return val;
+}
+
+static void
+kms_http_ep_server_set_coalescer (SoupMessage *msg, GstElement *httpep)
+{
+  KmsHttpEPCoalescer *coalescer;
+  guint size, latency;
+
+  size = get_guint_param (httpep, KEY_PARAM_COALESCE_SIZE);
+  latency = get_guint_param (httpep, KEY_PARAM_COALESCE_LATENCY);
+
+  if (size == 0 || latency == 0) {
+    /* Every sample is written as soon as it is available */
+    return;
+  }
+
+  coalescer = g_slice_new0 (KmsHttpEPCoalescer);
+  coalescer->max_size = size;
+  coalescer->max_latency = latency;
+  coalescer->data = g_byte_array_sized_new (size);
+
+  g_object_set_data_full (G_OBJECT (msg), KEY_COALESCER, coalescer,
+                          (GDestroyNotify) kms_http_ep_coalescer_free);
 }
 
 static gboolean
@@ -193,7 +685,7 @@ send_buffer_cb (gpointer data)
   struct sample_data *sdata = (struct sample_data *) data;
   SoupMessage *msg = (SoupMessage *) g_object_get_data (
                        G_OBJECT (sdata->httpep), KEY_MESSAGE);
-  KmsHttpEPServer *httpepserver;
+  KmsHttpEPCoalescer *coalescer;
   GstBuffer *buffer;
   GstMapInfo info;
 
@@ -213,12 +705,17 @@ send_buffer_cb (gpointer data)
     return FALSE;
   }
 
-  httpepserver = KMS_HTTP_EP_SERVER (g_object_get_data (G_OBJECT (msg),
-                                     KEY_HTTP_EP_SERVER) );
+  coalescer = (KmsHttpEPCoalescer *) g_object_get_data (G_OBJECT (msg),
+              KEY_COALESCER);
 
-  soup_message_body_append (msg->response_body, SOUP_MEMORY_COPY,
-                            info.data, info.size);
-  soup_server_unpause_message (httpepserver->priv->server, msg);
+  if (coalescer != NULL) {
+    kms_http_ep_coalescer_push (msg, coalescer, info.data, info.size);
+  } else {
+    soup_message_body_append (msg->response_body, SOUP_MEMORY_COPY,
+                              info.data, info.size);
+    KMS_HTTP_EP_STATS_ADD (msg_get_worker (msg), bytes_sent, info.size);
+    soup_server_unpause_message (msg_get_worker (msg)->server, msg);
+  }
 
   gst_buffer_unmap (buffer, &info);
   return FALSE;
@@ -238,11 +735,499 @@ destroy_sample_data (gpointer data)
   g_slice_free (struct sample_data, sdata);
 }
 
+static void
+destroy_buffer_map (gpointer data)
+{
+  struct buffer_map *map = (struct buffer_map *) data;
+
+  gst_buffer_unmap (map->buffer, &map->info);
+  gst_buffer_unref (map->buffer);
+
+  g_slice_free (struct buffer_map, map);
+}
+
+static SoupBuffer *
+wrap_gst_buffer (GstBuffer *buffer)
+{
+  struct buffer_map *map;
+
+  map = g_slice_new (struct buffer_map);
+
+  if (!gst_buffer_map (buffer, &map->info, GST_MAP_READ) ) {
+    GST_WARNING ("Could not get buffer map");
+    g_slice_free (struct buffer_map, map);
+    return NULL;
+  }
+
+  map->buffer = gst_buffer_ref (buffer);
+
+  /* Memory stays mapped until the last response body drops the chunk */
+  return soup_buffer_new_with_owner (map->info.data, map->info.size, map,
+                                     destroy_buffer_map);
+}
+
+static KmsHttpEPBroadcast *
+kms_http_ep_broadcast_new (const gchar *uri)
+{
+  KmsHttpEPBroadcast *bc;
+
+  bc = g_slice_new0 (KmsHttpEPBroadcast);
+  g_rec_mutex_init (&bc->mutex);
+  g_queue_init (&bc->gop);
+  bc->uri = g_strdup (uri);
+
+  return bc;
+}
+
+static void
+kms_http_ep_broadcast_clear_gop (KmsHttpEPBroadcast *bc)
+{
+  SoupBuffer *chunk;
+
+  while ( (chunk = (SoupBuffer *) g_queue_pop_head (&bc->gop) ) != NULL)
+    soup_buffer_free (chunk);
+
+  bc->gop_size = 0;
+  bc->gop_valid = FALSE;
+}
+
+static void
+destroy_viewer (KmsHttpEPViewer *viewer)
+{
+  g_signal_handlers_disconnect_by_data (viewer->msg, viewer);
+  g_object_unref (viewer->msg);
+  g_slice_free (KmsHttpEPViewer, viewer);
+}
+
+static void
+kms_http_ep_broadcast_free (KmsHttpEPBroadcast *bc)
+{
+  kms_http_ep_broadcast_clear_gop (bc);
+  g_list_free_full (bc->headers, (GDestroyNotify) soup_buffer_free);
+  g_slist_free_full (bc->viewers, (GDestroyNotify) destroy_viewer);
+  g_rec_mutex_clear (&bc->mutex);
+  g_free (bc->uri);
+
+  g_slice_free (KmsHttpEPBroadcast, bc);
+}
+
+static KmsHttpEPBroadcast *
+get_broadcast (GstElement *httpep)
+{
+  return (KmsHttpEPBroadcast *) g_object_get_data (G_OBJECT (httpep),
+         KEY_BROADCAST);
+}
+
+static void
+kms_http_ep_broadcast_cache (KmsHttpEPBroadcast *bc, GstBuffer *buffer,
+                             SoupBuffer *chunk)
+{
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER) ) {
+    if (bc->headers_done) {
+      /* Stream headers after media data mean a new stream is starting */
+      g_list_free_full (bc->headers, (GDestroyNotify) soup_buffer_free);
+      bc->headers = NULL;
+      bc->headers_done = FALSE;
+      kms_http_ep_broadcast_clear_gop (bc);
+    }
+
+    bc->headers = g_list_append (bc->headers, soup_buffer_copy (chunk) );
+    return;
+  }
+
+  bc->headers_done = TRUE;
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ) {
+    /* A key frame starts a new group of pictures */
+    kms_http_ep_broadcast_clear_gop (bc);
+    bc->gop_valid = TRUE;
+  } else if (!bc->gop_valid) {
+    return;
+  }
+
+  g_queue_push_tail (&bc->gop, soup_buffer_copy (chunk) );
+  bc->gop_size += chunk->length;
+
+  if (bc->gop_size > BROADCAST_MAX_GOP_SIZE) {
+    GST_WARNING ("Group of pictures too big for %s, not caching it", bc->uri);
+    kms_http_ep_broadcast_clear_gop (bc);
+  }
+}
+
+static gboolean
+broadcast_send_cb (gpointer data)
+{
+  struct broadcast_data *bdata = (struct broadcast_data *) data;
+  KmsHttpEPBroadcast *bc = get_broadcast (bdata->httpep);
+  GSList *l;
+
+  if (bc == NULL)
+    return FALSE;
+
+  g_rec_mutex_lock (&bc->mutex);
+
+  for (l = bc->viewers; l != NULL; l = l->next) {
+    KmsHttpEPViewer *viewer = (KmsHttpEPViewer *) l->data;
+
+    if (viewer->worker != bdata->worker || bdata->seq < viewer->first_seq ||
+        msg_has_finished (viewer->msg) )
+      continue;
+
+    if (bdata->chunk == NULL) {
+      /* End of stream */
+      soup_message_body_complete (viewer->msg->response_body);
+    } else if (!bdata->header &&
+               viewer->backlog + bdata->chunk->length > BROADCAST_MAX_VIEWER_BACKLOG) {
+      if (viewer->synced)
+        GST_WARNING ("Viewer %" GST_PTR_FORMAT " of %s is too slow, it will "
+                     "resume at the next key frame", (gpointer) viewer->msg, bc->uri);
+
+      viewer->synced = FALSE;
+      continue;
+    } else if (bdata->header || viewer->synced || bdata->keyframe) {
+      if (!bdata->header)
+        viewer->synced = TRUE;
+
+      soup_message_body_append_buffer (viewer->msg->response_body,
+                                       bdata->chunk);
+      viewer->backlog += bdata->chunk->length;
+      KMS_HTTP_EP_STATS_ADD (bdata->worker, bytes_sent, bdata->chunk->length);
+    } else {
+      /* Viewer is waiting for a key frame to start decoding */
+      continue;
+    }
+
+    soup_server_unpause_message (bdata->worker->server, viewer->msg);
+  }
+
+  g_rec_mutex_unlock (&bc->mutex);
+
+  return FALSE;
+}
+
+static void
+destroy_broadcast_data (gpointer data)
+{
+  struct broadcast_data *bdata = (struct broadcast_data *) data;
+
+  if (bdata->chunk != NULL)
+    soup_buffer_free (bdata->chunk);
+
+  gst_object_unref (bdata->httpep);
+
+  g_slice_free (struct broadcast_data, bdata);
+}
+
+static void
+kms_http_ep_broadcast_dispatch (GstElement *httpep, KmsHttpEPBroadcast *bc,
+                                GstBuffer *buffer)
+{
+  GSList *workers = NULL, *l;
+  SoupBuffer *chunk = NULL;
+  guint64 seq;
+
+  if (buffer != NULL) {
+    chunk = wrap_gst_buffer (buffer);
+
+    if (chunk == NULL)
+      return;
+  }
+
+  g_rec_mutex_lock (&bc->mutex);
+
+  seq = bc->seq++;
+
+  if (chunk != NULL)
+    kms_http_ep_broadcast_cache (bc, buffer, chunk);
+
+  for (l = bc->viewers; l != NULL; l = l->next) {
+    KmsHttpEPViewer *viewer = (KmsHttpEPViewer *) l->data;
+
+    if (g_slist_find (workers, viewer->worker) == NULL)
+      workers = g_slist_prepend (workers, viewer->worker);
+  }
+
+  g_rec_mutex_unlock (&bc->mutex);
+
+  /* Post the buffer once per worker, not once per viewer */
+  for (l = workers; l != NULL; l = l->next) {
+    struct broadcast_data *bdata;
+
+    bdata = g_slice_new (struct broadcast_data);
+    bdata->httpep = GST_ELEMENT (gst_object_ref (httpep) );
+    bdata->worker = (KmsHttpEPWorker *) l->data;
+    bdata->chunk = (chunk != NULL) ? soup_buffer_copy (chunk) : NULL;
+    bdata->seq = seq;
+    bdata->header = (buffer != NULL) &&
+                    GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER);
+    bdata->keyframe = (buffer != NULL) &&
+                      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    g_main_context_invoke_full (bdata->worker->context, G_PRIORITY_HIGH_IDLE,
+                                broadcast_send_cb, bdata, destroy_broadcast_data);
+  }
+
+  g_slist_free (workers);
+
+  if (chunk != NULL)
+    soup_buffer_free (chunk);
+}
+
+/* Only fragmented MP4 segments can be played by HLS clients */
+static KmsHttpEPSegmenter *
+kms_http_ep_segmenter_new (KmsHttpSegmentCache *cache, const gchar *uri,
+                           guint duration)
+{
+  KmsHttpEPSegmenter *seg;
+  gchar *dir;
+
+  seg = g_slice_new0 (KmsHttpEPSegmenter);
+  g_mutex_init (&seg->mutex);
+  g_queue_init (&seg->window);
+  seg->cache = kms_http_segment_cache_ref (cache);
+  seg->target = duration * GST_SECOND;
+  seg->init = g_byte_array_new ();
+  seg->current = g_byte_array_new ();
+
+  dir = g_path_get_dirname (uri);
+  seg->base = g_strdup_printf ("%s/", dir);
+  g_free (dir);
+
+  seg->ext = "m4s";
+  seg->content_type = "video/mp4";
+
+  return seg;
+}
+
+static void
+kms_http_ep_segmenter_free (KmsHttpEPSegmenter *seg)
+{
+  KmsHttpEPSegment *segment;
+
+  while ( (segment = (KmsHttpEPSegment *) g_queue_pop_head (&seg->window) ) )
+    g_slice_free (KmsHttpEPSegment, segment);
+
+  if (seg->init_segment != NULL)
+    soup_buffer_free (seg->init_segment);
+
+  g_byte_array_unref (seg->init);
+  g_byte_array_unref (seg->current);
+  kms_http_segment_cache_unref (seg->cache);
+  g_mutex_clear (&seg->mutex);
+  g_free (seg->base);
+
+  g_slice_free (KmsHttpEPSegmenter, seg);
+}
+
+static KmsHttpEPSegmenter *
+get_segmenter (GstElement *httpep)
+{
+  return (KmsHttpEPSegmenter *) g_object_get_data (G_OBJECT (httpep),
+         KEY_SEGMENTER);
+}
+
+static void
+kms_http_ep_segmenter_close_segment (KmsHttpEPSegmenter *seg)
+{
+  KmsHttpEPSegment *segment;
+  SoupBuffer *chunk;
+  gchar *path;
+  guint len;
+
+  seg->current_valid = FALSE;
+
+  if (seg->current->len == 0)
+    return;
+
+  len = seg->current->len;
+  chunk = soup_buffer_new (SOUP_MEMORY_TAKE,
+                           g_byte_array_free (seg->current, FALSE), len);
+  seg->current = g_byte_array_new ();
+
+  path = g_strdup_printf ("%s" SEGMENTED_PREFIX "%u.%s", seg->base, seg->seq,
+                          seg->ext);
+  kms_http_segment_cache_insert (seg->cache, path, chunk);
+  soup_buffer_free (chunk);
+
+  GST_DEBUG ("New segment %s (%u bytes)", path, len);
+  g_free (path);
+
+  segment = g_slice_new (KmsHttpEPSegment);
+  segment->seq = seg->seq++;
+  segment->duration = seg->last - seg->start;
+  g_queue_push_tail (&seg->window, segment);
+
+  if (g_queue_get_length (&seg->window) > SEGMENTED_WINDOW) {
+    segment = (KmsHttpEPSegment *) g_queue_pop_head (&seg->window);
+    g_slice_free (KmsHttpEPSegment, segment);
+  }
+}
+
+static void
+kms_http_ep_segmenter_reset (KmsHttpEPSegmenter *seg)
+{
+  KmsHttpEPSegment *segment;
+
+  /* Sequence numbers keep growing so that cached segments and playlists */
+  /* already fetched by clients never refer to different media */
+  g_byte_array_set_size (seg->current, 0);
+  seg->current_valid = FALSE;
+  seg->ended = FALSE;
+
+  while ( (segment = (KmsHttpEPSegment *) g_queue_pop_head (&seg->window) ) )
+    g_slice_free (KmsHttpEPSegment, segment);
+}
+
+/* Fragments can only be split where a new one begins, that is at the */
+/* moof box of a fragment or the styp box some muxers put before it */
+static gboolean
+kms_http_ep_segmenter_is_boundary (const GstMapInfo *info)
+{
+  if (info->size < 8)
+    return FALSE;
+
+  return memcmp (info->data + 4, "moof", 4) == 0 ||
+         memcmp (info->data + 4, "styp", 4) == 0;
+}
+
+static void
+kms_http_ep_segmenter_push (KmsHttpEPSegmenter *seg, GstBuffer *buffer)
+{
+  GstClockTime ts;
+  GstMapInfo info;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ) ) {
+    GST_WARNING ("Could not get buffer map");
+    return;
+  }
+
+  /* Muxers do not always timestamp their output */
+  if (GST_BUFFER_PTS_IS_VALID (buffer) )
+    ts = GST_BUFFER_PTS (buffer);
+  else
+    ts = g_get_monotonic_time () * GST_USECOND;
+
+  g_mutex_lock (&seg->mutex);
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER) ) {
+    if (seg->headers_done) {
+      /* New stream, a new initialization segment is needed */
+      g_byte_array_set_size (seg->init, 0);
+      seg->headers_done = FALSE;
+      kms_http_ep_segmenter_reset (seg);
+    }
+
+    g_byte_array_append (seg->init, info.data, info.size);
+    goto end;
+  }
+
+  if (!seg->headers_done) {
+    seg->headers_done = TRUE;
+
+    if (seg->init_segment != NULL) {
+      soup_buffer_free (seg->init_segment);
+      seg->init_segment = NULL;
+    }
+
+    if (seg->init->len > 0)
+      seg->init_segment = soup_buffer_new (SOUP_MEMORY_COPY, seg->init->data,
+                                           seg->init->len);
+  }
+
+  if (kms_http_ep_segmenter_is_boundary (&info) ) {
+    if (seg->current_valid && ts >= seg->start &&
+        ts - seg->start >= seg->target) {
+      seg->last = ts;
+      kms_http_ep_segmenter_close_segment (seg);
+    }
+
+    if (!seg->current_valid) {
+      seg->current_valid = TRUE;
+      seg->start = ts;
+    }
+  } else if (!seg->current_valid) {
+    /* Segments must start with a fragment */
+    goto end;
+  }
+
+  seg->last = ts;
+  g_byte_array_append (seg->current, info.data, info.size);
+
+end:
+  g_mutex_unlock (&seg->mutex);
+
+  gst_buffer_unmap (buffer, &info);
+}
+
+static void
+kms_http_ep_segmenter_end (KmsHttpEPSegmenter *seg)
+{
+  g_mutex_lock (&seg->mutex);
+
+  if (seg->current_valid)
+    kms_http_ep_segmenter_close_segment (seg);
+
+  seg->ended = TRUE;
+
+  g_mutex_unlock (&seg->mutex);
+}
+
+static gchar *
+kms_http_ep_segmenter_get_playlist (KmsHttpEPSegmenter *seg)
+{
+  guint target, media_seq = 0;
+  GString *playlist;
+  GList *l;
+
+  g_mutex_lock (&seg->mutex);
+
+  target = (guint) ( (seg->target + GST_SECOND - 1) / GST_SECOND);
+
+  for (l = seg->window.head; l != NULL; l = l->next) {
+    KmsHttpEPSegment *segment = (KmsHttpEPSegment *) l->data;
+    guint secs = (guint) ( (segment->duration + GST_SECOND - 1) / GST_SECOND);
+
+    target = MAX (target, secs);
+  }
+
+  if (seg->window.head != NULL)
+    media_seq = ( (KmsHttpEPSegment *) seg->window.head->data)->seq;
+
+  playlist = g_string_new ("#EXTM3U\n#EXT-X-VERSION:7\n");
+  g_string_append_printf (playlist, "#EXT-X-TARGETDURATION:%u\n", target);
+  g_string_append_printf (playlist, "#EXT-X-MEDIA-SEQUENCE:%u\n", media_seq);
+
+  if (seg->init_segment != NULL)
+    g_string_append_printf (playlist, "#EXT-X-MAP:URI=\"" SEGMENTED_INIT
+                            ".%s\"\n", seg->ext);
+
+  for (l = seg->window.head; l != NULL; l = l->next) {
+    KmsHttpEPSegment *segment = (KmsHttpEPSegment *) l->data;
+
+    guint64 ms = segment->duration / GST_MSECOND;
+
+    /* Avoid locale dependent decimal separators */
+    g_string_append_printf (playlist, "#EXTINF:%" G_GUINT64_FORMAT ".%03u,\n"
+                            SEGMENTED_PREFIX "%u.%s\n", ms / 1000, (guint) (ms % 1000),
+                            segment->seq, seg->ext);
+  }
+
+  if (seg->ended)
+    g_string_append (playlist, "#EXT-X-ENDLIST\n");
+
+  g_mutex_unlock (&seg->mutex);
+
+  return g_string_free (playlist, FALSE);
+}
+
 static GstFlowReturn
 new_sample_handler (GstElement *httpep, gpointer data)
 {
   GstSample *sample = NULL;
   struct sample_data *sdata;
+  KmsHttpEPSegmenter *seg;
+  KmsHttpEPBroadcast *bc;
+  KmsHttpEPWorker *worker;
 
   GST_TRACE ("New-sample in %" GST_PTR_FORMAT, (gpointer) httpep);
 
@@ -251,13 +1236,46 @@ new_sample_handler (GstElement *httpep, gpointer data)
   if (sample == NULL)
     return GST_FLOW_ERROR;
 
+  seg = get_segmenter (httpep);
+
+  if (seg != NULL) {
+    GstBuffer *buffer = gst_sample_get_buffer (sample);
+
+    if (buffer != NULL)
+      kms_http_ep_segmenter_push (seg, buffer);
+
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+  }
+
+  bc = get_broadcast (httpep);
+
+  if (bc != NULL) {
+    GstBuffer *buffer = gst_sample_get_buffer (sample);
+
+    if (buffer != NULL)
+      kms_http_ep_broadcast_dispatch (httpep, bc, buffer);
+
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+  }
+
+  worker = (KmsHttpEPWorker *) g_object_get_data (G_OBJECT (httpep),
+           KEY_WORKER);
+
+  if (worker == NULL) {
+    GST_WARNING ("No client attached to %" GST_PTR_FORMAT, (gpointer) httpep);
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+  }
+
   sdata = g_slice_new (struct sample_data);
   sdata->sample = gst_sample_ref (sample);
   sdata->httpep = GST_ELEMENT (gst_object_ref (httpep) );
 
-  /* Write buffer in the main context thread */
-  g_idle_add_full (G_PRIORITY_HIGH_IDLE, send_buffer_cb, sdata,
-                   destroy_sample_data);
+  /* Write buffer in the context of the worker serving this client */
+  g_main_context_invoke_full (worker->context, G_PRIORITY_HIGH_IDLE,
+                              send_buffer_cb, sdata, destroy_sample_data);
 
   gst_sample_unref (sample);
   return GST_FLOW_OK;
@@ -283,11 +1301,13 @@ get_recv_eos_cb (gpointer data)
 
   uri = soup_message_get_uri (msg);
   path = soup_uri_get_path (uri);
+  kms_http_ep_coalescer_flush (msg);
   soup_message_body_complete (msg->response_body);
 
   serv = (KmsHttpEPServer *) g_object_get_data (G_OBJECT (msg),
          KEY_HTTP_EP_SERVER);
-  g_signal_emit (G_OBJECT (serv), obj_signals[URL_EXPIRED], 0, path);
+  kms_http_ep_server_emit (serv, httpep, URL_EXPIRED, path,
+                           KMS_HTTP_END_POINT_ACTION_UNDEFINED);
 
   return FALSE;
 }
@@ -295,8 +1315,57 @@ get_recv_eos_cb (gpointer data)
 static void
 get_recv_eos (GstElement *httpep, gpointer data)
 {
-  g_idle_add_full (G_PRIORITY_HIGH_IDLE, get_recv_eos_cb,
-                   gst_object_ref (httpep), gst_object_unref);
+  KmsHttpEPSegmenter *seg = get_segmenter (httpep);
+  KmsHttpEPBroadcast *bc = get_broadcast (httpep);
+  KmsHttpEPWorker *worker;
+
+  if (seg != NULL) {
+    /* Playlist gets closed, session expires when clients stop polling */
+    GST_DEBUG ("EOS received in %" GST_PTR_FORMAT, (gpointer) httpep);
+    kms_http_ep_segmenter_end (seg);
+    return;
+  }
+
+  if (bc != NULL) {
+    KmsHttpEPServer *serv = NULL;
+
+    GST_DEBUG ("EOS received in %" GST_PTR_FORMAT, (gpointer) httpep);
+
+    g_rec_mutex_lock (&bc->mutex);
+
+    if (bc->viewers != NULL) {
+      KmsHttpEPViewer *viewer = (KmsHttpEPViewer *) bc->viewers->data;
+
+      serv = (KmsHttpEPServer *) g_object_get_data (G_OBJECT (viewer->msg),
+             KEY_HTTP_EP_SERVER);
+
+      if (serv != NULL)
+        g_object_ref (serv);
+    }
+
+    g_rec_mutex_unlock (&bc->mutex);
+
+    kms_http_ep_broadcast_dispatch (httpep, bc, NULL);
+
+    if (serv != NULL) {
+      kms_http_ep_server_emit (serv, httpep, URL_EXPIRED, bc->uri,
+                               KMS_HTTP_END_POINT_ACTION_UNDEFINED);
+      g_object_unref (serv);
+    }
+
+    return;
+  }
+
+  worker = (KmsHttpEPWorker *) g_object_get_data (G_OBJECT (httpep),
+           KEY_WORKER);
+
+  if (worker == NULL) {
+    GST_WARNING ("No client attached to %" GST_PTR_FORMAT, (gpointer) httpep);
+    return;
+  }
+
+  g_main_context_invoke_full (worker->context, G_PRIORITY_HIGH_IDLE,
+                              get_recv_eos_cb, gst_object_ref (httpep), gst_object_unref);
 }
 
 static void
@@ -308,7 +1377,7 @@ msg_finished (SoupMessage *msg)
   *finished = TRUE;
 }
 
-static gboolean
+static void
 emit_expiration_signal_cb (gpointer user_data)
 {
   SoupMessage *msg = (SoupMessage *) user_data;
@@ -319,14 +1388,25 @@ emit_expiration_signal_cb (gpointer user_data)
   GstElement *httpep;
 
   GST_DEBUG ("Cookie expired for %s", path);
-  g_signal_emit (G_OBJECT (serv), obj_signals[URL_EXPIRED], 0, path);
+  g_atomic_int_inc (&serv->priv->expirations);
+  httpep = kms_http_ep_server_lookup_end_point (serv, path);
+  kms_http_ep_server_emit (serv, httpep, URL_EXPIRED, path,
+                           KMS_HTTP_END_POINT_ACTION_UNDEFINED);
 
-  httpep = (GstElement *) g_hash_table_lookup (serv->priv->handlers, path);
+  if (httpep != NULL) {
+    KmsHttpEPSegmenter *seg = get_segmenter (httpep);
 
-  if (httpep != NULL)
-    remove_timeout (httpep);
+    if (seg != NULL) {
+      /* Nobody is polling the playlist any more */
+      g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
+      g_mutex_lock (&seg->mutex);
+      kms_http_ep_segmenter_reset (seg);
+      seg->requested = FALSE;
+      g_mutex_unlock (&seg->mutex);
+    }
 
-  return FALSE;
+    g_object_unref (httpep);
+  }
 }
 
 static void
@@ -338,23 +1418,19 @@ destroy_guint (guint *id)
 static void
 emit_expiration_signal (SoupMessage *msg, GstElement *httpep)
 {
-  double t_timeout;
-  SoupDate *now;
-  guint *timeout, *id;
+  KmsHttpTimer *timer;
+  guint *timeout;
 
   /* Set a timeout if no more connection are done over this httpendpoint */
-  /* and the cookie expires */
-  now = soup_date_new_from_now (0);
+  /* and the cookie expires. Any previous one is replaced */
+  timer = (KmsHttpTimer *) g_object_get_data (G_OBJECT (httpep), KEY_TIMER);
   timeout = (guint *) g_object_get_data (G_OBJECT (httpep), KEY_PARAM_TIMEOUT);
 
-  t_timeout = difftime (soup_date_to_time_t (now) + *timeout,
-                        soup_date_to_time_t (now) );
+  if (timer == NULL || timeout == NULL)
+    return;
 
-  id = g_slice_new (guint);
-  *id = g_timeout_add_full (G_PRIORITY_DEFAULT, t_timeout * 1000,
-                            emit_expiration_signal_cb, g_object_ref (G_OBJECT (msg) ), g_object_unref);
-  g_object_set_data_full (G_OBJECT (httpep), KEY_TIMEOUT_ID, id,
-                          (GDestroyNotify) destroy_guint);
+  kms_http_timer_schedule (timer, *timeout * 1000,
+                           g_object_ref (G_OBJECT (msg) ), g_object_unref);
 }
 
 static void
@@ -458,10 +1534,8 @@ uninstall_http_get_signals (GstElement *httpep)
 }
 
 static void
-kms_http_ep_server_get_handler (KmsHttpEPServer *self, SoupMessage *msg,
-                                GstElement *httpep)
+set_get_response (SoupMessage *msg, GstElement *httpep)
 {
-  gulong *handlerid;
   gint profile;
 
   /* TODO: Check wether we support client's capabilities before sending */
@@ -483,8 +1557,17 @@ kms_http_ep_server_get_handler (KmsHttpEPServer *self, SoupMessage *msg,
 
   soup_message_headers_set_encoding (msg->response_headers,
                                      SOUP_ENCODING_CHUNKED);
+}
 
+static void
+kms_http_ep_server_get_handler (KmsHttpEPServer *self, SoupMessage *msg,
+                                GstElement *httpep)
+{
+  gulong *handlerid;
+
+  set_get_response (msg, httpep);
   msg_add_finished_property (msg);
+  kms_http_ep_server_set_coalescer (msg, httpep);
 
   handlerid = g_slice_new (gulong);
   *handlerid = g_signal_connect (G_OBJECT (msg), "finished",
@@ -498,6 +1581,136 @@ kms_http_ep_server_get_handler (KmsHttpEPServer *self, SoupMessage *msg,
   g_object_set (G_OBJECT (httpep), "start", TRUE, NULL);
 }
 
+static KmsHttpEPViewer *
+kms_http_ep_broadcast_remove_viewer (KmsHttpEPBroadcast *bc, SoupMessage *msg,
+                                     gboolean *last)
+{
+  KmsHttpEPViewer *viewer = NULL;
+  GSList *l;
+
+  g_rec_mutex_lock (&bc->mutex);
+
+  for (l = bc->viewers; l != NULL; l = l->next) {
+    if ( ( (KmsHttpEPViewer *) l->data)->msg == msg) {
+      viewer = (KmsHttpEPViewer *) l->data;
+      bc->viewers = g_slist_delete_link (bc->viewers, l);
+      break;
+    }
+  }
+
+  *last = (viewer != NULL && bc->viewers == NULL);
+
+  if (*last) {
+    /* Media will stop flowing, so cached frames are no longer valid */
+    kms_http_ep_broadcast_clear_gop (bc);
+  }
+
+  g_rec_mutex_unlock (&bc->mutex);
+
+  return viewer;
+}
+
+static void
+finished_broadcast_processing (SoupMessage *msg, gpointer data)
+{
+  GstElement *httpep = GST_ELEMENT (data);
+  KmsHttpEPBroadcast *bc = get_broadcast (httpep);
+  KmsHttpEPViewer *viewer;
+  gboolean last;
+
+  GST_DEBUG ("Viewer finished %" GST_PTR_FORMAT, (gpointer) msg);
+  msg_finished (msg);
+
+  if (bc == NULL)
+    return;
+
+  viewer = kms_http_ep_broadcast_remove_viewer (bc, msg, &last);
+
+  if (viewer == NULL)
+    return;
+
+  if (last) {
+    /* Expiration only starts counting when nobody is watching */
+    emit_expiration_signal (msg, httpep);
+    g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
+  }
+
+  destroy_viewer (viewer);
+}
+
+static void
+viewer_wrote_body_data (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
+{
+  KmsHttpEPViewer *viewer = (KmsHttpEPViewer *) data;
+
+  /* Written and queued data are both handled in the worker context */
+  viewer->backlog -= MIN (viewer->backlog, chunk->length);
+}
+
+static void
+kms_http_ep_server_broadcast_handler (KmsHttpEPServer *self, SoupMessage *msg,
+                                      GstElement *httpep, KmsHttpEPWorker *worker)
+{
+  KmsHttpEPBroadcast *bc = get_broadcast (httpep);
+  KmsHttpEPViewer *viewer;
+  gulong *handlerid;
+  gboolean first;
+  GList *l;
+
+  set_get_response (msg, httpep);
+  msg_add_finished_property (msg);
+
+  handlerid = g_slice_new (gulong);
+  *handlerid = g_signal_connect (G_OBJECT (msg), "finished",
+                                 G_CALLBACK (finished_broadcast_processing), httpep);
+  g_object_set_data_full (G_OBJECT (msg), KEY_FINISHED_HANDLER_ID, handlerid,
+                          (GDestroyNotify) destroy_ulong);
+
+  viewer = g_slice_new0 (KmsHttpEPViewer);
+  viewer->msg = SOUP_MESSAGE (g_object_ref (msg) );
+  viewer->worker = worker;
+
+  /* Written chunks are released instead of kept until the end */
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+  g_signal_connect (G_OBJECT (msg), "wrote-body-data",
+                    G_CALLBACK (viewer_wrote_body_data), viewer);
+
+  g_rec_mutex_lock (&bc->mutex);
+
+  /* Late joiners get the stream headers and the frames since the last */
+  /* key frame, so they can start decoding right away */
+  for (l = bc->headers; l != NULL; l = l->next) {
+    soup_message_body_append_buffer (msg->response_body,
+                                     (SoupBuffer *) l->data);
+    KMS_HTTP_EP_STATS_ADD (worker, bytes_sent,
+                           ( (SoupBuffer *) l->data)->length);
+    viewer->backlog += ( (SoupBuffer *) l->data)->length;
+  }
+
+  if (bc->gop_valid) {
+    for (l = bc->gop.head; l != NULL; l = l->next)
+      soup_message_body_append_buffer (msg->response_body,
+                                       (SoupBuffer *) l->data);
+
+    KMS_HTTP_EP_STATS_ADD (worker, bytes_sent, bc->gop_size);
+    viewer->backlog += bc->gop_size;
+    viewer->synced = TRUE;
+  }
+
+  viewer->first_seq = bc->seq;
+  first = (bc->viewers == NULL);
+  bc->viewers = g_slist_prepend (bc->viewers, viewer);
+
+  g_rec_mutex_unlock (&bc->mutex);
+
+  GST_DEBUG ("New viewer %" GST_PTR_FORMAT " for %s", (gpointer) msg, bc->uri);
+
+  if (first) {
+    install_http_get_signals (httpep);
+    g_object_set (G_OBJECT (httpep), "start", TRUE, NULL);
+  }
+}
+
 static void
 find_content_part (const gchar *start, const gchar *end,
                    const gchar **content_start, const gchar **content_end,
@@ -556,6 +1769,8 @@ got_chunk_handler (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
 
   GST_INFO ("Chunk callback.");
 
+  KMS_HTTP_EP_STATS_ADD (msg_get_worker (msg), bytes_received, chunk->length);
+
   if (boundary != NULL)
     find_content_part (chunk->data, chunk->data + chunk->length, &content_start,
                        &content_end, boundary);
@@ -682,34 +1897,106 @@ end:
     g_hash_table_destroy (params);
 }
 
+static gboolean
+equal_str_key (gconstpointer a, gconstpointer b)
+{
+  const char *str1 = (const char *) a;
+  const char *str2 = (const char *) b;
+
+  return (g_strcmp0 (str1, str2) == 0);
+}
+
 static void
-emit_removed_url_signal (gpointer data, gpointer user_data)
+emit_removed_url_signal (KmsHttpEPServer *self, GstElement *httpep,
+                         const gchar *uri)
 {
-  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (user_data);
-  gchar *uri = (gchar *) data;
+  KmsHttpEPCallbacks *callbacks = get_callbacks (httpep);
 
   GST_DEBUG ("Emit signal for uri %s", uri);
-  g_signal_emit (G_OBJECT (self), obj_signals[URL_REMOVED], 0, uri);
+  kms_http_ep_server_dispatch (self, callbacks, URL_REMOVED, uri,
+                               KMS_HTTP_END_POINT_ACTION_UNDEFINED);
+
+  if (callbacks != NULL)
+    kms_http_ep_callbacks_unref (callbacks);
 }
 
 static void
 kms_http_ep_server_remove_handlers (KmsHttpEPServer *self)
 {
-  GList *keys;
+  GHashTable *handlers;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  /* Take over all handlers, removed url signals are emitted unlocked */
+  KMS_HTTP_EP_SERVER_LOCK (self);
+
+  handlers = self->priv->handlers;
+  self->priv->handlers = g_hash_table_new_full (g_str_hash, equal_str_key,
+                         g_free, g_object_unref);
+
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  g_hash_table_iter_init (&iter, handlers);
+
+  while (g_hash_table_iter_next (&iter, &key, &value) )
+    emit_removed_url_signal (self, GST_ELEMENT (value), (const gchar *) key);
+
+  g_hash_table_unref (handlers);
+}
+
+static void
+kms_http_ep_server_stop_workers (KmsHttpEPServer *self)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    KmsHttpEPWorker *worker = &self->priv->workers[i];
+
+    if (worker->thread == NULL) {
+      /* Legacy server running in the default main context */
+      soup_server_quit (worker->server);
+      continue;
+    }
+
+    g_main_loop_quit (worker->loop);
+    g_thread_join (worker->thread);
+    worker->thread = NULL;
+  }
+}
+
+static void
+kms_http_ep_server_destroy_workers (KmsHttpEPServer *self)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    KmsHttpEPWorker *worker = &self->priv->workers[i];
+
+    if (worker->thread != NULL) {
+      g_main_loop_quit (worker->loop);
+      g_thread_join (worker->thread);
+      worker->thread = NULL;
+    }
+
+    soup_server_disconnect (worker->server);
+    g_clear_object (&worker->server);
 
-  /* Emit removed url signal for each key */
-  keys = g_hash_table_get_keys (self->priv->handlers);
-  g_list_foreach (keys, (GFunc) emit_removed_url_signal, self);
-  g_list_free (keys);
+    if (worker->loop != NULL)
+      g_main_loop_unref (worker->loop);
 
-  /* Remove handlers */
-  g_hash_table_remove_all (self->priv->handlers);
+    if (worker->context != NULL)
+      g_main_context_unref (worker->context);
+  }
+
+  g_free (self->priv->workers);
+  self->priv->workers = NULL;
+  self->priv->n_workers = 0;
 }
 
 static void
 kms_http_ep_server_stop_impl (KmsHttpEPServer *self)
 {
-  if (self->priv->server == NULL) {
+  if (self->priv->workers == NULL) {
     GST_WARNING ("Server is not started");
     return;
   }
@@ -717,7 +2004,7 @@ kms_http_ep_server_stop_impl (KmsHttpEPServer *self)
   kms_http_ep_server_remove_handlers (self);
 
   /* Stops processing for server */
-  soup_server_quit (self->priv->server);
+  kms_http_ep_server_stop_workers (self);
 }
 
 static void
@@ -728,16 +2015,8 @@ destroy_pending_message (SoupMessage *msg)
   GST_DEBUG ("Destroy pending message %" GST_PTR_FORMAT, (gpointer) msg);
 
   if (msg->method == SOUP_METHOD_GET) {
-    KmsHttpEPServer *serv = KMS_HTTP_EP_SERVER (
-                              g_object_get_data (G_OBJECT (msg), KEY_HTTP_EP_SERVER) );
-    GstElement *httpep = kms_http_ep_server_get_ep_from_msg (serv, msg);
-
-    if (httpep != NULL) {
-      /* Drop internal media flowing in the piepline */
-      g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
-    }
-
-    soup_server_unpause_message (serv->priv->server, msg);
+    kms_http_ep_coalescer_flush (msg);
+    soup_server_unpause_message (msg_get_worker (msg)->server, msg);
     soup_message_body_complete (msg->response_body);
   } else if (msg->method == SOUP_METHOD_POST) {
     handlerid = (gulong *) g_object_get_data (G_OBJECT (msg),
@@ -757,23 +2036,86 @@ destroy_pending_message (SoupMessage *msg)
   g_object_unref (G_OBJECT (msg) );
 }
 
+static gboolean
+destroy_pending_message_cb (gpointer data)
+{
+  destroy_pending_message ( (SoupMessage *) data);
+
+  return FALSE;
+}
+
+static void
+kms_http_ep_server_release_message (GstElement *httpep)
+{
+  SoupMessage *msg;
+
+  msg = (SoupMessage *) g_object_steal_data (G_OBJECT (httpep), KEY_MESSAGE);
+
+  if (msg == NULL)
+    return;
+
+  if (msg->method == SOUP_METHOD_GET) {
+    /* Drop internal media flowing in the piepline */
+    g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
+  }
+
+  /* Soup messages can only be touched from the worker serving them */
+  g_main_context_invoke_full (msg_get_worker (msg)->context,
+                              G_PRIORITY_HIGH_IDLE, destroy_pending_message_cb, msg, NULL);
+}
+
+static void
+kms_http_ep_server_release_viewers (GstElement *httpep)
+{
+  KmsHttpEPBroadcast *bc = get_broadcast (httpep);
+  GSList *viewers, *l;
+
+  if (bc == NULL)
+    return;
+
+  g_rec_mutex_lock (&bc->mutex);
+  viewers = bc->viewers;
+  bc->viewers = NULL;
+  kms_http_ep_broadcast_clear_gop (bc);
+  g_rec_mutex_unlock (&bc->mutex);
+
+  if (viewers != NULL)
+    g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
+
+  for (l = viewers; l != NULL; l = l->next) {
+    KmsHttpEPViewer *viewer = (KmsHttpEPViewer *) l->data;
+
+    /* Message reference is handed over to destroy_pending_message */
+    g_main_context_invoke_full (viewer->worker->context, G_PRIORITY_HIGH_IDLE,
+                                destroy_pending_message_cb, viewer->msg, NULL);
+    g_slice_free (KmsHttpEPViewer, viewer);
+  }
+
+  g_slist_free (viewers);
+}
+
 static gboolean
 kms_http_ep_server_register_handler (KmsHttpEPServer *self, gchar *uri,
                                      GstElement *endpoint)
 {
   GstElement *element;
+  gboolean ret = TRUE;
+
+  KMS_HTTP_EP_SERVER_LOCK (self);
 
   element = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
 
   if (element != NULL) {
     GST_ERROR ("URI %s is already registered for element %s.", uri,
                GST_ELEMENT_NAME (element) );
-    return FALSE;
+    ret = FALSE;
+  } else {
+    g_hash_table_insert (self->priv->handlers, uri, g_object_ref (endpoint) );
   }
 
-  g_hash_table_insert (self->priv->handlers, uri, g_object_ref (endpoint) );
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
 
-  return TRUE;
+  return ret;
 }
 
 static void
@@ -836,47 +2178,512 @@ kms_http_ep_server_manage_cookie_session (KmsHttpEPServer *self,
     GstElement *httpep, SoupMessage *msg, const char *path)
 {
   SoupCookie *cookie;
+  gboolean ret = TRUE;
+
+  /* Workers may race to set the first cookie for the same end point */
+  KMS_HTTP_EP_SERVER_LOCK (self);
 
   cookie = (SoupCookie *) g_object_get_data (G_OBJECT (httpep), KEY_COOKIE);
 
   if (cookie != NULL)
-    return kms_http_ep_server_check_cookie (cookie, msg);
+    ret = kms_http_ep_server_check_cookie (cookie, msg);
+  else
+    kms_http_ep_server_set_cookie (self, httpep, msg, path);
 
-  kms_http_ep_server_set_cookie (self, httpep, msg, path);
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
 
-  return TRUE;
+  return ret;
+}
+
+static void
+finished_playlist_processing (SoupMessage *msg, gpointer data)
+{
+  /* Session expires if the playlist is not requested again */
+  emit_expiration_signal (msg, GST_ELEMENT (data) );
+}
+
+static void
+kms_http_ep_server_set_segment_response (SoupMessage *msg,
+    const gchar *content_type, const gchar *cache_control, SoupBuffer *body)
+{
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_set_content_type (msg->response_headers, content_type,
+                                         NULL);
+  soup_message_headers_replace (msg->response_headers, "Cache-Control",
+                                cache_control);
+  soup_message_headers_set_content_length (msg->response_headers,
+      body->length);
+  soup_message_body_append_buffer (msg->response_body, body);
+  soup_message_body_complete (msg->response_body);
+  KMS_HTTP_EP_STATS_ADD (msg_get_worker (msg), bytes_sent, body->length);
+}
+
+static void
+kms_http_ep_server_segmented_handler (KmsHttpEPServer *self, SoupMessage *msg,
+                                      GstElement *httpep, const gchar *uri, const gchar *path)
+{
+  KmsHttpEPSegmenter *seg = get_segmenter (httpep);
+  SoupBuffer *body = NULL;
+  gchar *name;
+
+  if (msg->method != SOUP_METHOD_GET) {
+    GST_WARNING ("HTTP operation %s is not allowed in segmented mode",
+                 msg->method);
+    soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                  "Not allowed");
+    return;
+  }
+
+  if (g_strcmp0 (path, uri) == 0) {
+    gchar *playlist = kms_http_ep_segmenter_get_playlist (seg);
+    gboolean first;
+
+    body = soup_buffer_new (SOUP_MEMORY_TAKE, playlist, strlen (playlist) );
+    kms_http_ep_server_set_segment_response (msg, SEGMENTED_PLAYLIST_TYPE,
+        "no-cache", body);
+    soup_buffer_free (body);
+
+    g_object_set_data_full (G_OBJECT (msg), KEY_HTTP_EP_SERVER,
+                            g_object_ref (self), g_object_unref);
+    g_signal_connect_data (msg, "finished",
+                           G_CALLBACK (finished_playlist_processing),
+                           gst_object_ref (httpep), (GClosureNotify) gst_object_unref,
+                           (GConnectFlags) 0);
+
+    /* Media flows while clients keep polling the playlist */
+    remove_timeout (httpep);
+    install_http_get_signals (httpep);
+    g_object_set (G_OBJECT (httpep), "start", TRUE, NULL);
+
+    /* Clients poll the playlist, but the session is requested only once */
+    /* until it expires */
+    g_mutex_lock (&seg->mutex);
+    first = !seg->requested;
+    seg->requested = TRUE;
+    g_mutex_unlock (&seg->mutex);
+
+    if (first)
+      kms_http_ep_server_emit (self, httpep, ACTION_REQUESTED, uri,
+                               KMS_HTTP_END_POINT_ACTION_GET);
+
+    return;
+  }
+
+  name = g_path_get_basename (path);
+
+  if (g_str_has_prefix (name, SEGMENTED_INIT ".") ) {
+    g_mutex_lock (&seg->mutex);
+
+    if (seg->init_segment != NULL)
+      body = soup_buffer_copy (seg->init_segment);
+
+    g_mutex_unlock (&seg->mutex);
+  } else if (g_str_has_prefix (name, SEGMENTED_PREFIX) ) {
+    body = kms_http_segment_cache_lookup (seg->cache, path);
+  }
+
+  g_free (name);
+
+  if (body == NULL) {
+    soup_message_set_status_full (msg, SOUP_STATUS_NOT_FOUND,
+                                  "Segment not found");
+    return;
+  }
+
+  kms_http_ep_server_set_segment_response (msg, seg->content_type,
+      SEGMENTED_CACHE_CONTROL, body);
+  soup_buffer_free (body);
+}
+
+static GstElement *
+kms_http_ep_server_lookup_segmented (KmsHttpEPServer *self, const gchar *path,
+                                     gchar **uri)
+{
+  GstElement *httpep;
+  gchar *dir;
+
+  /* Segments are siblings of the playlist the end point is registered on */
+  dir = g_path_get_dirname (path);
+  *uri = g_strdup_printf ("%s/" SEGMENTED_PLAYLIST, dir);
+  g_free (dir);
+
+  httpep = kms_http_ep_server_lookup_end_point (self, *uri);
+
+  if (httpep != NULL && get_segmenter (httpep) == NULL) {
+    g_object_unref (httpep);
+    httpep = NULL;
+  }
+
+  if (httpep == NULL) {
+    g_free (*uri);
+    *uri = NULL;
+  }
+
+  return httpep;
+}
+
+static KmsHttpEPFile *
+kms_http_ep_file_ref (KmsHttpEPFile *file)
+{
+  g_atomic_int_inc (&file->ref_count);
+
+  return file;
+}
+
+static void
+kms_http_ep_file_unref (KmsHttpEPFile *file)
+{
+  if (!g_atomic_int_dec_and_test (&file->ref_count) )
+    return;
+
+  g_free (file->path);
+  g_free (file->content_type);
+  g_slice_free (KmsHttpEPFile, file);
+}
+
+static KmsHttpEPFile *
+kms_http_ep_server_lookup_file (KmsHttpEPServer *self, const gchar *uri)
+{
+  KmsHttpEPFile *file;
+
+  KMS_HTTP_EP_SERVER_LOCK (self);
+
+  file = (KmsHttpEPFile *) g_hash_table_lookup (self->priv->files, uri);
+
+  if (file != NULL)
+    kms_http_ep_file_ref (file);
+
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  return file;
+}
+
+static void
+kms_http_ep_file_reader_free (gpointer data, GClosure *closure)
+{
+  KmsHttpEPFileReader *reader = (KmsHttpEPFileReader *) data;
+
+  close (reader->fd);
+  g_object_unref (reader->socket);
+  g_slice_free (KmsHttpEPFileReader, reader);
+}
+
+/* Appends the next chunk of the file once the previous one is written */
+static void
+kms_http_ep_file_reader_next (SoupMessage *msg, gpointer data)
+{
+  KmsHttpEPFileReader *reader = (KmsHttpEPFileReader *) data;
+  gsize size;
+  gssize n;
+  gchar *buf;
+
+  if (reader->remaining == 0)
+    return;
+
+  size = MIN (reader->remaining, FILE_CHUNK_SIZE);
+  buf = (gchar *) g_malloc (size);
+
+  do {
+    n = read (reader->fd, buf, size);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) {
+    /* File shrank or failed since the response started. Headers with */
+    /* its Content-Length are already out, so the connection is dropped */
+    /* for the client to see the response as truncated */
+    GST_WARNING ("File served to %" GST_PTR_FORMAT " ended %" G_GOFFSET_FORMAT
+                 " bytes early", (gpointer) msg, reader->remaining);
+    g_free (buf);
+    reader->remaining = 0;
+    soup_socket_disconnect (reader->socket);
+    return;
+  }
+
+  reader->remaining -= n;
+  soup_message_body_append_take (msg->response_body, (guchar *) buf, n);
+  KMS_HTTP_EP_STATS_ADD (msg_get_worker (msg), bytes_sent, n);
+
+  if (reader->remaining == 0)
+    soup_message_body_complete (msg->response_body);
+}
+
+static void
+kms_http_ep_server_file_handler (KmsHttpEPServer *self, SoupMessage *msg,
+                                 KmsHttpEPFile *file)
+{
+  KmsHttpEPFileReader *reader;
+  SoupRange *ranges = NULL;
+  goffset start = 0, end, total;
+  struct stat st;
+  gint n_ranges;
+  gint fd;
+
+  if (msg->method != SOUP_METHOD_GET && msg->method != SOUP_METHOD_HEAD) {
+    soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                  "Not allowed");
+    return;
+  }
+
+  fd = g_open (file->path, O_RDONLY, 0);
+
+  if (fd < 0 || fstat (fd, &st) < 0) {
+    GST_WARNING ("Cannot read %s: %s", file->path, g_strerror (errno) );
+
+    if (fd >= 0)
+      close (fd);
+
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  total = st.st_size;
+  end = total - 1;
+
+  /* Range headers that can not be parsed are ignored, which is allowed */
+  if (soup_message_headers_get_ranges (msg->request_headers, total, &ranges,
+                                       &n_ranges) ) {
+    /* Seeking clients ask for a single range. Several ranges get the */
+    /* whole file, which is allowed */
+    if (n_ranges == 1) {
+      start = ranges[0].start;
+      end = ranges[0].end;
+    }
+
+    soup_message_headers_free_ranges (msg->request_headers, ranges);
+  }
+
+  /* Nothing is sent before the file is positioned at the range */
+  if (total > 0 && lseek (fd, start, SEEK_SET) < 0) {
+    GST_WARNING ("Cannot seek %s: %s", file->path, g_strerror (errno) );
+    close (fd);
+    soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+
+  soup_message_headers_replace (msg->response_headers, "Accept-Ranges",
+                                "bytes");
+
+  if (start == 0 && end == total - 1) {
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+    soup_message_headers_set_content_range (msg->response_headers, start, end,
+                                            total);
+  }
+
+  soup_message_headers_set_content_type (msg->response_headers,
+                                         file->content_type, NULL);
+  soup_message_headers_set_content_length (msg->response_headers,
+      end - start + 1);
+
+  if (total == 0 || msg->method == SOUP_METHOD_HEAD) {
+    close (fd);
+    return;
+  }
+
+  reader = g_slice_new (KmsHttpEPFileReader);
+  reader->fd = fd;
+  reader->remaining = end - start + 1;
+  reader->socket = SOUP_SOCKET (g_object_ref (g_object_get_data (G_OBJECT (msg),
+                                KEY_SOCKET) ) );
+
+  /* Only the chunk being written is kept in memory */
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+  g_signal_connect_data (msg, "wrote-chunk",
+                         G_CALLBACK (kms_http_ep_file_reader_next), reader,
+                         kms_http_ep_file_reader_free, (GConnectFlags) 0);
+  kms_http_ep_file_reader_next (msg, reader);
+}
+
+static void
+finished_session (SoupMessage *msg, gpointer data)
+{
+  KmsHttpEPWorker *worker = msg_get_worker (msg);
+
+  if (msg->method == SOUP_METHOD_GET)
+    KMS_HTTP_EP_STATS_ADD (worker, get_sessions, -1);
+  else
+    KMS_HTTP_EP_STATS_ADD (worker, post_sessions, -1);
+}
+
+static void
+kms_http_ep_server_track_session (SoupMessage *msg)
+{
+  KmsHttpEPWorker *worker = msg_get_worker (msg);
+
+  if (msg->status_code != SOUP_STATUS_OK)
+    return;
+
+  if (msg->method == SOUP_METHOD_GET)
+    KMS_HTTP_EP_STATS_ADD (worker, get_sessions, 1);
+  else
+    KMS_HTTP_EP_STATS_ADD (worker, post_sessions, 1);
+
+  g_signal_connect (msg, "finished", G_CALLBACK (finished_session), NULL);
+}
+
+static void
+append_metric (GString *metrics, const gchar *name, const gchar *type,
+               const gchar *help, gint64 value)
+{
+  g_string_append_printf (metrics, "# HELP %s %s\n# TYPE %s %s\n"
+                          "%s %" G_GINT64_FORMAT "\n", name, help, name, type, name, value);
+}
+
+static gchar *
+kms_http_ep_server_get_metrics (KmsHttpEPServer *self)
+{
+  GString *metrics = g_string_new (NULL);
+  gint64 get_sessions = 0, post_sessions = 0;
+  guint64 requests = 0, sent = 0, received = 0;
+  guint i;
+
+  /* Counters are summed up only when they are scraped */
+  for (i = 0; i < self->priv->n_workers; i++) {
+    KmsHttpEPWorker *worker = &self->priv->workers[i];
+
+    get_sessions += KMS_HTTP_EP_STATS_GET (worker, get_sessions);
+    post_sessions += KMS_HTTP_EP_STATS_GET (worker, post_sessions);
+    requests += KMS_HTTP_EP_STATS_GET (worker, requests);
+    sent += KMS_HTTP_EP_STATS_GET (worker, bytes_sent);
+    received += KMS_HTTP_EP_STATS_GET (worker, bytes_received);
+  }
+
+  append_metric (metrics, "kms_http_requests_total", "counter",
+                 "HTTP requests received", requests);
+  append_metric (metrics, "kms_http_get_sessions", "gauge",
+                 "HTTP GET sessions streaming media", get_sessions);
+  append_metric (metrics, "kms_http_post_sessions", "gauge",
+                 "HTTP POST sessions uploading media", post_sessions);
+  append_metric (metrics, "kms_http_sent_bytes_total", "counter",
+                 "Media bytes sent to HTTP clients", sent);
+  append_metric (metrics, "kms_http_received_bytes_total", "counter",
+                 "Media bytes received from HTTP clients", received);
+  append_metric (metrics, "kms_http_expirations_total", "counter",
+                 "HTTP end point sessions expired",
+                 g_atomic_int_get (&self->priv->expirations) );
+  append_metric (metrics, "kms_http_expiration_timers", "gauge",
+                 "HTTP end point sessions waiting to expire",
+                 kms_http_timer_queue_get_length (self->priv->timers) );
+  append_metric (metrics, "kms_http_event_queue_depth", "gauge",
+                 "HTTP end point events waiting to be notified",
+                 g_atomic_int_get (&self->priv->pending_emits) );
+
+  g_rec_mutex_lock (&self->priv->metrics_mutex);
+
+  if (self->priv->metrics_func != NULL)
+    self->priv->metrics_func (self, metrics, self->priv->metrics_data);
+
+  g_rec_mutex_unlock (&self->priv->metrics_mutex);
+
+  return g_string_free (metrics, FALSE);
+}
+
+static void
+kms_http_ep_server_metrics_handler (KmsHttpEPServer *self, SoupMessage *msg)
+{
+  gchar *metrics;
+
+  if (msg->method != SOUP_METHOD_GET) {
+    soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                  "Not allowed");
+    return;
+  }
+
+  metrics = kms_http_ep_server_get_metrics (self);
+
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_replace (msg->response_headers, "Cache-Control",
+                                "no-cache");
+  soup_message_set_response (msg, METRICS_CONTENT_TYPE, SOUP_MEMORY_TAKE,
+                             metrics, strlen (metrics) );
 }
 
 static void
 got_headers_handler (SoupMessage *msg, gpointer data)
 {
   KmsHttpEndPointAction action = KMS_HTTP_END_POINT_ACTION_UNDEFINED;
-  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
+  KmsHttpEPWorker *worker = (KmsHttpEPWorker *) data;
+  KmsHttpEPServer *self = worker->self;
   SoupURI *uri = soup_message_get_uri (msg);
   const char *path = soup_uri_get_path (uri);
+  KmsHttpEPFile *file;
   GstElement *httpep;
 
-  httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, path);
+  KMS_HTTP_EP_STATS_ADD (worker, requests, 1);
+
+  if (g_strcmp0 (path, KMS_HTTP_EP_SERVER_METRICS_PATH) == 0) {
+    kms_http_ep_server_metrics_handler (self, msg);
+    return;
+  }
+
+  file = kms_http_ep_server_lookup_file (self, path);
+
+  if (file != NULL) {
+    kms_http_ep_server_file_handler (self, msg, file);
+    kms_http_ep_file_unref (file);
+    return;
+  }
+
+  httpep = kms_http_ep_server_lookup_end_point (self, path);
+
+  if (httpep == NULL || get_segmenter (httpep) != NULL) {
+    gchar *segmented_uri = NULL;
+
+    if (httpep == NULL)
+      httpep = kms_http_ep_server_lookup_segmented (self, path, &segmented_uri);
+    else
+      segmented_uri = g_strdup (path);
+
+    if (httpep == NULL) {
+      /* URI is not registered */
+      soup_message_set_status_full (msg, SOUP_STATUS_NOT_FOUND,
+                                    "Http end point not found");
+      return;
+    }
+
+    kms_http_ep_server_segmented_handler (self, msg, httpep, segmented_uri,
+                                          path);
+    g_free (segmented_uri);
+    goto end;
+  }
+
+  if (get_broadcast (httpep) != NULL) {
+    /* Broadcast end points are shared, so there is no cookie session */
+    if (msg->method != SOUP_METHOD_GET) {
+      GST_WARNING ("HTTP operation %s is not allowed in broadcast mode",
+                   msg->method);
+      soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                    "Not allowed");
+      goto end;
+    }
 
-  if (httpep == NULL) {
-    /* URI is not registered */
-    soup_message_set_status_full (msg, SOUP_STATUS_NOT_FOUND,
-                                  "Http end point not found");
-    return;
+    remove_timeout (httpep);
+
+    g_object_set_data_full (G_OBJECT (msg), KEY_HTTP_EP_SERVER,
+                            g_object_ref (self), g_object_unref);
+
+    kms_http_ep_server_broadcast_handler (self, msg, httpep, worker);
+    kms_http_ep_server_track_session (msg);
+    kms_http_ep_server_emit (self, httpep, ACTION_REQUESTED, path,
+                             KMS_HTTP_END_POINT_ACTION_GET);
+    goto end;
   }
 
   if (!kms_http_ep_server_manage_cookie_session (self, httpep, msg, path) ) {
     GST_TRACE ("Request declined because of a cookie error");
     soup_message_set_status_full (msg, SOUP_STATUS_BAD_REQUEST,
                                   "Invalid cookie");
-    return;
+    goto end;
   }
 
   remove_timeout (httpep);
 
   /* Bind message life cicle to this httpendpoint */
+  kms_http_ep_server_release_message (httpep);
   g_object_set_data_full (G_OBJECT (httpep), KEY_MESSAGE,
                           g_object_ref (G_OBJECT (msg) ), (GDestroyNotify) destroy_pending_message);
+  g_object_set_data (G_OBJECT (httpep), KEY_WORKER, worker);
 
   /* Common parameters used for both, get and post operations */
   g_object_set_data_full (G_OBJECT (msg), KEY_HTTP_EP_SERVER,
@@ -892,35 +2699,50 @@ got_headers_handler (SoupMessage *msg, gpointer data)
     GST_WARNING ("HTTP operation %s is not allowed", msg->method);
     soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
                                   "Not allowed");
-    return;
+    goto end;
   }
 
-  g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
-                 action);
+  kms_http_ep_server_track_session (msg);
+  kms_http_ep_server_emit (self, httpep, ACTION_REQUESTED, path, action);
+
+end:
+  g_object_unref (httpep);
 }
 
 static void
 request_started_handler (SoupServer *server, SoupMessage *msg,
                          SoupClientContext *client, gpointer data)
 {
+  /* Remember which worker is serving this message */
+  g_object_set_data (G_OBJECT (msg), KEY_WORKER, data);
+  /* and its connection, which is dropped to abort a response */
+  g_object_set_data_full (G_OBJECT (msg), KEY_SOCKET,
+                          g_object_ref (soup_client_context_get_socket (client) ),
+                          g_object_unref);
   g_signal_connect (msg, "got-headers", G_CALLBACK (got_headers_handler), data);
 }
 
 static void
 kms_http_ep_server_create_server (KmsHttpEPServer *self, SoupAddress *addr)
 {
+  KmsHttpEPWorker *worker;
   SoupSocket *listener;
 
-  self->priv->server = soup_server_new (SOUP_SERVER_PORT, self->priv->port,
-                                        SOUP_SERVER_INTERFACE, addr, NULL);
+  self->priv->workers = g_new0 (KmsHttpEPWorker, 1);
+  self->priv->n_workers = 1;
+
+  worker = &self->priv->workers[0];
+  worker->self = self;
+  worker->server = soup_server_new (SOUP_SERVER_PORT, self->priv->port,
+                                    SOUP_SERVER_INTERFACE, addr, NULL);
 
   /* Connect server signals handlers */
-  g_signal_connect (self->priv->server, "request-started",
-                    G_CALLBACK (request_started_handler), self);
+  g_signal_connect (worker->server, "request-started",
+                    G_CALLBACK (request_started_handler), worker);
 
-  soup_server_run_async (self->priv->server);
+  soup_server_run_async (worker->server);
 
-  listener = soup_server_get_listener (self->priv->server);
+  listener = soup_server_get_listener (worker->server);
 
   if (!soup_socket_is_connected (listener) ) {
     GST_ERROR ("Server socket is not connected");
@@ -945,6 +2767,180 @@ kms_http_ep_server_create_server (KmsHttpEPServer *self, SoupAddress *addr)
              self->priv->port );
 }
 
+#if SOUP_CHECK_VERSION (2, 48, 0)
+
+static gpointer
+kms_http_ep_server_worker_thread (gpointer data)
+{
+  KmsHttpEPWorker *worker = (KmsHttpEPWorker *) data;
+
+  g_main_context_push_thread_default (worker->context);
+  g_main_loop_run (worker->loop);
+  g_main_context_pop_thread_default (worker->context);
+
+  return NULL;
+}
+
+static GSocket *
+kms_http_ep_server_create_socket (GSocketAddress *saddr, GError **err)
+{
+  GSocket *socket;
+
+  socket = g_socket_new (g_socket_address_get_family (saddr),
+                         G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, err);
+
+  if (socket == NULL)
+    return NULL;
+
+#ifdef SO_REUSEPORT
+  {
+    gint on = 1;
+
+    /* Let the kernel balance connections among every worker socket */
+    if (setsockopt (g_socket_get_fd (socket), SOL_SOCKET, SO_REUSEPORT, &on,
+                    sizeof (on) ) < 0)
+      GST_WARNING ("Can not set SO_REUSEPORT on listening socket");
+  }
+#endif
+
+  if (!g_socket_bind (socket, saddr, TRUE, err) ||
+      !g_socket_listen (socket, err) ) {
+    g_object_unref (socket);
+    return NULL;
+  }
+
+  return socket;
+}
+
+static void
+kms_http_ep_server_update_address (KmsHttpEPServer *self, GSocket *socket)
+{
+  GSocketAddress *local;
+  GInetAddress *inet;
+
+  local = g_socket_get_local_address (socket, NULL);
+
+  if (local == NULL)
+    return;
+
+  inet = g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (local) );
+
+  if (self->priv->iface == NULL)
+    self->priv->iface = g_inet_address_to_string (inet);
+
+  if (self->priv->port == 0)
+    self->priv->port = g_inet_socket_address_get_port (
+                         G_INET_SOCKET_ADDRESS (local) );
+
+  g_object_unref (local);
+}
+
+static gboolean
+kms_http_ep_server_create_workers (KmsHttpEPServer *self, SoupAddress *addr,
+                                   GError **err)
+{
+  GSocketAddress *saddr;
+  guint i;
+
+  if (addr != NULL) {
+    saddr = soup_address_get_gsockaddr (addr);
+  } else {
+    GInetAddress *any = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+
+    saddr = g_inet_socket_address_new (any, self->priv->port);
+    g_object_unref (any);
+  }
+
+#ifndef SO_REUSEPORT
+
+  if (self->priv->threads > 1) {
+    GST_WARNING ("SO_REUSEPORT is not supported. Using only one worker");
+    self->priv->threads = 1;
+  }
+
+#endif
+
+  self->priv->workers = g_new0 (KmsHttpEPWorker, self->priv->threads);
+
+  for (i = 0; i < self->priv->threads; i++) {
+    KmsHttpEPWorker *worker = &self->priv->workers[self->priv->n_workers];
+    GSocket *socket;
+    gboolean ret;
+
+    socket = kms_http_ep_server_create_socket (saddr, err);
+
+    if (socket == NULL)
+      break;
+
+    if (i == 0) {
+      /* The rest of workers will share the port picked by the first one */
+      kms_http_ep_server_update_address (self, socket);
+      g_object_unref (saddr);
+      saddr = g_socket_get_local_address (socket, NULL);
+    }
+
+    worker->self = self;
+    worker->context = g_main_context_new ();
+    worker->loop = g_main_loop_new (worker->context, FALSE);
+    worker->server = soup_server_new (NULL, NULL);
+
+    g_signal_connect (worker->server, "request-started",
+                      G_CALLBACK (request_started_handler), worker);
+
+    /* Server sources are attached to the thread default context */
+    g_main_context_push_thread_default (worker->context);
+    ret = soup_server_listen_socket (worker->server, socket,
+                                     (SoupServerListenOptions) 0, err);
+    g_main_context_pop_thread_default (worker->context);
+    g_object_unref (socket);
+
+    self->priv->n_workers++;
+
+    if (!ret)
+      break;
+
+    worker->thread = g_thread_new ("HttpEPWorker",
+                                   kms_http_ep_server_worker_thread, worker);
+  }
+
+  g_object_unref (saddr);
+
+  if (self->priv->n_workers == self->priv->threads &&
+      self->priv->workers[self->priv->n_workers - 1].thread != NULL) {
+    GST_DEBUG ("Http end point server running in %s:%d with %u workers",
+               self->priv->iface, self->priv->port, self->priv->n_workers);
+    return TRUE;
+  }
+
+  kms_http_ep_server_destroy_workers (self);
+
+  return FALSE;
+}
+
+#endif /* SOUP_CHECK_VERSION (2, 48, 0) */
+
+static void
+kms_http_ep_server_run (KmsHttpEPServer *self, SoupAddress *addr,
+                        GError **err)
+{
+  if (self->priv->threads > 0) {
+#if SOUP_CHECK_VERSION (2, 48, 0)
+
+    if (!kms_http_ep_server_create_workers (self, addr, err) ) {
+      GST_ERROR ("Can not start http end point server workers");
+      g_prefix_error (err, "Can not start workers: ");
+    }
+
+    return;
+#else
+    GST_WARNING ("Worker threads require libsoup 2.48. "
+                 "Running server in the main context");
+#endif
+  }
+
+  kms_http_ep_server_create_server (self, addr);
+}
+
 static void
 soup_address_callback (SoupAddress *addr, guint status, gpointer user_data)
 {
@@ -954,7 +2950,7 @@ soup_address_callback (SoupAddress *addr, guint status, gpointer user_data)
   switch (status) {
   case SOUP_STATUS_OK:
     GST_DEBUG ("Domain name resolved");
-    kms_http_ep_server_create_server (rdata->server, addr);
+    kms_http_ep_server_run (rdata->server, addr, &gerr);
     break;
 
   case SOUP_STATUS_CANCELLED:
@@ -990,14 +2986,27 @@ kms_http_ep_server_start_impl (KmsHttpEPServer *self,
   struct resolv_data *rdata;
   SoupAddress *addr = NULL;
 
-  if (self->priv->server != NULL) {
+  if (self->priv->workers != NULL) {
     GST_WARNING ("Server is already running");
     return;
   }
 
+  /* Signals will be emitted in the context the server is started from */
+  if (self->priv->context != NULL)
+    g_main_context_unref (self->priv->context);
+
+  self->priv->context = g_main_context_ref_thread_default ();
+  kms_http_timer_queue_attach (self->priv->timers, self->priv->context);
+
   if (self->priv->iface == NULL) {
-    kms_http_ep_server_create_server (self, NULL);
-    start_cb (self, NULL);
+    GError *gerr = NULL;
+
+    kms_http_ep_server_run (self, NULL, &gerr);
+    start_cb (self, gerr);
+
+    if (gerr != NULL)
+      g_error_free (gerr);
+
     return;
   }
 
@@ -1023,26 +3032,50 @@ add_guint_param (GstElement *httpep, const gchar *name, guint val)
                           (GDestroyNotify) destroy_guint);
 }
 
+static KmsHttpSegmentCache *
+kms_http_ep_server_get_cache (KmsHttpEPServer *self)
+{
+  KmsHttpSegmentCache *cache;
+
+  KMS_HTTP_EP_SERVER_LOCK (self);
+
+  if (self->priv->cache == NULL)
+    self->priv->cache = kms_http_segment_cache_new (self->priv->cache_size);
+
+  cache = self->priv->cache;
+
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  return cache;
+}
+
 static const gchar *
 kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
-    GstElement *endpoint, guint timeout)
+    GstElement *endpoint, guint timeout, KmsHttpEPServerFlags flags)
 {
   gchar *url;
   uuid_t uuid;
   gchar *uuid_str;
 
-  /* Check whether this is really an httpendpoint element */
-  if (http_t == G_TYPE_INVALID) {
+  /* Check whether this is really an httpendpoint element. End points */
+  /* may be registered from any thread */
+  if (g_once_init_enter (&http_t) ) {
     GstElementFactory *http_f;
+    GType type = G_TYPE_INVALID;
 
     http_f = gst_element_factory_find ("httpendpoint");
 
-    if (http_f == NULL) {
-      GST_ERROR ("No httpendpoint factory found");
-      return NULL;
+    if (http_f != NULL) {
+      type = gst_element_factory_get_element_type (http_f);
+      gst_object_unref (http_f);
     }
 
-    http_t = gst_element_factory_get_element_type (http_f);
+    g_once_init_leave (&http_t, type);
+  }
+
+  if (http_t == G_TYPE_INVALID) {
+    GST_ERROR ("No httpendpoint factory found");
+    return NULL;
   }
 
   if (!KMS_IS_EXPECTED_TYPE (endpoint, http_t) ) {
@@ -1050,12 +3083,28 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
     return NULL;
   }
 
+  if (flags & KMS_HTTP_EP_SERVER_FLAG_SEGMENTED) {
+    gint profile;
+
+    g_object_get (G_OBJECT (endpoint), "profile", &profile, NULL);
+
+    if (profile != 1 /* mp4 */) {
+      GST_ERROR ("Segmented end point %s needs the MP4 profile",
+                 GST_ELEMENT_NAME (endpoint) );
+      return NULL;
+    }
+  }
+
   uuid_str = (gchar *) g_malloc (UUID_STR_SIZE);
   uuid_generate (uuid);
   uuid_unparse (uuid, uuid_str);
 
   /* Create URL from uuid string and add it to list of handlers */
-  url = g_strdup_printf ("/%s", uuid_str);
+  if (flags & KMS_HTTP_EP_SERVER_FLAG_SEGMENTED)
+    url = g_strdup_printf ("/%s/" SEGMENTED_PLAYLIST, uuid_str);
+  else
+    url = g_strdup_printf ("/%s", uuid_str);
+
   g_free (uuid_str);
 
   if (!kms_http_ep_server_register_handler (self, url, endpoint) ) {
@@ -1063,7 +3112,36 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
     return NULL;
   }
 
+  if (flags & KMS_HTTP_EP_SERVER_FLAG_SEGMENTED) {
+    KmsHttpEPSegmenter *seg;
+
+    seg = kms_http_ep_segmenter_new (kms_http_ep_server_get_cache (self), url,
+                                     self->priv->segment_duration);
+    g_object_set_data_full (G_OBJECT (endpoint), KEY_SEGMENTER, seg,
+                            (GDestroyNotify) kms_http_ep_segmenter_free);
+
+    timeout = MAX (timeout, SEGMENTED_EXPIRATION_FACTOR *
+                   self->priv->segment_duration);
+    flags = (KmsHttpEPServerFlags) (flags & ~KMS_HTTP_EP_SERVER_FLAG_BROADCAST);
+  } else {
+    g_object_set_data (G_OBJECT (endpoint), KEY_SEGMENTER, NULL);
+  }
+
   add_guint_param (endpoint, KEY_PARAM_TIMEOUT, timeout);
+  g_object_set_data_full (G_OBJECT (endpoint), KEY_TIMER,
+                          kms_http_timer_new (self->priv->timers, emit_expiration_signal_cb),
+                          (GDestroyNotify) kms_http_timer_free);
+  add_guint_param (endpoint, KEY_PARAM_COALESCE_SIZE,
+                   self->priv->coalesce_size);
+  add_guint_param (endpoint, KEY_PARAM_COALESCE_LATENCY,
+                   self->priv->coalesce_latency);
+
+  if (flags & KMS_HTTP_EP_SERVER_FLAG_BROADCAST)
+    g_object_set_data_full (G_OBJECT (endpoint), KEY_BROADCAST,
+                            kms_http_ep_broadcast_new (url),
+                            (GDestroyNotify) kms_http_ep_broadcast_free);
+  else
+    g_object_set_data (G_OBJECT (endpoint), KEY_BROADCAST, NULL);
 
   return url;
 }
@@ -1072,28 +3150,51 @@ static gboolean
 kms_http_ep_server_unregister_end_point_impl (KmsHttpEPServer *self,
     const gchar *uri)
 {
-  GstElement *httpep;
+  GstElement *httpep = NULL;
+  KmsHttpEPSegmenter *seg;
 
   GST_DEBUG ("Unregister uri: %s", uri);
 
-  if (self->priv->handlers == NULL)
-    return FALSE;
+  KMS_HTTP_EP_SERVER_LOCK (self);
+
+  if (self->priv->handlers != NULL) {
+    httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
+
+    if (httpep != NULL) {
+      g_object_ref (httpep);
+      g_hash_table_remove (self->priv->handlers, uri);
+    }
+  }
+
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
 
-  if (!g_hash_table_contains (self->priv->handlers, uri) ) {
+  if (httpep == NULL) {
     GST_DEBUG ("Uri %s is not registered", uri);
     return FALSE;
   }
 
-  httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
   uninstall_http_get_signals (httpep);
 
   remove_timeout (httpep);
 
+  seg = get_segmenter (httpep);
+
+  if (seg != NULL) {
+    /* Segments can not be requested any more */
+    g_object_set (G_OBJECT (httpep), "start", FALSE, NULL);
+    kms_http_segment_cache_remove_prefix (seg->cache, seg->base);
+  }
+
   /* Cancel current transtacion */
-  g_object_set_data_full (G_OBJECT (httpep), KEY_MESSAGE, NULL, NULL);
+  kms_http_ep_server_release_message (httpep);
+  kms_http_ep_server_release_viewers (httpep);
+
+  /* Unregistration may come from any thread but listeners are always */
+  /* notified from the server context */
+  kms_http_ep_server_emit (self, httpep, URL_REMOVED, uri,
+                           KMS_HTTP_END_POINT_ACTION_UNDEFINED);
+  g_object_unref (httpep);
 
-  g_hash_table_remove (self->priv->handlers, uri);
-  emit_removed_url_signal ( (gpointer) uri, self);
   return TRUE;
 }
 
@@ -1104,10 +3205,8 @@ kms_http_ep_server_dispose (GObject *obj)
 
   GST_DEBUG_OBJECT (self, "dispose");
 
-  if (self->priv->server) {
-    soup_server_disconnect (self->priv->server);
-    g_clear_object (&self->priv->server);
-  }
+  if (self->priv->workers != NULL)
+    kms_http_ep_server_destroy_workers (self);
 
   /* Chain up to the parent class */
   G_OBJECT_CLASS (kms_http_ep_server_parent_class)->dispose (obj);
@@ -1136,11 +3235,38 @@ kms_http_ep_server_finalize (GObject *obj)
     self->priv->handlers = NULL;
   }
 
+  if (self->priv->files != NULL) {
+    g_hash_table_unref (self->priv->files);
+    self->priv->files = NULL;
+  }
+
   if (self->priv->rand != NULL) {
     g_rand_free (self->priv->rand);
     self->priv->rand = NULL;
   }
 
+  if (self->priv->timers != NULL) {
+    kms_http_timer_queue_detach (self->priv->timers);
+    kms_http_timer_queue_unref (self->priv->timers);
+    self->priv->timers = NULL;
+  }
+
+  if (self->priv->context != NULL) {
+    g_main_context_unref (self->priv->context);
+    self->priv->context = NULL;
+  }
+
+  if (self->priv->cache != NULL) {
+    kms_http_segment_cache_unref (self->priv->cache);
+    self->priv->cache = NULL;
+  }
+
+  if (self->priv->metrics_notify != NULL)
+    self->priv->metrics_notify (self->priv->metrics_data);
+
+  g_rec_mutex_clear (&self->priv->metrics_mutex);
+  g_mutex_clear (&self->priv->mutex);
+
   /* Chain up to the parent class */
   G_OBJECT_CLASS (kms_http_ep_server_parent_class)->finalize (obj);
 }
@@ -1180,6 +3306,26 @@ kms_http_ep_server_set_property (GObject *obj, guint prop_id,
     break;
   }
 
+  case PROP_KMS_HTTP_EP_SERVER_WORKERS:
+    self->priv->threads = g_value_get_uint (value);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_SEGMENT_DURATION:
+    self->priv->segment_duration = g_value_get_uint (value);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE:
+    self->priv->cache_size = g_value_get_uint (value);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_COALESCE_SIZE:
+    self->priv->coalesce_size = g_value_get_uint (value);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_COALESCE_LATENCY:
+    self->priv->coalesce_latency = g_value_get_uint (value);
+    break;
+
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
@@ -1206,6 +3352,26 @@ kms_http_ep_server_get_property (GObject *obj, guint prop_id, GValue *value,
     g_value_set_string (value, self->priv->announcedAddr);
     break;
 
+  case PROP_KMS_HTTP_EP_SERVER_WORKERS:
+    g_value_set_uint (value, self->priv->threads);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_SEGMENT_DURATION:
+    g_value_set_uint (value, self->priv->segment_duration);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE:
+    g_value_set_uint (value, self->priv->cache_size);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_COALESCE_SIZE:
+    g_value_set_uint (value, self->priv->coalesce_size);
+    break;
+
+  case PROP_KMS_HTTP_EP_SERVER_COALESCE_LATENCY:
+    g_value_set_uint (value, self->priv->coalesce_latency);
+    break;
+
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
@@ -1252,6 +3418,54 @@ kms_http_ep_server_class_init (KmsHttpEPServerClass *klass)
                          KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE,
                          (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
 
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_WORKERS] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_WORKERS,
+                       "Worker threads",
+                       "Number of threads accepting requests on the same port. "
+                       "Zero runs the server in the default main context",
+                       0,
+                       KMS_HTTP_EP_SERVER_MAX_WORKERS,
+                       KMS_HTTP_EP_SERVER_DEFAULT_WORKERS,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_SEGMENT_DURATION] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_SEGMENT_DURATION,
+                       "Segment duration",
+                       "Target duration in seconds of segmented end points' segments",
+                       1,
+                       KMS_HTTP_EP_SERVER_MAX_SEGMENT_DURATION,
+                       KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_DURATION,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE,
+                       "Segment cache size",
+                       "Maximum number of bytes used to keep segments in memory",
+                       0,
+                       G_MAXUINT,
+                       KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_CACHE_SIZE,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_COALESCE_SIZE] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_COALESCE_SIZE,
+                       "Coalesce size",
+                       "Bytes of media gathered before they are written to a "
+                       "GET response by default. Zero writes every sample",
+                       0,
+                       G_MAXUINT,
+                       KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_SIZE,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_COALESCE_LATENCY] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_COALESCE_LATENCY,
+                       "Coalesce latency",
+                       "Milliseconds media may be held back before it is "
+                       "written to a GET response by default. Zero writes every sample",
+                       0,
+                       KMS_HTTP_EP_SERVER_MAX_COALESCE_LATENCY,
+                       KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_LATENCY,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
   g_object_class_install_properties (gobject_class,
                                      N_PROPERTIES,
                                      obj_properties);
@@ -1282,27 +3496,31 @@ kms_http_ep_server_class_init (KmsHttpEPServerClass *klass)
   g_type_class_add_private (klass, sizeof (KmsHttpEPServerPrivate) );
 }
 
-static gboolean
-equal_str_key (gconstpointer a, gconstpointer b)
-{
-  const char *str1 = (const char *) a;
-  const char *str2 = (const char *) b;
-
-  return (g_strcmp0 (str1, str2) == 0);
-}
-
 static void
 kms_http_ep_server_init (KmsHttpEPServer *self)
 {
   self->priv = KMS_HTTP_EP_SERVER_GET_PRIVATE (self);
 
   /* Set default values */
-  self->priv->server = NULL;
+  self->priv->workers = NULL;
+  self->priv->n_workers = 0;
+  self->priv->threads = KMS_HTTP_EP_SERVER_DEFAULT_WORKERS;
+  self->priv->segment_duration = KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_DURATION;
+  self->priv->cache_size = KMS_HTTP_EP_SERVER_DEFAULT_SEGMENT_CACHE_SIZE;
+  self->priv->coalesce_size = KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_SIZE;
+  self->priv->coalesce_latency = KMS_HTTP_EP_SERVER_DEFAULT_COALESCE_LATENCY;
+  self->priv->cache = NULL;
+  self->priv->context = NULL;
   self->priv->port = KMS_HTTP_EP_SERVER_DEFAULT_PORT;
   self->priv->iface = KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE;
   self->priv->announcedAddr = KMS_HTTP_EP_SERVER_DEFAULT_ANNOUNCED_ADDRESS;
   self->priv->handlers = g_hash_table_new_full (g_str_hash, equal_str_key,
                          g_free, g_object_unref);
+  self->priv->files = g_hash_table_new_full (g_str_hash, equal_str_key,
+                      g_free, (GDestroyNotify) kms_http_ep_file_unref);
+  self->priv->timers = kms_http_timer_queue_new ();
+  g_mutex_init (&self->priv->mutex);
+  g_rec_mutex_init (&self->priv->metrics_mutex);
 
   self->priv->rand = g_rand_new();
 }
@@ -1343,11 +3561,19 @@ kms_http_ep_server_stop (KmsHttpEPServer *self)
 const gchar *
 kms_http_ep_server_register_end_point (KmsHttpEPServer *self,
                                        GstElement *endpoint, guint timeout)
+{
+  return kms_http_ep_server_register_end_point_full (self, endpoint, timeout,
+         KMS_HTTP_EP_SERVER_FLAG_NONE);
+}
+
+const gchar *
+kms_http_ep_server_register_end_point_full (KmsHttpEPServer *self,
+    GstElement *endpoint, guint timeout, KmsHttpEPServerFlags flags)
 {
   g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), NULL);
 
   return KMS_HTTP_EP_SERVER_GET_CLASS (self)->register_end_point (self,
-         endpoint, timeout);
+         endpoint, timeout, flags);
 }
 
 gboolean
@@ -1358,3 +3584,140 @@ kms_http_ep_server_unregister_end_point (KmsHttpEPServer *self,
 
   return KMS_HTTP_EP_SERVER_GET_CLASS (self)->unregister_end_point (self, uri);
 }
+
+gboolean
+kms_http_ep_server_set_end_point_callbacks (KmsHttpEPServer *self,
+    const gchar *uri, const KmsHttpEPServerCallbacks *callbacks, gpointer data,
+    GDestroyNotify notify)
+{
+  KmsHttpEPCallbacks *cb = NULL;
+  GstElement *httpep;
+
+  g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), FALSE);
+
+  httpep = kms_http_ep_server_lookup_end_point (self, uri);
+
+  if (httpep == NULL) {
+    GST_WARNING ("Uri %s is not registered", uri);
+    return FALSE;
+  }
+
+  if (callbacks != NULL) {
+    cb = g_slice_new0 (KmsHttpEPCallbacks);
+    cb->ref_count = 1;
+    g_rec_mutex_init (&cb->mutex);
+    cb->callbacks = *callbacks;
+    cb->valid = TRUE;
+    cb->data = data;
+    cb->notify = notify;
+  }
+
+  /* Previous callbacks, if any, are invalidated when replaced */
+  g_object_set_data_full (G_OBJECT (httpep), KEY_CALLBACKS, cb,
+                          (GDestroyNotify) destroy_callbacks);
+  g_object_unref (httpep);
+
+  return TRUE;
+}
+
+const gchar *
+kms_http_ep_server_register_file (KmsHttpEPServer *self, const gchar *path,
+                                  const gchar *content_type, GError **err)
+{
+  KmsHttpEPFile *file;
+  uuid_t uuid;
+  gchar *uuid_str;
+  gchar *url;
+
+  g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (g_access (path, R_OK) < 0) {
+    gint saved_errno = errno;
+
+    g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                 "Cannot read %s: %s", path, g_strerror (saved_errno) );
+    return NULL;
+  }
+
+  file = g_slice_new0 (KmsHttpEPFile);
+  file->ref_count = 1;
+  file->path = g_strdup (path);
+  file->content_type = g_strdup (content_type != NULL ? content_type :
+                                 "application/octet-stream");
+
+  uuid_str = (gchar *) g_malloc (UUID_STR_SIZE);
+  uuid_generate (uuid);
+  uuid_unparse (uuid, uuid_str);
+  url = g_strdup_printf ("/%s", uuid_str);
+  g_free (uuid_str);
+
+  KMS_HTTP_EP_SERVER_LOCK (self);
+  g_hash_table_insert (self->priv->files, url, file);
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  GST_DEBUG ("File %s served in %s", path, url);
+
+  return url;
+}
+
+gboolean
+kms_http_ep_server_unregister_file (KmsHttpEPServer *self, const gchar *uri)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), FALSE);
+
+  /* Requests being served keep reading from their own descriptor */
+  KMS_HTTP_EP_SERVER_LOCK (self);
+  ret = g_hash_table_remove (self->priv->files, uri);
+  KMS_HTTP_EP_SERVER_UNLOCK (self);
+
+  return ret;
+}
+
+gboolean
+kms_http_ep_server_set_end_point_coalescing (KmsHttpEPServer *self,
+    const gchar *uri, guint max_size, guint max_latency)
+{
+  GstElement *httpep;
+
+  g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), FALSE);
+
+  httpep = kms_http_ep_server_lookup_end_point (self, uri);
+
+  if (httpep == NULL) {
+    GST_WARNING ("Uri %s is not registered", uri);
+    return FALSE;
+  }
+
+  /* Takes effect on the next GET request */
+  add_guint_param (httpep, KEY_PARAM_COALESCE_SIZE, max_size);
+  add_guint_param (httpep, KEY_PARAM_COALESCE_LATENCY,
+                   MIN (max_latency, KMS_HTTP_EP_SERVER_MAX_COALESCE_LATENCY) );
+  g_object_unref (httpep);
+
+  return TRUE;
+}
+
+void
+kms_http_ep_server_set_metrics_func (KmsHttpEPServer *self,
+                                     KmsHttpEPServerMetricsFunc func, gpointer data, GDestroyNotify notify)
+{
+  GDestroyNotify old_notify;
+  gpointer old_data;
+
+  g_return_if_fail (KMS_IS_HTTP_EP_SERVER (self) );
+
+  /* Wait for any scrape in progress to finish with the old function */
+  g_rec_mutex_lock (&self->priv->metrics_mutex);
+  old_notify = self->priv->metrics_notify;
+  old_data = self->priv->metrics_data;
+  self->priv->metrics_func = func;
+  self->priv->metrics_data = data;
+  self->priv->metrics_notify = notify;
+  g_rec_mutex_unlock (&self->priv->metrics_mutex);
+
+  if (old_notify != NULL)
+    old_notify (old_data);
+}
@@ -76,6 +76,15 @@ typedef enum
   HTTPEPSERVER_UNEXPECTED_ERROR
 } HttpEPServerError;
 
+typedef enum
+{
+  KMS_HTTP_EP_SERVER_FLAG_NONE = 0,
+  /* Let many GET clients share the stream of a single end point */
+  KMS_HTTP_EP_SERVER_FLAG_BROADCAST = 1 << 0,
+  /* Serve the stream as cacheable segments listed in an HLS playlist */
+  KMS_HTTP_EP_SERVER_FLAG_SEGMENTED = 1 << 1
+} KmsHttpEPServerFlags;
+
 typedef struct _KmsHttpEPServer KmsHttpEPServer;
 typedef struct _KmsHttpEPServerClass KmsHttpEPServerClass;
 typedef struct _KmsHttpEPServerPrivate KmsHttpEPServerPrivate;
@@ -83,6 +92,23 @@ typedef struct _KmsHttpEPServerPrivate KmsHttpEPServerPrivate;
 typedef void (*KmsHttpEPServerStartCallback) (KmsHttpEPServer * self,
     GError * err);
 
+/* Callbacks invoked only for the url of the end point they are set on. */
+/* They run in the same context signals are emitted in */
+typedef struct _KmsHttpEPServerCallbacks
+{
+  void (*action_requested) (KmsHttpEPServer * self, const gchar * uri,
+      KmsHttpEndPointAction action, gpointer data);
+  void (*url_removed) (KmsHttpEPServer * self, const gchar * uri,
+      gpointer data);
+  void (*url_expired) (KmsHttpEPServer * self, const gchar * uri,
+      gpointer data);
+} KmsHttpEPServerCallbacks;
+
+/* Appends metrics in Prometheus text format to @metrics. It is called */
+/* from the thread serving each scrape of KMS_HTTP_EP_SERVER_METRICS_PATH */
+typedef void (*KmsHttpEPServerMetricsFunc) (KmsHttpEPServer * self,
+    GString * metrics, gpointer data);
+
 struct _KmsHttpEPServer
 {
   GObject parent_instance;
@@ -101,7 +127,7 @@ struct _KmsHttpEPServerClass
   void (*start) (KmsHttpEPServer * self, KmsHttpEPServerStartCallback);
   void (*stop) (KmsHttpEPServer * self);
   const gchar *(*register_end_point) (KmsHttpEPServer * self,
-      GstElement * endpoint, guint timeout);
+      GstElement * endpoint, guint timeout, KmsHttpEPServerFlags flags);
   gboolean (*unregister_end_point) (KmsHttpEPServer * self, const gchar *);
 
   /* signal callbacks */
@@ -121,11 +147,36 @@ void kms_http_ep_server_start (KmsHttpEPServer * self,
 void kms_http_ep_server_stop (KmsHttpEPServer * self);
 const gchar *kms_http_ep_server_register_end_point (KmsHttpEPServer * self,
     GstElement * endpoint, guint timeout);
+const gchar *kms_http_ep_server_register_end_point_full (KmsHttpEPServer *
+    self, GstElement * endpoint, guint timeout, KmsHttpEPServerFlags flags);
 gboolean kms_http_ep_server_unregister_end_point (KmsHttpEPServer * self,
     const gchar * uri);
+gboolean kms_http_ep_server_set_end_point_callbacks (KmsHttpEPServer * self,
+    const gchar * uri, const KmsHttpEPServerCallbacks * callbacks,
+    gpointer data, GDestroyNotify notify);
+/* Serves a finished file with no media pipeline. Range requests are */
+/* supported so clients can seek. The file is read as clients take it, */
+/* so responses in flight end early if it is truncated meanwhile */
+const gchar *kms_http_ep_server_register_file (KmsHttpEPServer * self,
+    const gchar * path, const gchar * content_type, GError ** err);
+gboolean kms_http_ep_server_unregister_file (KmsHttpEPServer * self,
+    const gchar * uri);
+/* Media is written to GET responses of @uri once @max_size bytes are */
+/* gathered or after @max_latency milliseconds. Zero disables it */
+gboolean kms_http_ep_server_set_end_point_coalescing (KmsHttpEPServer * self,
+    const gchar * uri, guint max_size, guint max_latency);
+void kms_http_ep_server_set_metrics_func (KmsHttpEPServer * self,
+    KmsHttpEPServerMetricsFunc func, gpointer data, GDestroyNotify notify);
 
 #define KMS_HTTP_EP_SERVER_PORT "port"
 #define KMS_HTTP_EP_SERVER_INTERFACE "interface"
 #define KMS_HTTP_EP_SERVER_ANNOUNCED_IP "announced-address"
+#define KMS_HTTP_EP_SERVER_WORKERS "workers"
+#define KMS_HTTP_EP_SERVER_SEGMENT_DURATION "segment-duration"
+#define KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE "segment-cache-size"
+#define KMS_HTTP_EP_SERVER_COALESCE_SIZE "coalesce-size"
+#define KMS_HTTP_EP_SERVER_COALESCE_LATENCY "coalesce-latency"
+
+#define KMS_HTTP_EP_SERVER_METRICS_PATH "/metrics"
 
 #endif /* __KMS_HTTP_EP_SERVER_H__ */
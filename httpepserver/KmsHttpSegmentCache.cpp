@@ -0,0 +1,198 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "KmsHttpSegmentCache.h"
+
+#define GST_CAT_DEFAULT kms_http_segment_cache_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+typedef struct _KmsHttpSegmentEntry {
+  gchar *path;
+  SoupBuffer *segment;
+} KmsHttpSegmentEntry;
+
+struct _KmsHttpSegmentCache {
+  volatile gint ref_count;
+  GMutex mutex;
+  GHashTable *entries;  /* path -> GList link in lru */
+  GQueue lru;           /* Most recently used entries at the head */
+  gsize size;
+  gsize max_size;
+};
+
+static void
+destroy_entry (KmsHttpSegmentEntry *entry)
+{
+  g_free (entry->path);
+  soup_buffer_free (entry->segment);
+  g_slice_free (KmsHttpSegmentEntry, entry);
+}
+
+static void
+kms_http_segment_cache_drop_link (KmsHttpSegmentCache *cache, GList *link)
+{
+  KmsHttpSegmentEntry *entry = (KmsHttpSegmentEntry *) link->data;
+
+  g_hash_table_remove (cache->entries, entry->path);
+  g_queue_delete_link (&cache->lru, link);
+  cache->size -= entry->segment->length;
+  destroy_entry (entry);
+}
+
+KmsHttpSegmentCache *
+kms_http_segment_cache_new (gsize max_size)
+{
+  KmsHttpSegmentCache *cache;
+
+  if (GST_CAT_DEFAULT == NULL)
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "HttpSegmentCache", 0,
+                             "debug category for http segment cache");
+
+  cache = g_slice_new0 (KmsHttpSegmentCache);
+  cache->ref_count = 1;
+  cache->max_size = max_size;
+  cache->entries = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&cache->lru);
+  g_mutex_init (&cache->mutex);
+
+  return cache;
+}
+
+KmsHttpSegmentCache *
+kms_http_segment_cache_ref (KmsHttpSegmentCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+
+  g_atomic_int_inc (&cache->ref_count);
+
+  return cache;
+}
+
+void
+kms_http_segment_cache_unref (KmsHttpSegmentCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  if (!g_atomic_int_dec_and_test (&cache->ref_count) )
+    return;
+
+  g_queue_foreach (&cache->lru, (GFunc) destroy_entry, NULL);
+  g_queue_clear (&cache->lru);
+  g_hash_table_unref (cache->entries);
+  g_mutex_clear (&cache->mutex);
+
+  g_slice_free (KmsHttpSegmentCache, cache);
+}
+
+void
+kms_http_segment_cache_insert (KmsHttpSegmentCache *cache, const gchar *path,
+                               SoupBuffer *segment)
+{
+  KmsHttpSegmentEntry *entry;
+  GList *link;
+
+  g_return_if_fail (cache != NULL && path != NULL && segment != NULL);
+
+  if (segment->length > cache->max_size) {
+    GST_WARNING ("Segment %s does not fit in cache", path);
+    return;
+  }
+
+  entry = g_slice_new (KmsHttpSegmentEntry);
+  entry->path = g_strdup (path);
+  entry->segment = soup_buffer_copy (segment);
+
+  g_mutex_lock (&cache->mutex);
+
+  link = (GList *) g_hash_table_lookup (cache->entries, path);
+
+  if (link != NULL)
+    kms_http_segment_cache_drop_link (cache, link);
+
+  /* Make room for the new segment */
+  while (cache->size + segment->length > cache->max_size &&
+         cache->lru.tail != NULL) {
+    GST_DEBUG ("Evicting %s",
+               ( (KmsHttpSegmentEntry *) cache->lru.tail->data)->path);
+    kms_http_segment_cache_drop_link (cache, cache->lru.tail);
+  }
+
+  g_queue_push_head (&cache->lru, entry);
+  g_hash_table_insert (cache->entries, entry->path, cache->lru.head);
+  cache->size += segment->length;
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+SoupBuffer *
+kms_http_segment_cache_lookup (KmsHttpSegmentCache *cache, const gchar *path)
+{
+  SoupBuffer *segment = NULL;
+  GList *link;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+
+  g_mutex_lock (&cache->mutex);
+
+  link = (GList *) g_hash_table_lookup (cache->entries, path);
+
+  if (link != NULL) {
+    /* Move it to the head of the list, links stay valid */
+    g_queue_unlink (&cache->lru, link);
+    g_queue_push_head_link (&cache->lru, link);
+
+    segment = soup_buffer_copy ( ( (KmsHttpSegmentEntry *) link->data)->segment);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+
+  return segment;
+}
+
+void
+kms_http_segment_cache_remove_prefix (KmsHttpSegmentCache *cache,
+                                      const gchar *prefix)
+{
+  GList *link, *next;
+
+  g_return_if_fail (cache != NULL && prefix != NULL);
+
+  g_mutex_lock (&cache->mutex);
+
+  for (link = cache->lru.head; link != NULL; link = next) {
+    next = link->next;
+
+    if (g_str_has_prefix ( ( (KmsHttpSegmentEntry *) link->data)->path, prefix) )
+      kms_http_segment_cache_drop_link (cache, link);
+  }
+
+  g_mutex_unlock (&cache->mutex);
+}
+
+gsize
+kms_http_segment_cache_get_size (KmsHttpSegmentCache *cache)
+{
+  gsize size;
+
+  g_return_val_if_fail (cache != NULL, 0);
+
+  g_mutex_lock (&cache->mutex);
+  size = cache->size;
+  g_mutex_unlock (&cache->mutex);
+
+  return size;
+}
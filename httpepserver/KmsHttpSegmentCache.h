@@ -0,0 +1,45 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+/* inclusion guard */
+#ifndef __KMS_HTTP_SEGMENT_CACHE_H__
+#define __KMS_HTTP_SEGMENT_CACHE_H__
+
+#include <glib.h>
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+/* Thread safe LRU cache of media segments indexed by request path. */
+/* Least recently served segments are evicted once the total size of */
+/* the cached buffers goes beyond the configured limit */
+typedef struct _KmsHttpSegmentCache KmsHttpSegmentCache;
+
+KmsHttpSegmentCache *kms_http_segment_cache_new (gsize max_size);
+KmsHttpSegmentCache *kms_http_segment_cache_ref (KmsHttpSegmentCache * cache);
+void kms_http_segment_cache_unref (KmsHttpSegmentCache * cache);
+
+/* Takes a reference to @segment */
+void kms_http_segment_cache_insert (KmsHttpSegmentCache * cache,
+    const gchar * path, SoupBuffer * segment);
+/* Returns a new reference to be released with soup_buffer_free or NULL */
+SoupBuffer *kms_http_segment_cache_lookup (KmsHttpSegmentCache * cache,
+    const gchar * path);
+void kms_http_segment_cache_remove_prefix (KmsHttpSegmentCache * cache,
+    const gchar * prefix);
+gsize kms_http_segment_cache_get_size (KmsHttpSegmentCache * cache);
+
+G_END_DECLS
+#endif /* __KMS_HTTP_SEGMENT_CACHE_H__ */
@@ -0,0 +1,403 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "KmsHttpTimerQueue.h"
+
+#define GST_CAT_DEFAULT kms_http_timer_queue_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Deadlines are rounded up to this many microseconds so that timers */
+/* armed at about the same time expire in the same wake up */
+#define TIMER_GRANULARITY (10 * 1000)
+
+#define NOT_QUEUED G_MAXUINT
+
+struct _KmsHttpTimer {
+  KmsHttpTimerQueue *queue;
+  KmsHttpTimerFunc func;
+  gint64 deadline;
+  guint index;          /* Position in the heap or NOT_QUEUED */
+  gpointer data;
+  GDestroyNotify notify;
+};
+
+struct _KmsHttpTimerQueue {
+  volatile gint ref_count;
+  GMutex mutex;
+  GPtrArray *heap;      /* Timer with the earliest deadline first */
+  GSource *source;
+};
+
+typedef struct _KmsHttpTimerExpiration {
+  KmsHttpTimerFunc func;
+  gpointer data;
+  GDestroyNotify notify;
+} KmsHttpTimerExpiration;
+
+#define HEAP_TIMER(queue, i) \
+  ((KmsHttpTimer *) g_ptr_array_index ((queue)->heap, (i)))
+
+static void
+heap_set (KmsHttpTimerQueue *queue, guint i, KmsHttpTimer *timer)
+{
+  g_ptr_array_index (queue->heap, i) = timer;
+  timer->index = i;
+}
+
+static void
+heap_sift_up (KmsHttpTimerQueue *queue, guint i)
+{
+  KmsHttpTimer *timer = HEAP_TIMER (queue, i);
+
+  while (i > 0) {
+    guint parent = (i - 1) / 2;
+
+    if (HEAP_TIMER (queue, parent)->deadline <= timer->deadline)
+      break;
+
+    heap_set (queue, i, HEAP_TIMER (queue, parent) );
+    i = parent;
+  }
+
+  heap_set (queue, i, timer);
+}
+
+static void
+heap_sift_down (KmsHttpTimerQueue *queue, guint i)
+{
+  KmsHttpTimer *timer = HEAP_TIMER (queue, i);
+  guint len = queue->heap->len;
+
+  for (;;) {
+    guint child = 2 * i + 1;
+
+    if (child >= len)
+      break;
+
+    if (child + 1 < len &&
+        HEAP_TIMER (queue, child + 1)->deadline < HEAP_TIMER (queue,
+            child)->deadline)
+      child++;
+
+    if (timer->deadline <= HEAP_TIMER (queue, child)->deadline)
+      break;
+
+    heap_set (queue, i, HEAP_TIMER (queue, child) );
+    i = child;
+  }
+
+  heap_set (queue, i, timer);
+}
+
+static void
+heap_remove (KmsHttpTimerQueue *queue, KmsHttpTimer *timer)
+{
+  guint i = timer->index;
+  KmsHttpTimer *last;
+
+  last = (KmsHttpTimer *) g_ptr_array_remove_index (queue->heap,
+         queue->heap->len - 1);
+  timer->index = NOT_QUEUED;
+
+  if (last == timer)
+    return;
+
+  /* Fill the hole with the last timer and restore the heap property */
+  heap_set (queue, i, last);
+  heap_sift_up (queue, i);
+  heap_sift_down (queue, last->index);
+}
+
+/* Must be called with the lock held */
+static void
+kms_http_timer_queue_update_source (KmsHttpTimerQueue *queue)
+{
+  if (queue->source == NULL)
+    return;
+
+  if (queue->heap->len == 0)
+    g_source_set_ready_time (queue->source, -1);
+  else
+    g_source_set_ready_time (queue->source, HEAP_TIMER (queue, 0)->deadline);
+}
+
+static gboolean
+kms_http_timer_queue_dispatch (gpointer data)
+{
+  KmsHttpTimerQueue *queue = (KmsHttpTimerQueue *) data;
+  KmsHttpTimerExpiration *exp;
+  GArray *expired;
+  gint64 now;
+  guint i;
+
+  expired = g_array_new (FALSE, FALSE, sizeof (KmsHttpTimerExpiration) );
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&queue->mutex);
+
+  while (queue->heap->len > 0 && HEAP_TIMER (queue, 0)->deadline <= now) {
+    KmsHttpTimer *timer = HEAP_TIMER (queue, 0);
+    KmsHttpTimerExpiration e;
+
+    heap_remove (queue, timer);
+
+    e.func = timer->func;
+    e.data = timer->data;
+    e.notify = timer->notify;
+    g_array_append_val (expired, e);
+
+    timer->data = NULL;
+    timer->notify = NULL;
+  }
+
+  kms_http_timer_queue_update_source (queue);
+
+  g_mutex_unlock (&queue->mutex);
+
+  GST_TRACE ("%u timers expired", expired->len);
+
+  /* Callbacks may arm timers again, so they are called without the lock */
+  for (i = 0; i < expired->len; i++) {
+    exp = &g_array_index (expired, KmsHttpTimerExpiration, i);
+    exp->func (exp->data);
+
+    if (exp->notify != NULL)
+      exp->notify (exp->data);
+  }
+
+  g_array_free (expired, TRUE);
+
+  return TRUE;
+}
+
+static gboolean
+timer_source_dispatch (GSource *source, GSourceFunc callback,
+                       gpointer user_data)
+{
+  return callback (user_data);
+}
+
+static GSourceFuncs timer_source_funcs = {
+  NULL, NULL, timer_source_dispatch, NULL, NULL, NULL
+};
+
+KmsHttpTimerQueue *
+kms_http_timer_queue_new (void)
+{
+  KmsHttpTimerQueue *queue;
+
+  if (GST_CAT_DEFAULT == NULL)
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "HttpTimerQueue", 0,
+                             "debug category for http timer queue");
+
+  queue = g_slice_new0 (KmsHttpTimerQueue);
+  queue->ref_count = 1;
+  queue->heap = g_ptr_array_new ();
+  g_mutex_init (&queue->mutex);
+
+  return queue;
+}
+
+KmsHttpTimerQueue *
+kms_http_timer_queue_ref (KmsHttpTimerQueue *queue)
+{
+  g_return_val_if_fail (queue != NULL, NULL);
+
+  g_atomic_int_inc (&queue->ref_count);
+
+  return queue;
+}
+
+void
+kms_http_timer_queue_unref (KmsHttpTimerQueue *queue)
+{
+  g_return_if_fail (queue != NULL);
+
+  if (!g_atomic_int_dec_and_test (&queue->ref_count) )
+    return;
+
+  /* Every timer keeps a reference, so there is none left in the heap */
+  g_ptr_array_unref (queue->heap);
+  g_mutex_clear (&queue->mutex);
+
+  g_slice_free (KmsHttpTimerQueue, queue);
+}
+
+void
+kms_http_timer_queue_attach (KmsHttpTimerQueue *queue, GMainContext *context)
+{
+  GSource *source;
+
+  g_return_if_fail (queue != NULL);
+
+  kms_http_timer_queue_detach (queue);
+
+  /* The source keeps the queue alive until it is detached */
+  source = g_source_new (&timer_source_funcs, sizeof (GSource) );
+  g_source_set_callback (source, kms_http_timer_queue_dispatch,
+                         kms_http_timer_queue_ref (queue),
+                         (GDestroyNotify) kms_http_timer_queue_unref);
+
+  g_mutex_lock (&queue->mutex);
+  queue->source = source;
+  kms_http_timer_queue_update_source (queue);
+  g_mutex_unlock (&queue->mutex);
+
+  g_source_attach (source, context);
+}
+
+void
+kms_http_timer_queue_detach (KmsHttpTimerQueue *queue)
+{
+  GSource *source;
+
+  g_return_if_fail (queue != NULL);
+
+  g_mutex_lock (&queue->mutex);
+  source = queue->source;
+  queue->source = NULL;
+  g_mutex_unlock (&queue->mutex);
+
+  if (source == NULL)
+    return;
+
+  g_source_destroy (source);
+  g_source_unref (source);
+}
+
+guint
+kms_http_timer_queue_get_length (KmsHttpTimerQueue *queue)
+{
+  guint len;
+
+  g_return_val_if_fail (queue != NULL, 0);
+
+  g_mutex_lock (&queue->mutex);
+  len = queue->heap->len;
+  g_mutex_unlock (&queue->mutex);
+
+  return len;
+}
+
+KmsHttpTimer *
+kms_http_timer_new (KmsHttpTimerQueue *queue, KmsHttpTimerFunc func)
+{
+  KmsHttpTimer *timer;
+
+  g_return_val_if_fail (queue != NULL && func != NULL, NULL);
+
+  timer = g_slice_new0 (KmsHttpTimer);
+  timer->queue = kms_http_timer_queue_ref (queue);
+  timer->func = func;
+  timer->index = NOT_QUEUED;
+
+  return timer;
+}
+
+void
+kms_http_timer_free (KmsHttpTimer *timer)
+{
+  g_return_if_fail (timer != NULL);
+
+  kms_http_timer_cancel (timer);
+  kms_http_timer_queue_unref (timer->queue);
+
+  g_slice_free (KmsHttpTimer, timer);
+}
+
+void
+kms_http_timer_schedule (KmsHttpTimer *timer, guint timeout, gpointer data,
+                         GDestroyNotify notify)
+{
+  KmsHttpTimerQueue *queue;
+  GDestroyNotify old_notify;
+  gpointer old_data;
+  gint64 deadline, top;
+
+  g_return_if_fail (timer != NULL);
+
+  queue = timer->queue;
+  deadline = g_get_monotonic_time () + (gint64) timeout * 1000;
+  deadline += TIMER_GRANULARITY - 1;
+  deadline -= deadline % TIMER_GRANULARITY;
+
+  g_mutex_lock (&queue->mutex);
+
+  top = queue->heap->len > 0 ? HEAP_TIMER (queue, 0)->deadline : -1;
+  old_data = timer->data;
+  old_notify = timer->notify;
+  timer->data = data;
+  timer->notify = notify;
+  timer->deadline = deadline;
+
+  if (timer->index == NOT_QUEUED) {
+    g_ptr_array_add (queue->heap, timer);
+    heap_sift_up (queue, queue->heap->len - 1);
+  } else {
+    heap_sift_up (queue, timer->index);
+    heap_sift_down (queue, timer->index);
+  }
+
+  /* Only wake up the context if the next deadline has changed */
+  if (HEAP_TIMER (queue, 0)->deadline != top)
+    kms_http_timer_queue_update_source (queue);
+
+  g_mutex_unlock (&queue->mutex);
+
+  if (old_notify != NULL)
+    old_notify (old_data);
+}
+
+gboolean
+kms_http_timer_cancel (KmsHttpTimer *timer)
+{
+  KmsHttpTimerQueue *queue;
+  GDestroyNotify notify;
+  gpointer data;
+
+  g_return_val_if_fail (timer != NULL, FALSE);
+
+  queue = timer->queue;
+
+  g_mutex_lock (&queue->mutex);
+
+  if (timer->index == NOT_QUEUED) {
+    g_mutex_unlock (&queue->mutex);
+    return FALSE;
+  }
+
+  /* An earlier wake up than needed is harmless, so the source is only */
+  /* updated if this was the next timer to expire */
+  if (timer->index == 0) {
+    heap_remove (queue, timer);
+    kms_http_timer_queue_update_source (queue);
+  } else {
+    heap_remove (queue, timer);
+  }
+
+  data = timer->data;
+  notify = timer->notify;
+  timer->data = NULL;
+  timer->notify = NULL;
+
+  g_mutex_unlock (&queue->mutex);
+
+  if (notify != NULL)
+    notify (data);
+
+  return TRUE;
+}
@@ -0,0 +1,57 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+/* inclusion guard */
+#ifndef __KMS_HTTP_TIMER_QUEUE_H__
+#define __KMS_HTTP_TIMER_QUEUE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Thread safe set of timers sharing a single GSource. Deadlines are */
+/* kept in a binary min-heap, so arming or cancelling a timer costs */
+/* O(log n) and the context only wakes up for the earliest deadline. */
+/* Every timer due at that moment is expired in the same dispatch */
+typedef struct _KmsHttpTimerQueue KmsHttpTimerQueue;
+typedef struct _KmsHttpTimer KmsHttpTimer;
+
+typedef void (*KmsHttpTimerFunc) (gpointer data);
+
+KmsHttpTimerQueue *kms_http_timer_queue_new (void);
+KmsHttpTimerQueue *kms_http_timer_queue_ref (KmsHttpTimerQueue * queue);
+void kms_http_timer_queue_unref (KmsHttpTimerQueue * queue);
+
+/* Expired timers are dispatched from @context. Timers armed while the */
+/* queue is detached fire once it is attached again */
+void kms_http_timer_queue_attach (KmsHttpTimerQueue * queue,
+    GMainContext * context);
+void kms_http_timer_queue_detach (KmsHttpTimerQueue * queue);
+guint kms_http_timer_queue_get_length (KmsHttpTimerQueue * queue);
+
+/* @func is called with the data of each expiration of the timer */
+KmsHttpTimer *kms_http_timer_new (KmsHttpTimerQueue * queue,
+    KmsHttpTimerFunc func);
+/* Cancels the timer if it is armed */
+void kms_http_timer_free (KmsHttpTimer * timer);
+
+/* Replaces any pending expiration of @timer. @data is released with */
+/* @notify after the timer fires or once it is cancelled */
+void kms_http_timer_schedule (KmsHttpTimer * timer, guint timeout,
+    gpointer data, GDestroyNotify notify);
+gboolean kms_http_timer_cancel (KmsHttpTimer * timer);
+
+G_END_DECLS
+#endif /* __KMS_HTTP_TIMER_QUEUE_H__ */
@@ -0,0 +1,334 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "ElementPool.hpp"
+#include "MediaElementRegistry.hpp"
+
+#define GST_CAT_DEFAULT kurento_element_pool
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoElementPool"
+
+namespace kurento
+{
+
+ElementPool::ElementPool () : threadPool (1)
+{
+  addMetricsCollector (this);
+}
+
+ElementPool::~ElementPool ()
+{
+  removeMetricsCollector (this);
+  threadPool.shutdown (true);
+
+  for (auto it = pools.begin(); it != pools.end(); it++) {
+    for (auto e = it->second.elements.begin(); e != it->second.elements.end(); e++) {
+      gst_element_set_state (*e, GST_STATE_NULL);
+      g_object_unref (*e);
+    }
+  }
+}
+
+ElementPool &
+ElementPool::getInstance ()
+{
+  static ElementPool instance;
+
+  return instance;
+}
+
+void
+ElementPool::setSize (const std::string &factory, guint size)
+{
+  bool refillNeeded = false;
+
+  mutex.lock();
+
+  Pool &pool = pools[factory];
+
+  pool.size = size;
+
+  while (pool.elements.size() > size) {
+    GstElement *element = pool.elements.back();
+
+    pool.elements.pop_back();
+    gst_element_set_state (element, GST_STATE_NULL);
+    g_object_unref (element);
+  }
+
+  if (pool.elements.size() < size && !pool.refilling) {
+    pool.refilling = true;
+    refillNeeded = true;
+  }
+
+  mutex.unlock();
+
+  if (refillNeeded) {
+    threadPool.push ([this, factory] () {
+      refill (factory);
+    } );
+  }
+}
+
+static GstElement *
+makeElement (const std::string &factory)
+{
+  GstElement *element;
+
+  element = MediaElementRegistry::getInstance ().makeElement (factory);
+
+  if (element != NULL && factory == ELEMENT_POOL_PIPELINE) {
+    /* Pipelines wait for their elements already playing */
+    g_object_set (G_OBJECT (element), "async-handling", TRUE, NULL);
+    gst_element_set_state (element, GST_STATE_PLAYING);
+  }
+
+  return element;
+}
+
+GstElement *
+ElementPool::create (const std::string &factory, Pool &pool)
+{
+  GstElement *element;
+  gint64 time;
+
+  time = g_get_monotonic_time ();
+  element = makeElement (factory);
+  time = g_get_monotonic_time () - time;
+
+  mutex.lock();
+  pool.created++;
+  pool.creationTime += time;
+  mutex.unlock();
+
+  return element;
+}
+
+void
+ElementPool::refill (const std::string &factory)
+{
+  mutex.lock();
+
+  Pool &pool = pools[factory];
+
+  while (pool.elements.size() < pool.size) {
+    GstElement *element;
+
+    mutex.unlock();
+    element = create (factory, pool);
+    mutex.lock();
+
+    if (element == NULL) {
+      GST_WARNING ("Can not create %s elements", factory.c_str() );
+      break;
+    }
+
+    gst_object_ref_sink (element);
+
+    /* Released pipelines may have filled it meanwhile */
+    if (pool.elements.size() >= pool.size) {
+      mutex.unlock();
+      gst_element_set_state (element, GST_STATE_NULL);
+      g_object_unref (element);
+      mutex.lock();
+      break;
+    }
+
+    pool.elements.push_back (element);
+  }
+
+  GST_DEBUG ("%s pool holds %zu elements", factory.c_str(),
+             pool.elements.size() );
+  pool.refilling = false;
+
+  mutex.unlock();
+}
+
+GstElement *
+ElementPool::acquire (const std::string &factory)
+{
+  GstElement *element = NULL;
+  bool refillNeeded = false;
+
+  mutex.lock();
+
+  auto it = pools.find (factory);
+
+  if (it == pools.end() || it->second.size == 0) {
+    mutex.unlock();
+    return makeElement (factory);
+  }
+
+  Pool &pool = it->second;
+
+  if (!pool.elements.empty() ) {
+    element = pool.elements.front();
+    pool.elements.pop_front();
+    pool.hits++;
+  } else {
+    pool.misses++;
+  }
+
+  if (!pool.refilling) {
+    pool.refilling = true;
+    refillNeeded = true;
+  }
+
+  mutex.unlock();
+
+  if (refillNeeded) {
+    threadPool.push ([this, factory] () {
+      refill (factory);
+    } );
+  }
+
+  if (element == NULL)
+    return create (factory, pool);
+
+  /* Callers own it the same way as a newly created one */
+  g_object_force_floating (G_OBJECT (element) );
+
+  return element;
+}
+
+bool
+ElementPool::resetPipeline (GstElement *pipeline)
+{
+  if (gst_element_set_state (pipeline, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_FAILURE)
+    return false;
+
+  gst_pipeline_auto_clock (GST_PIPELINE (pipeline) );
+  gst_pipeline_set_delay (GST_PIPELINE (pipeline), 0);
+  gst_pipeline_set_auto_flush_bus (GST_PIPELINE (pipeline), TRUE);
+  g_object_set (G_OBJECT (pipeline), "async-handling", TRUE, NULL);
+
+  return gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+         GST_STATE_CHANGE_FAILURE;
+}
+
+bool
+ElementPool::hasRoom (const std::string &factory)
+{
+  auto it = pools.find (factory);
+
+  return it != pools.end() && it->second.elements.size() < it->second.size;
+}
+
+void
+ElementPool::releasePipeline (GstElement *pipeline)
+{
+  bool recycle;
+
+  mutex.lock();
+  recycle = hasRoom (ELEMENT_POOL_PIPELINE) &&
+            GST_BIN_NUMCHILDREN (pipeline) == 0 &&
+            GST_STATE (pipeline) == GST_STATE_PLAYING;
+  mutex.unlock();
+
+  if (recycle)
+    recycle = resetPipeline (pipeline);
+
+  if (recycle) {
+    mutex.lock();
+    /* Pool may have been refilled meanwhile */
+    recycle = hasRoom (ELEMENT_POOL_PIPELINE);
+
+    if (recycle) {
+      /* Keeps the caller's reference, floating or not */
+      if (g_object_is_floating (pipeline) )
+        gst_object_ref_sink (pipeline);
+
+      pools[ELEMENT_POOL_PIPELINE].elements.push_back (pipeline);
+    }
+
+    mutex.unlock();
+  }
+
+  if (!recycle) {
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    g_object_unref (pipeline);
+    return;
+  }
+
+  GST_DEBUG ("Pipeline %s recycled", GST_ELEMENT_NAME (pipeline) );
+}
+
+guint
+ElementPool::getAvailable (const std::string &factory)
+{
+  guint available = 0;
+
+  mutex.lock();
+
+  auto it = pools.find (factory);
+
+  if (it != pools.end() )
+    available = it->second.elements.size();
+
+  mutex.unlock();
+
+  return available;
+}
+
+void
+ElementPool::collect (std::string &_return)
+{
+  std::string hits, misses, available, saved;
+
+  mutex.lock();
+
+  for (auto it = pools.begin(); it != pools.end(); it++) {
+    Pool &pool = it->second;
+    std::string label = "{factory=\"" + it->first + "\"} ";
+    int64_t average = pool.created > 0 ? pool.creationTime / pool.created : 0;
+
+    hits += "kms_element_pool_hits_total" + label +
+            std::to_string (pool.hits) + "\n";
+    misses += "kms_element_pool_misses_total" + label +
+              std::to_string (pool.misses) + "\n";
+    available += "kms_element_pool_available" + label +
+                 std::to_string (pool.elements.size() ) + "\n";
+    /* Estimated as if every hit had taken the average creation time */
+    saved += "kms_element_pool_estimated_saved_microseconds_total" + label +
+             std::to_string (pool.hits * average) + "\n";
+  }
+
+  mutex.unlock();
+
+  _return.append ("# HELP kms_element_pool_hits_total Elements taken from a pool\n"
+                  "# TYPE kms_element_pool_hits_total counter\n" + hits);
+  _return.append ("# HELP kms_element_pool_misses_total Elements created "
+                  "because their pool was empty\n"
+                  "# TYPE kms_element_pool_misses_total counter\n" + misses);
+  _return.append ("# HELP kms_element_pool_available Elements ready in a pool\n"
+                  "# TYPE kms_element_pool_available gauge\n" + available);
+  _return.append ("# HELP kms_element_pool_estimated_saved_microseconds_total "
+                  "Estimated creation time saved by pool hits, hits times "
+                  "the average creation time\n"
+                  "# TYPE kms_element_pool_estimated_saved_microseconds_total "
+                  "counter\n" +
+                  saved);
+}
+
+ElementPool::StaticConstructor ElementPool::staticConstructor;
+
+ElementPool::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
@@ -0,0 +1,94 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __ELEMENT_POOL_H__
+#define __ELEMENT_POOL_H__
+
+#include "common/Metrics.hpp"
+
+#include <gst/gst.h>
+#include <glibmm.h>
+#include <list>
+#include <map>
+
+#define ELEMENT_POOL_PIPELINE "pipeline"
+
+namespace kurento
+{
+
+/* Keeps instances of the most expensive elements created in advance, */
+/* so that creating media objects does not wait for them. Pools are */
+/* refilled from a background thread as soon as they are used */
+class ElementPool : public MetricsCollector
+{
+public:
+  ElementPool ();
+  ~ElementPool ();
+
+  static ElementPool &getInstance ();
+
+  /* Keeps up to @size elements of @factory ready. Zero disables it */
+  void setSize (const std::string &factory, guint size);
+
+  /* Returns a floating reference to an element in NULL state, just as */
+  /* gst_element_factory_make does. Pipelines are already playing */
+  GstElement *acquire (const std::string &factory);
+
+  /* Takes the reference of an empty pipeline and keeps it for reuse, */
+  /* reset to the state of a new one. Other elements hold per session */
+  /* state and are just destroyed */
+  void releasePipeline (GstElement *pipeline);
+
+  /* Elements of @factory ready to be acquired */
+  guint getAvailable (const std::string &factory);
+
+  /* Leaves a used empty pipeline playing as a new one would be. Going */
+  /* through NULL drops pending bus messages and resets clock, base time */
+  /* and running time */
+  static bool resetPipeline (GstElement *pipeline);
+
+  void collect (std::string &_return);
+
+private:
+  struct Pool {
+    guint size = 0;
+    std::list<GstElement *> elements;
+    bool refilling = false;
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t created = 0;
+    int64_t creationTime = 0; /* microseconds */
+  };
+
+  GstElement *create (const std::string &factory, Pool &pool);
+  void refill (const std::string &factory);
+  bool hasRoom (const std::string &factory);
+
+  Glib::Threads::Mutex mutex;
+  std::map<std::string, Pool> pools;
+  Glib::ThreadPool threadPool;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __ELEMENT_POOL_H__ */
@@ -0,0 +1,205 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "MediaElementRegistry.hpp"
+
+#include "utils/utils.hpp"
+#include "KmsMediaErrorCodes_constants.h"
+
+#include "KmsMediaPlayerEndPointType_constants.h"
+#include "types/PlayerEndPoint.hpp"
+#include "KmsMediaRecorderEndPointType_constants.h"
+#include "types/RecorderEndPoint.hpp"
+#include "KmsMediaRtpEndPointType_constants.h"
+#include "types/RtpEndPoint.hpp"
+#include "KmsMediaHttpEndPointType_constants.h"
+#include "types/HttpEndPoint.hpp"
+#include "KmsMediaZBarFilterType_constants.h"
+#include "types/ZBarFilter.hpp"
+#include "KmsMediaJackVaderFilterType_constants.h"
+#include "types/JackVaderFilter.hpp"
+#include "KmsMediaPointerDetectorFilterType_constants.h"
+#include "types/PointerDetectorFilter.hpp"
+#include "KmsMediaWebRtcEndPointType_constants.h"
+#include "types/WebRtcEndPoint.hpp"
+#include "KmsMediaPlateDetectorFilterType_constants.h"
+#include "types/PlateDetectorFilter.hpp"
+
+#define GST_CAT_DEFAULT kurento_media_element_registry
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoMediaElementRegistry"
+
+namespace kurento
+{
+
+MediaElementRegistry::~MediaElementRegistry ()
+{
+  for (auto it = factories.begin(); it != factories.end(); it++)
+    gst_object_unref (it->second);
+}
+
+MediaElementRegistry &
+MediaElementRegistry::getInstance ()
+{
+  static MediaElementRegistry instance;
+
+  return instance;
+}
+
+GstElementFactory *
+MediaElementRegistry::getFactory (const std::string &factoryName)
+{
+  GstElementFactory *factory = NULL;
+
+  lock.reader_lock();
+
+  auto it = factories.find (factoryName);
+
+  if (it != factories.end() )
+    factory = it->second;
+
+  lock.reader_unlock();
+
+  if (factory != NULL)
+    return factory;
+
+  /* Factories not used by any registered type are cached on first use */
+  factory = gst_element_factory_find (factoryName.c_str() );
+
+  if (factory == NULL)
+    return NULL;
+
+  lock.writer_lock();
+
+  auto inserted = factories.insert (std::make_pair (factoryName, factory) );
+
+  if (!inserted.second) {
+    gst_object_unref (factory);
+    factory = inserted.first->second;
+  }
+
+  lock.writer_unlock();
+
+  return factory;
+}
+
+bool
+MediaElementRegistry::registerType (const std::string &typeName,
+                                    const std::string &factoryName,
+                                    Constructor constructor)
+{
+  if (!factoryName.empty() && getFactory (factoryName) == NULL) {
+    GST_ERROR ("Type %s will not be available: %s element factory not found",
+               typeName.c_str(), factoryName.c_str() );
+    return false;
+  }
+
+  lock.writer_lock();
+  constructors[typeName] = constructor;
+  lock.writer_unlock();
+
+  GST_DEBUG ("Registered type %s", typeName.c_str() );
+
+  return true;
+}
+
+bool
+MediaElementRegistry::hasType (const std::string &typeName)
+{
+  bool found;
+
+  lock.reader_lock();
+  found = constructors.find (typeName) != constructors.end();
+  lock.reader_unlock();
+
+  return found;
+}
+
+std::shared_ptr<MediaElement>
+MediaElementRegistry::create (const std::string &typeName, MediaSet &mediaSet,
+                              std::shared_ptr<MediaPipeline> parent,
+                              const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  Constructor constructor;
+
+  lock.reader_lock();
+
+  auto it = constructors.find (typeName);
+
+  if (it != constructors.end() )
+    constructor = it->second;
+
+  lock.reader_unlock();
+
+  if (!constructor) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_TYPE_NOT_FOUND,
+                                   "There is not any media object type " + typeName);
+    throw except;
+  }
+
+  return constructor (mediaSet, parent, params);
+}
+
+GstElement *
+MediaElementRegistry::makeElement (const std::string &factoryName)
+{
+  GstElementFactory *factory = getFactory (factoryName);
+
+  if (factory == NULL) {
+    GST_ERROR ("No %s element factory found", factoryName.c_str() );
+    return NULL;
+  }
+
+  return gst_element_factory_create (factory, NULL);
+}
+
+void
+registerMediaElementTypes ()
+{
+  MediaElementRegistry &registry = MediaElementRegistry::getInstance ();
+
+  registry.registerType<PlayerEndPoint> (
+    g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, "playerendpoint");
+  registry.registerType<RecorderEndPoint> (
+    g_KmsMediaRecorderEndPointType_constants.TYPE_NAME, "recorderendpoint");
+  registry.registerType<RtpEndPoint> (
+    g_KmsMediaRtpEndPointType_constants.TYPE_NAME, "rtpendpoint");
+  registry.registerType<HttpEndPoint> (
+    g_KmsMediaHttpEndPointType_constants.TYPE_NAME, "httpendpoint");
+  registry.registerType<ZBarFilter> (
+    g_KmsMediaZBarFilterType_constants.TYPE_NAME, "filterelement");
+  registry.registerType<JackVaderFilter> (
+    g_KmsMediaJackVaderFilterType_constants.TYPE_NAME, "filterelement");
+  registry.registerType<PointerDetectorFilter> (
+    g_KmsMediaPointerDetectorFilterType_constants.TYPE_NAME, "filterelement");
+  registry.registerType<PlateDetectorFilter> (
+    g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, "filterelement");
+  registry.registerType<WebRtcEndPoint> (
+    g_KmsMediaWebRtcEndPointType_constants.TYPE_NAME, "webrtcendpoint");
+}
+
+MediaElementRegistry::StaticConstructor MediaElementRegistry::staticConstructor;
+
+MediaElementRegistry::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
@@ -0,0 +1,95 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __MEDIA_ELEMENT_REGISTRY_H__
+#define __MEDIA_ELEMENT_REGISTRY_H__
+
+#include "KmsMediaServer_types.h"
+
+#include <gst/gst.h>
+#include <glibmm.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+namespace kurento
+{
+
+class MediaSet;
+class MediaElement;
+class MediaPipeline;
+
+/* Media element types that pipelines can create, indexed by type name. */
+/* Element factories are resolved once when types are registered, so a */
+/* missing plugin is reported at startup instead of on first use */
+class MediaElementRegistry
+{
+public:
+  typedef std::function < std::shared_ptr<MediaElement> (MediaSet &mediaSet,
+      std::shared_ptr<MediaPipeline> parent,
+      const std::map<std::string, KmsMediaParam> &params) > Constructor;
+
+  ~MediaElementRegistry ();
+
+  static MediaElementRegistry &getInstance ();
+
+  /* Returns false if @factoryName can not be found. An empty factory */
+  /* name registers a type that does not need any element */
+  bool registerType (const std::string &typeName,
+                     const std::string &factoryName, Constructor constructor);
+
+  template <class T>
+  bool registerType (const std::string &typeName,
+                     const std::string &factoryName) {
+    return registerType (typeName, factoryName, [] (MediaSet & mediaSet,
+    std::shared_ptr<MediaPipeline> parent,
+    const std::map<std::string, KmsMediaParam> &params) {
+      return std::shared_ptr<MediaElement> (new T (mediaSet, parent, params) );
+    } );
+  }
+
+  bool hasType (const std::string &typeName);
+
+  std::shared_ptr<MediaElement> create (const std::string &typeName,
+                                        MediaSet &mediaSet,
+                                        std::shared_ptr<MediaPipeline> parent,
+                                        const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+
+  /* Same as gst_element_factory_make but the factory is looked up once */
+  GstElement *makeElement (const std::string &factoryName);
+
+private:
+  GstElementFactory *getFactory (const std::string &factoryName);
+
+  Glib::Threads::RWLock lock;
+  std::unordered_map<std::string, Constructor> constructors;
+  std::unordered_map<std::string, GstElementFactory *> factories;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+/* Registers the element types built in the server */
+void registerMediaElementTypes ();
+
+} // kurento
+
+#endif /* __MEDIA_ELEMENT_REGISTRY_H__ */
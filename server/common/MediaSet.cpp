@@ -27,6 +27,8 @@
 #include "KmsMediaErrorCodes_constants.h"
 #include "utils/utils.hpp"
 
+#include <cxxabi.h>
+
 #define GST_CAT_DEFAULT kurento_media_set
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaSet"
@@ -49,6 +51,7 @@ auto_release (gpointer dataPointer)
 
   GST_TRACE ("Auto release media object %" G_GINT64_FORMAT ", force: %d",
              data->objectId, data->forceRemoving);
+  metrics::gcExpirations.inc ();
   data->mediaSet->remove (data->objectId, data->forceRemoving);
   return TRUE;
 }
@@ -77,8 +80,14 @@ public:
   std::shared_ptr <MediaObjectImpl> object;
 };
 
+MediaSet::MediaSet ()
+{
+  addMetricsCollector (this);
+}
+
 MediaSet::~MediaSet ()
 {
+  removeMetricsCollector (this);
   threadPool.shutdown (true);
 }
 
@@ -282,6 +291,47 @@ MediaSet::size ()
   return size;
 }
 
+static std::string
+getTypeName (const MediaObjectImpl &mediaObject)
+{
+  const char *mangled = typeid (mediaObject).name ();
+  std::string name;
+  char *demangled;
+  int status;
+
+  demangled = abi::__cxa_demangle (mangled, NULL, NULL, &status);
+  name = (status == 0) ? demangled : mangled;
+  free (demangled);
+
+  if (name.compare (0, strlen ("kurento::"), "kurento::") == 0)
+    name.erase (0, strlen ("kurento::") );
+
+  return name;
+}
+
+void
+MediaSet::collect (std::string &_return)
+{
+  std::map<std::string, int> types;
+
+  mutex.lock();
+
+  for (auto it = mediaObjectsMap.begin(); it != mediaObjectsMap.end(); it++) {
+    if (it->second != NULL)
+      types[getTypeName (*it->second)]++;
+  }
+
+  mutex.unlock();
+
+  _return.append ("# HELP kms_media_objects Live media objects by type\n"
+                  "# TYPE kms_media_objects gauge\n");
+
+  for (auto it = types.begin(); it != types.end(); it++) {
+    _return.append ("kms_media_objects{type=\"" + it->first + "\"} " +
+                    std::to_string (it->second) + "\n");
+  }
+}
+
 template std::shared_ptr<MediaObjectImpl>
 MediaSet::getMediaObject<MediaObjectImpl> (const KmsMediaObjectRef &mediaObject);
 
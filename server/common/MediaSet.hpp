@@ -17,6 +17,7 @@
 #define __MEDIA_SET_H__
 
 #include "types/MediaObjectImpl.hpp"
+#include "common/Metrics.hpp"
 
 #include <glibmm.h>
 
@@ -25,10 +26,10 @@ typedef struct _AutoReleaseData AutoReleaseData;
 namespace kurento
 {
 
-class MediaSet
+class MediaSet : public MetricsCollector
 {
 public:
-  MediaSet () {};
+  MediaSet ();
   ~MediaSet ();
 
   void put (std::shared_ptr<MediaObjectImpl> mediaObject);
@@ -37,6 +38,8 @@ public:
   void remove (const KmsMediaObjectId &id, bool force);
   int size();
 
+  void collect (std::string &_return);
+
   template <class T>
   std::shared_ptr<T> getMediaObject (const KmsMediaObjectRef &mediaObject) throw (KmsMediaServerException);
 
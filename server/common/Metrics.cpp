@@ -0,0 +1,175 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "Metrics.hpp"
+
+#include <glibmm.h>
+#include <list>
+
+namespace kurento
+{
+
+namespace metrics
+{
+
+Metric rpcRequests ("kms_rpc_requests_total",
+                    "Thrift calls received", Metric::COUNTER);
+Metric rpcErrors ("kms_rpc_errors_total",
+                  "Thrift calls that threw an exception", Metric::COUNTER);
+Metric rpcInFlight ("kms_rpc_in_flight",
+                    "Thrift calls being processed", Metric::GAUGE);
+Metric gcExpirations ("kms_gc_expirations_total",
+                      "Media objects released because they were not kept alive",
+                      Metric::COUNTER);
+Metric eventQueueDepth ("kms_event_queue_depth",
+                        "Events and errors waiting to be sent to media handlers",
+                        Metric::GAUGE);
+Metric mainLoopLag ("kms_main_loop_lag_microseconds",
+                    "Delay of the last main loop probe over its schedule",
+                    Metric::GAUGE);
+Metric filterFramesProcessed ("kms_filter_frames_processed_total",
+                              "Frames analysed by filters", Metric::COUNTER);
+Metric filterFramesDropped ("kms_filter_frames_dropped_total",
+                            "Frames filters let through without analysing them",
+                            Metric::COUNTER);
+Metric filterFramesBypassed ("kms_filter_frames_bypassed_total",
+                             "Frames filters let through because nobody was "
+                             "subscribed to their events", Metric::COUNTER);
+Metric filterBypassSavedTime ("kms_filter_bypass_saved_microseconds_total",
+                              "Estimated analysis time saved by bypassing filters",
+                              Metric::COUNTER);
+Metric suspendedPipelines ("kms_suspended_pipelines",
+                           "Pipelines suspended while their sessions are on hold",
+                           Metric::GAUGE);
+Metric pipelineResumeTime ("kms_pipeline_resume_milliseconds",
+                           "Time the last suspended pipeline took to play again",
+                           Metric::GAUGE);
+
+} // metrics
+
+static Glib::Threads::Mutex &
+getMutex ()
+{
+  static Glib::Threads::Mutex mutex;
+
+  return mutex;
+}
+
+static std::list<Metric *> &
+getMetrics ()
+{
+  static std::list<Metric *> list;
+
+  return list;
+}
+
+static std::list<MetricsCollector *> &
+getCollectors ()
+{
+  static std::list<MetricsCollector *> list;
+
+  return list;
+}
+
+Metric::Metric (const std::string &name, const std::string &help, Type type)
+{
+  this->name = name;
+  this->help = help;
+  this->type = type;
+
+  for (int i = 0; i < METRICS_SHARDS; i++)
+    shards[i].value.store (0, std::memory_order_relaxed);
+
+  getMutex ().lock ();
+  getMetrics ().push_back (this);
+  getMutex ().unlock ();
+}
+
+Metric::~Metric ()
+{
+  getMutex ().lock ();
+  getMetrics ().remove (this);
+  getMutex ().unlock ();
+}
+
+unsigned int
+Metric::getShard ()
+{
+  static std::atomic<unsigned int> nextShard (0);
+  static thread_local unsigned int shard = nextShard.fetch_add (1) %
+      METRICS_SHARDS;
+
+  return shard;
+}
+
+void
+Metric::set (int64_t value)
+{
+  shards[0].value.store (value, std::memory_order_relaxed);
+
+  for (int i = 1; i < METRICS_SHARDS; i++)
+    shards[i].value.store (0, std::memory_order_relaxed);
+}
+
+int64_t
+Metric::get ()
+{
+  int64_t value = 0;
+
+  for (int i = 0; i < METRICS_SHARDS; i++)
+    value += shards[i].value.load (std::memory_order_relaxed);
+
+  return value;
+}
+
+void
+Metric::serialize (std::string &_return)
+{
+  _return.append ("# HELP " + name + " " + help + "\n");
+  _return.append ("# TYPE " + name + (type == COUNTER ? " counter\n" : " gauge\n") );
+  _return.append (name + " " + std::to_string (get () ) + "\n");
+}
+
+void
+addMetricsCollector (MetricsCollector *collector)
+{
+  getMutex ().lock ();
+  getCollectors ().push_back (collector);
+  getMutex ().unlock ();
+}
+
+void
+removeMetricsCollector (MetricsCollector *collector)
+{
+  getMutex ().lock ();
+  getCollectors ().remove (collector);
+  getMutex ().unlock ();
+}
+
+void
+serializeMetrics (std::string &_return)
+{
+  getMutex ().lock ();
+
+  for (auto it = getMetrics ().begin (); it != getMetrics ().end (); it++)
+    (*it)->serialize (_return);
+
+  for (auto it = getCollectors ().begin (); it != getCollectors ().end (); it++)
+    (*it)->collect (_return);
+
+  getMutex ().unlock ();
+}
+
+} // kurento
@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+#define METRICS_SHARDS 16
+#define METRICS_CACHE_LINE_SIZE 64
+
+namespace kurento
+{
+
+/* Counter or gauge exported in Prometheus text format. Updates go to a */
+/* shard picked once per thread, so concurrent writers never share a */
+/* cache line. Shards are only summed up when metrics are scraped */
+class Metric
+{
+public:
+  enum Type {
+    COUNTER,
+    GAUGE
+  };
+
+  Metric (const std::string &name, const std::string &help, Type type);
+  ~Metric ();
+
+  void add (int64_t value) {
+    shards[getShard ()].value.fetch_add (value, std::memory_order_relaxed);
+  }
+
+  void inc () {
+    add (1);
+  }
+
+  void dec () {
+    add (-1);
+  }
+
+  /* Only for gauges whose value is not an aggregate of many updates */
+  void set (int64_t value);
+
+  int64_t get ();
+  void serialize (std::string &_return);
+
+private:
+  struct Shard {
+    std::atomic<int64_t> value;
+    char padding[METRICS_CACHE_LINE_SIZE - sizeof (std::atomic<int64_t>)];
+  };
+
+  static unsigned int getShard ();
+
+  std::string name;
+  std::string help;
+  Type type;
+  Shard shards[METRICS_SHARDS];
+};
+
+/* Sources of metrics that are computed only when they are scraped */
+class MetricsCollector
+{
+public:
+  virtual ~MetricsCollector () {};
+  virtual void collect (std::string &_return) = 0;
+};
+
+void addMetricsCollector (MetricsCollector *collector);
+void removeMetricsCollector (MetricsCollector *collector);
+
+/* Appends every registered metric to @_return */
+void serializeMetrics (std::string &_return);
+
+namespace metrics
+{
+
+extern Metric rpcRequests;
+extern Metric rpcErrors;
+extern Metric rpcInFlight;
+extern Metric gcExpirations;
+extern Metric eventQueueDepth;
+extern Metric mainLoopLag;
+extern Metric filterFramesProcessed;
+extern Metric filterFramesDropped;
+extern Metric filterFramesBypassed;
+extern Metric filterBypassSavedTime;
+extern Metric suspendedPipelines;
+extern Metric pipelineResumeTime;
+
+} // metrics
+
+} // kurento
+
+#endif /* __METRICS_H__ */
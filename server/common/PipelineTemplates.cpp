@@ -0,0 +1,156 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "PipelineTemplates.hpp"
+#include "MediaElementRegistry.hpp"
+
+#include "utils/utils.hpp"
+#include "KmsMediaErrorCodes_constants.h"
+
+#include <gst/gst.h>
+
+#define GST_CAT_DEFAULT kurento_pipeline_templates
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoPipelineTemplates"
+
+#define TEMPLATE_TYPE_KEY "type"
+#define TEMPLATE_CONNECT_KEY "connect"
+
+namespace kurento
+{
+
+static void
+throwTemplateError (const std::string &name, const std::string &error)
+throw (KmsMediaServerException)
+{
+  KmsMediaServerException except;
+
+  createKmsMediaServerException (except,
+                                 g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                 "Invalid template " + name + ": " + error);
+  throw except;
+}
+
+PipelineTemplates &
+PipelineTemplates::getInstance ()
+{
+  static PipelineTemplates instance;
+
+  return instance;
+}
+
+void
+PipelineTemplates::registerTemplate (const std::string &name,
+                                     const std::string &definition,
+                                     const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  std::shared_ptr<PipelineTemplate> pipelineTemplate (new PipelineTemplate () );
+  std::map<std::string, PipelineTemplate::Element *> elements;
+  Glib::KeyFile keyFile;
+
+  try {
+    keyFile.load_from_data (definition);
+
+    for (auto group : keyFile.get_groups () ) {
+      PipelineTemplate::Element element;
+
+      element.name = group;
+      element.type = keyFile.get_string (group, TEMPLATE_TYPE_KEY);
+
+      if (!MediaElementRegistry::getInstance ().hasType (element.type) )
+        throwTemplateError (name, "unknown type " + element.type);
+
+      if (keyFile.has_key (group, TEMPLATE_CONNECT_KEY) ) {
+        for (auto sink : keyFile.get_string_list (group, TEMPLATE_CONNECT_KEY) )
+          element.sinks.push_back (sink);
+      }
+
+      pipelineTemplate->elements.push_back (element);
+      elements[group] = &pipelineTemplate->elements.back();
+    }
+  } catch (const Glib::Error &err) {
+    throwTemplateError (name, err.what () );
+  }
+
+  if (elements.empty() )
+    throwTemplateError (name, "it has no elements");
+
+  for (auto it = pipelineTemplate->elements.begin();
+       it != pipelineTemplate->elements.end(); it++) {
+    for (auto sink = it->sinks.begin(); sink != it->sinks.end(); sink++) {
+      if (elements.find (*sink) == elements.end() )
+        throwTemplateError (name, it->name + " connects to unknown " + *sink);
+    }
+  }
+
+  for (auto it = params.begin(); it != params.end(); it++) {
+    std::string::size_type dot = it->first.find ('.');
+
+    if (dot == std::string::npos)
+      continue;
+
+    auto element = elements.find (it->first.substr (0, dot) );
+
+    if (element == elements.end() )
+      throwTemplateError (name, "param for unknown element " + it->first);
+
+    element->second->params[it->first.substr (dot + 1)] = it->second;
+  }
+
+  mutex.lock();
+  templates[name] = pipelineTemplate;
+  mutex.unlock();
+
+  GST_DEBUG ("Registered template %s with %zu elements", name.c_str(),
+             pipelineTemplate->elements.size() );
+}
+
+std::shared_ptr<const PipelineTemplate>
+PipelineTemplates::getTemplate (const std::string &name)
+throw (KmsMediaServerException)
+{
+  std::shared_ptr<const PipelineTemplate> pipelineTemplate;
+
+  mutex.lock();
+
+  auto it = templates.find (name);
+
+  if (it != templates.end() )
+    pipelineTemplate = it->second;
+
+  mutex.unlock();
+
+  if (!pipelineTemplate) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                   "There is not any template named " + name);
+    throw except;
+  }
+
+  return pipelineTemplate;
+}
+
+PipelineTemplates::StaticConstructor PipelineTemplates::staticConstructor;
+
+PipelineTemplates::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
@@ -0,0 +1,80 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __PIPELINE_TEMPLATES_H__
+#define __PIPELINE_TEMPLATES_H__
+
+#include "KmsMediaServer_types.h"
+
+#include <glibmm.h>
+#include <list>
+#include <memory>
+
+namespace kurento
+{
+
+/* Media elements and connections created together by createFromTemplate */
+struct PipelineTemplate {
+  struct Element {
+    std::string name;
+    std::string type;
+    std::map<std::string, KmsMediaParam> params;
+    std::list<std::string> sinks;
+  };
+
+  /* In the order they are declared, which is the order they are created */
+  std::list<Element> elements;
+};
+
+/* Templates are described in key file syntax, one group per element:
+ *
+ *   [webrtc]
+ *   type=WebRtcEndPoint
+ *   connect=recorder;http
+ *
+ *   [recorder]
+ *   type=RecorderEndPoint
+ *
+ * Constructor params of an element are passed as "<element>.<param>",
+ * both when the template is registered and as overrides when it is used
+ */
+class PipelineTemplates
+{
+public:
+  static PipelineTemplates &getInstance ();
+
+  void registerTemplate (const std::string &name, const std::string &definition,
+                         const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+
+  std::shared_ptr<const PipelineTemplate> getTemplate (const std::string &name)
+  throw (KmsMediaServerException);
+
+private:
+  Glib::Threads::Mutex mutex;
+  std::map<std::string, std::shared_ptr<const PipelineTemplate>> templates;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __PIPELINE_TEMPLATES_H__ */
@@ -0,0 +1,90 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "PlateAppearances.hpp"
+
+#include <vector>
+
+namespace kurento
+{
+
+static size_t
+editDistance (const std::string &a, const std::string &b)
+{
+  std::vector<size_t> row (b.size() + 1);
+
+  for (size_t j = 0; j <= b.size(); j++)
+    row[j] = j;
+
+  for (size_t i = 1; i <= a.size(); i++) {
+    size_t diagonal = row[0];
+
+    row[0] = i;
+
+    for (size_t j = 1; j <= b.size(); j++) {
+      size_t above = row[j];
+
+      row[j] = MIN (MIN (row[j] + 1, row[j - 1] + 1),
+                    diagonal + (a[i - 1] == b[j - 1] ? 0 : 1) );
+      diagonal = above;
+    }
+  }
+
+  return row[b.size()];
+}
+
+PlateAppearances::PlateAppearances (gint64 timeout) : timeout (timeout)
+{
+}
+
+void
+PlateAppearances::setTimeout (gint64 timeout)
+{
+  this->timeout = timeout;
+}
+
+bool
+PlateAppearances::isNewAppearance (const std::string &plateNumber, gint64 now)
+{
+  bool found = false;
+
+  for (auto it = visiblePlates.begin(); it != visiblePlates.end(); ) {
+    if (now - it->lastSeen > timeout) {
+      it = visiblePlates.erase (it);
+      continue;
+    }
+
+    if (!found && editDistance (it->number, plateNumber) <=
+        MAX (1, MAX (it->number.size(), plateNumber.size() ) / 4) ) {
+      it->lastSeen = now;
+      found = true;
+    }
+
+    it++;
+  }
+
+  if (found)
+    return false;
+
+  Plate plate;
+
+  plate.number = plateNumber;
+  plate.lastSeen = now;
+  visiblePlates.push_back (plate);
+
+  return true;
+}
+
+} // kurento
@@ -0,0 +1,54 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __PLATE_APPEARANCES_H__
+#define __PLATE_APPEARANCES_H__
+
+#include <glib.h>
+#include <list>
+#include <string>
+
+namespace kurento
+{
+
+/* Tells new appearances of license plates from readings of the plates */
+/* already in view. Recognition of a plate in view varies between frames */
+/* by a character or two, so readings close to a visible plate belong to */
+/* it. Not thread safe */
+class PlateAppearances
+{
+public:
+  /* Plates unseen for more than @timeout microseconds are out of view */
+  PlateAppearances (gint64 timeout);
+
+  void setTimeout (gint64 timeout);
+
+  /* Records a reading of @plateNumber at @now monotonic time */
+  bool isNewAppearance (const std::string &plateNumber, gint64 now);
+
+private:
+  /* A plate in view, seen last at @lastSeen monotonic time */
+  struct Plate {
+    std::string number;
+    gint64 lastSeen;
+  };
+
+  gint64 timeout;
+  std::list<Plate> visiblePlates;
+};
+
+} // kurento
+
+#endif /* __PLATE_APPEARANCES_H__ */
@@ -24,6 +24,7 @@
 #include <server/TNonblockingServer.h>
 #include <concurrency/PosixThreadFactory.h>
 #include <concurrency/ThreadManager.h>
+#include <TProcessor.h>
 
 #include "media_config.hpp"
 
@@ -34,9 +35,14 @@
 #include <version.hpp>
 #include "log.hpp"
 #include "httpendpointserver.hpp"
+#include "common/Metrics.hpp"
+#include "common/ElementPool.hpp"
+#include "common/MediaElementRegistry.hpp"
 
 #define GST_DEFAULT_NAME "media_server"
 
+#define MAIN_LOOP_PROBE_PERIOD 1000 /* ms */
+
 GST_DEBUG_CATEGORY (GST_CAT_DEFAULT);
 
 using namespace ::apache::thrift;
@@ -56,6 +62,11 @@ using ::Glib::KeyFileFlags;
 static std::string serverAddress, httpEPServerAddress,
        httpEPServerAnnouncedAddress;
 static gint serverServicePort, httpEPServerServicePort;
+static guint httpEPServerWorkers = HTTP_EP_SERVER_WORKERS;
+static guint httpEPServerSegmentDuration = HTTP_EP_SERVER_SEGMENT_DURATION;
+static guint httpEPServerSegmentCacheSize = HTTP_EP_SERVER_SEGMENT_CACHE_SIZE;
+static guint httpEPServerCoalesceSize = HTTP_EP_SERVER_COALESCE_SIZE;
+static guint httpEPServerCoalesceLatency = HTTP_EP_SERVER_COALESCE_LATENCY;
 GstSDPMessage *sdpPattern;
 KmsHttpEPServer *httpepserver;
 std::string stunServerAddress, pemCertificate;
@@ -74,6 +85,25 @@ static GOptionEntry entries[] = {
   {NULL}
 };
 
+/* Counts Thrift calls as they go through the processor */
+class RpcMetricsEventHandler : public TProcessorEventHandler
+{
+public:
+  void *getContext (const char *fn_name, void *serverContext) {
+    metrics::rpcRequests.inc ();
+    metrics::rpcInFlight.inc ();
+    return NULL;
+  }
+
+  void freeContext (void *ctx, const char *fn_name) {
+    metrics::rpcInFlight.dec ();
+  }
+
+  void handlerError (void *ctx, const char *fn_name) {
+    metrics::rpcErrors.inc ();
+  }
+};
+
 static void
 create_media_server_service ()
 {
@@ -81,6 +111,8 @@ create_media_server_service ()
   handler (new MediaServerServiceHandler () );
   shared_ptr < TProcessor >
   processor (new KmsMediaServerServiceProcessor (handler) );
+  processor->setEventHandler (shared_ptr < TProcessorEventHandler >
+                              (new RpcMetricsEventHandler () ) );
   shared_ptr < TProtocolFactory >
   protocolFactory (new TBinaryProtocolFactory () );
   shared_ptr < PosixThreadFactory > threadFactory (new PosixThreadFactory () );
@@ -125,11 +157,23 @@ set_default_http_ep_server_config ()
                httpEPServerAddress.c_str (), httpEPServerServicePort);
 }
 
+static void
+set_default_element_pool_config ()
+{
+  ElementPool &pool = ElementPool::getInstance ();
+
+  pool.setSize (ELEMENT_POOL_PIPELINE, ELEMENT_POOL_PIPELINES);
+  pool.setSize ("webrtcendpoint", ELEMENT_POOL_END_POINTS);
+  pool.setSize ("rtpendpoint", ELEMENT_POOL_END_POINTS);
+  pool.setSize ("httpendpoint", ELEMENT_POOL_END_POINTS);
+}
+
 static void
 set_default_config ()
 {
   set_default_media_server_config ();
   set_default_http_ep_server_config();
+  set_default_element_pool_config ();
 }
 
 static gchar *
@@ -264,6 +308,85 @@ configure_http_ep_server (KeyFile &configFile)
     GST_WARNING ("Http end point server will choose any available "
                  "IP address to compose URLs");
   }
+
+  try {
+    gint workers;
+
+    workers = configFile.get_integer (HTTP_EP_SERVER_GROUP,
+                                      HTTP_EP_SERVER_WORKERS_KEY);
+
+    if (workers < 0)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+
+    httpEPServerWorkers = workers;
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Http end point server will run in the main loop");
+    httpEPServerWorkers = HTTP_EP_SERVER_WORKERS;
+  }
+
+  try {
+    gint duration;
+
+    duration = configFile.get_integer (HTTP_EP_SERVER_GROUP,
+                                       HTTP_EP_SERVER_SEGMENT_DURATION_KEY);
+
+    if (duration <= 0 || duration > HTTP_EP_SERVER_MAX_SEGMENT_DURATION)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+
+    httpEPServerSegmentDuration = duration;
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Setting default segment duration %d",
+              HTTP_EP_SERVER_SEGMENT_DURATION);
+    httpEPServerSegmentDuration = HTTP_EP_SERVER_SEGMENT_DURATION;
+  }
+
+  try {
+    gint size;
+
+    size = configFile.get_integer (HTTP_EP_SERVER_GROUP,
+                                   HTTP_EP_SERVER_SEGMENT_CACHE_SIZE_KEY);
+
+    if (size < 0 || size > HTTP_EP_SERVER_MAX_SEGMENT_CACHE_SIZE)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+
+    httpEPServerSegmentCacheSize = size;
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Setting default segment cache size %d MiB",
+              HTTP_EP_SERVER_SEGMENT_CACHE_SIZE);
+    httpEPServerSegmentCacheSize = HTTP_EP_SERVER_SEGMENT_CACHE_SIZE;
+  }
+
+  try {
+    gint size;
+
+    size = configFile.get_integer (HTTP_EP_SERVER_GROUP,
+                                   HTTP_EP_SERVER_COALESCE_SIZE_KEY);
+
+    if (size < 0 || size > HTTP_EP_SERVER_MAX_COALESCE_SIZE)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+
+    httpEPServerCoalesceSize = size;
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Setting default coalesce size %d bytes",
+              HTTP_EP_SERVER_COALESCE_SIZE);
+    httpEPServerCoalesceSize = HTTP_EP_SERVER_COALESCE_SIZE;
+  }
+
+  try {
+    gint latency;
+
+    latency = configFile.get_integer (HTTP_EP_SERVER_GROUP,
+                                      HTTP_EP_SERVER_COALESCE_LATENCY_KEY);
+
+    if (latency < 0 || latency > HTTP_EP_SERVER_MAX_COALESCE_LATENCY)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+
+    httpEPServerCoalesceLatency = latency;
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Setting default coalesce latency %d ms",
+              HTTP_EP_SERVER_COALESCE_LATENCY);
+    httpEPServerCoalesceLatency = HTTP_EP_SERVER_COALESCE_LATENCY;
+  }
 }
 
 static void
@@ -309,6 +432,38 @@ configure_web_rtc_end_point (KeyFile &configFile, const std::string &file_name)
   }
 }
 
+static void
+configure_element_pool_size (KeyFile &configFile, const std::string &key,
+                             const std::string &factory, gint defaultSize)
+{
+  gint size;
+
+  try {
+    size = configFile.get_integer (ELEMENT_POOL_GROUP, key);
+
+    if (size < 0 || size > ELEMENT_POOL_MAX_SIZE)
+      throw Glib::KeyFileError (Glib::KeyFileError::PARSE, "Invalid value");
+  } catch (const Glib::KeyFileError &err) {
+    GST_INFO ("Keeping %d %s elements in advance", defaultSize, factory.c_str () );
+    size = defaultSize;
+  }
+
+  ElementPool::getInstance ().setSize (factory, size);
+}
+
+static void
+configure_element_pool (KeyFile &configFile)
+{
+  configure_element_pool_size (configFile, ELEMENT_POOL_PIPELINES_KEY,
+                               ELEMENT_POOL_PIPELINE, ELEMENT_POOL_PIPELINES);
+  configure_element_pool_size (configFile, ELEMENT_POOL_WEB_RTC_END_POINTS_KEY,
+                               "webrtcendpoint", ELEMENT_POOL_END_POINTS);
+  configure_element_pool_size (configFile, ELEMENT_POOL_RTP_END_POINTS_KEY,
+                               "rtpendpoint", ELEMENT_POOL_END_POINTS);
+  configure_element_pool_size (configFile, ELEMENT_POOL_HTTP_END_POINTS_KEY,
+                               "httpendpoint", ELEMENT_POOL_END_POINTS);
+}
+
 static void
 load_config (const std::string &file_name)
 {
@@ -335,6 +490,7 @@ load_config (const std::string &file_name)
   configure_kurento_media_server (configFile, file_name);
   configure_http_ep_server (configFile);
   configure_web_rtc_end_point (configFile, file_name);
+  configure_element_pool (configFile);
 
   GST_INFO ("Configuration loaded successfully");
 }
@@ -434,6 +590,39 @@ bt_sighandler (int sig, siginfo_t *info, gpointer data)
   }
 }
 
+static void
+append_metrics (KmsHttpEPServer *self, GString *metrics, gpointer data)
+{
+  std::string serialized;
+
+  serializeMetrics (serialized);
+  g_string_append_len (metrics, serialized.c_str (), serialized.size () );
+}
+
+static gboolean
+probe_main_loop_lag (gpointer data)
+{
+  gint64 *expected = (gint64 *) data;
+  gint64 now = g_get_monotonic_time ();
+
+  /* Time this probe waited beyond its period to be dispatched */
+  metrics::mainLoopLag.set (MAX (now - *expected, 0) );
+  *expected = now + MAIN_LOOP_PROBE_PERIOD * G_TIME_SPAN_MILLISECOND;
+
+  return TRUE;
+}
+
+static void
+start_main_loop_probe ()
+{
+  gint64 *expected = g_new (gint64, 1);
+
+  *expected = g_get_monotonic_time () +
+              MAIN_LOOP_PROBE_PERIOD * G_TIME_SPAN_MILLISECOND;
+  g_timeout_add_full (G_PRIORITY_DEFAULT, MAIN_LOOP_PROBE_PERIOD,
+                      probe_main_loop_lag, expected, g_free);
+}
+
 static void
 http_server_start_cb (KmsHttpEPServer *self, GError *err)
 {
@@ -484,6 +673,9 @@ main (int argc, char **argv)
   Glib::thread_init ();
   GST_INFO ("Kmsc version: %s", get_version () );
 
+  /* Element pools configured below need the factories already resolved */
+  registerMediaElementTypes ();
+
   if (!conf_file)
     load_config (DEFAULT_CONFIG_FILE);
   else
@@ -498,8 +690,18 @@ main (int argc, char **argv)
                    KMS_HTTP_EP_SERVER_ANNOUNCED_IP,
                    (httpEPServerAnnouncedAddress.empty() ) ? NULL :
                    httpEPServerAnnouncedAddress.c_str (),
+                   KMS_HTTP_EP_SERVER_WORKERS, httpEPServerWorkers,
+                   KMS_HTTP_EP_SERVER_SEGMENT_DURATION, httpEPServerSegmentDuration,
+                   KMS_HTTP_EP_SERVER_SEGMENT_CACHE_SIZE,
+                   httpEPServerSegmentCacheSize * 1024 * 1024,
+                   KMS_HTTP_EP_SERVER_COALESCE_SIZE, httpEPServerCoalesceSize,
+                   KMS_HTTP_EP_SERVER_COALESCE_LATENCY, httpEPServerCoalesceLatency,
                    NULL);
 
+  kms_http_ep_server_set_metrics_func (httpepserver, append_metrics, NULL,
+                                       NULL);
+  start_main_loop_probe ();
+
   kms_http_ep_server_start (httpepserver, http_server_start_cb);
 
   loop->run ();
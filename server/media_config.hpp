@@ -30,12 +30,23 @@
 #define HTTP_EP_SERVER_ADDRESS_KEY MEDIA_SERVER_ADDRESS_KEY
 #define HTTP_EP_SERVER_SERVICE_PORT_KEY MEDIA_SERVER_SERVICE_PORT_KEY
 #define HTTP_EP_SERVER_ANNOUNCED_ADDRESS_KEY "announcedAddress"
+#define HTTP_EP_SERVER_WORKERS_KEY "workers"
+#define HTTP_EP_SERVER_SEGMENT_DURATION_KEY "segmentDuration"
+#define HTTP_EP_SERVER_SEGMENT_CACHE_SIZE_KEY "segmentCacheSize"
+#define HTTP_EP_SERVER_COALESCE_SIZE_KEY "coalesceSize"
+#define HTTP_EP_SERVER_COALESCE_LATENCY_KEY "coalesceLatency"
 
 #define WEB_RTC_END_POINT_GROUP "WebRtcEndPoint"
 #define WEB_RTC_END_POINT_STUN_SERVER_ADDRESS_KEY "stunServerAddress"
 #define WEB_RTC_END_POINT_STUN_SERVER_PORT_KEY "stunServerPort"
 #define WEB_RTC_END_POINT_PEM_CERTIFICATE_KEY "pemCertificate"
 
+#define ELEMENT_POOL_GROUP "ElementPool"
+#define ELEMENT_POOL_PIPELINES_KEY "pipelines"
+#define ELEMENT_POOL_WEB_RTC_END_POINTS_KEY "webRtcEndPoints"
+#define ELEMENT_POOL_RTP_END_POINTS_KEY "rtpEndPoints"
+#define ELEMENT_POOL_HTTP_END_POINTS_KEY "httpEndPoints"
+
 #define MEDIA_SERVER_ADDRESS "localhost"
 #define MEDIA_SERVER_SERVICE_PORT 9090
 
@@ -43,6 +54,19 @@
 #define STUN_SERVER_PORT 0
 
 #define HTTP_EP_SERVER_SERVICE_PORT ((MEDIA_SERVER_SERVICE_PORT) + 1)
+#define HTTP_EP_SERVER_WORKERS 0
+#define HTTP_EP_SERVER_SEGMENT_DURATION 4 /* seconds */
+#define HTTP_EP_SERVER_MAX_SEGMENT_DURATION 60 /* seconds */
+#define HTTP_EP_SERVER_SEGMENT_CACHE_SIZE 64 /* MiB */
+#define HTTP_EP_SERVER_MAX_SEGMENT_CACHE_SIZE 4095 /* MiB */
+#define HTTP_EP_SERVER_COALESCE_SIZE 0 /* bytes, disabled */
+#define HTTP_EP_SERVER_MAX_COALESCE_SIZE (4 * 1024 * 1024) /* bytes */
+#define HTTP_EP_SERVER_COALESCE_LATENCY 20 /* milliseconds */
+#define HTTP_EP_SERVER_MAX_COALESCE_LATENCY 1000 /* milliseconds */
+
+#define ELEMENT_POOL_PIPELINES 4
+#define ELEMENT_POOL_END_POINTS 2
+#define ELEMENT_POOL_MAX_SIZE 256
 
 extern GstSDPMessage *sdpPattern;
 extern std::string stunServerAddress;
@@ -15,19 +15,645 @@
 
 #include "Filter.hpp"
 
+#include "utils/utils.hpp"
+#include "utils/marshalling.hpp"
+#include "common/Metrics.hpp"
+#include "KmsMediaErrorCodes_constants.h"
+
+#include <cstdio>
+
+#define GST_CAT_DEFAULT kurento_filter
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoFilter"
+
+/* Adaptive analysis never analyses less than 1 of every 16 scheduled frames */
+#define MAX_ANALYSIS_BACKOFF 16
+
 namespace kurento
 {
 
+/* Sequence number tagging frames queued for async analysis */
+static GQuark
+queued_frame_quark ()
+{
+  static GQuark quark = g_quark_from_static_string ("kms-queued-frame");
+
+  return quark;
+}
+
+GstPadProbeReturn
+analysis_sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer filter)
+{
+  Filter *self = (Filter *) filter;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (self->analysisBypassed || self->demandBypassed) {
+    self->frameBypassed ();
+  } else if (self->analyseFrame (buffer) ) {
+    if (self->asyncAnalysis)
+      self->frameQueued (buffer);
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* In async mode the frame already went on through the tee */
+  if (self->asyncAnalysis)
+    return GST_PAD_PROBE_DROP;
+
+  /* Analysers work in place, so the frame can go around them unchanged */
+  gst_pad_push (self->analysisSrc, gst_buffer_ref (buffer) );
+
+  return GST_PAD_PROBE_DROP;
+}
+
+GstPadProbeReturn
+analysis_start_probe (GstPad *pad, GstPadProbeInfo *info, gpointer filter)
+{
+  ( (Filter *) filter)->frameDequeued (GST_PAD_PROBE_INFO_BUFFER (info) );
+
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn
+analysis_src_probe (GstPad *pad, GstPadProbeInfo *info, gpointer filter)
+{
+  ( (Filter *) filter)->frameAnalysed ();
+
+  return GST_PAD_PROBE_OK;
+}
+
+void
+analysis_queue_overrun (GstElement *queue, gpointer filter)
+{
+  ( (Filter *) filter)->frameReplaced ();
+}
+
+static int
+getAnalysisParam (const std::map<std::string, KmsMediaParam> &params,
+                  const std::string &name)
+{
+  const KmsMediaParam *p;
+  int value;
+
+  p = getParam (params, name);
+
+  if (p == NULL)
+    return 0;
+
+  value = unmarshalI32Param (*p);
+
+  if (value < 0) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                   "Param '" + name + "' can not be negative");
+    throw except;
+  }
+
+  return value;
+}
+
 Filter::Filter (MediaSet &mediaSet, std::shared_ptr<MediaObjectImpl> parent,
                 const std::string &filterType,
+                const std::map<std::string, KmsMediaParam> &params,
+                const std::string &analysisFormat)
+  : MediaElement (mediaSet, parent, filterType, params),
+    analysisFormat (analysisFormat), processedFrames (0), droppedFrames (0),
+    analysisLag (0), analysisCost (0), bypassedFrames (0), bypassSavedTime (0),
+    analysisBypassed (false), demandBypassed (false)
+{
+  const KmsMediaParam *p;
+
+  p = getParam (params, FILTER_ANALYSIS_FORMAT_PARAM);
+
+  if (p != NULL)
+    unmarshalStringParam (this->analysisFormat, *p);
+
+  setAnalysisArea (params);
+
+  analysisFps = getAnalysisParam (params, FILTER_ANALYSIS_FPS_PARAM);
+  skipFrames = getAnalysisParam (params, FILTER_SKIP_FRAMES_PARAM);
+  adaptiveAnalysis = getAnalysisParam (params, FILTER_ADAPTIVE_ANALYSIS_PARAM) != 0;
+  asyncAnalysis = getAnalysisParam (params, FILTER_ASYNC_ANALYSIS_PARAM) != 0;
+}
+
+void
+Filter::initAnalysis ()
+{
+  GstElement *filter = NULL;
+
+  g_object_get (G_OBJECT (element), "filter", &filter, NULL);
+
+  if (filter == NULL) {
+    GST_WARNING ("Filter %s has no analyser, frames will not be counted",
+                 GST_ELEMENT_NAME (element) );
+    return;
+  }
+
+  analysisSink = gst_element_get_static_pad (filter, "sink");
+  analysisSrc = gst_element_get_static_pad (filter, "src");
+
+  if (analysisSink == NULL || analysisSrc == NULL) {
+    GST_WARNING ("Analyser of filter %s is not a transform",
+                 GST_ELEMENT_NAME (element) );
+    g_object_unref (filter);
+    return;
+  }
+
+  if (asyncAnalysis && !branchAnalysis (filter) ) {
+    GST_WARNING ("Filter %s can not analyse frames asynchronously",
+                 GST_ELEMENT_NAME (element) );
+    asyncAnalysis = false;
+  }
+
+  // There is no need to reference the analyser, its pads are kept instead
+  g_object_unref (filter);
+
+  if (asyncAnalysis) {
+    sinkProbeId = gst_pad_add_probe (queueSink, GST_PAD_PROBE_TYPE_BUFFER,
+                                     analysis_sink_probe, this, NULL);
+    startProbeId = gst_pad_add_probe (analysisSink, GST_PAD_PROBE_TYPE_BUFFER,
+                                      analysis_start_probe, this, NULL);
+  } else {
+    sinkProbeId = gst_pad_add_probe (analysisSink, GST_PAD_PROBE_TYPE_BUFFER,
+                                     analysis_sink_probe, this, NULL);
+  }
+
+  srcProbeId = gst_pad_add_probe (analysisSrc, GST_PAD_PROBE_TYPE_BUFFER,
+                                  analysis_src_probe, this, NULL);
+}
+
+/* Moves the analyser out of the path of the frames, to a branch with a */
+/* leaky queue, so it runs in its own streaming thread and only gets the */
+/* newest frame when it is done with the previous one */
+bool
+Filter::branchAnalysis (GstElement *filter)
+{
+  GstObject *parent;
+  GstPad *upstream, *downstream, *teeSink, *teeSrc;
+  GstElement *tee, *queue, *sink;
+  bool ret = false;
+
+  parent = gst_object_get_parent (GST_OBJECT (filter) );
+  upstream = gst_pad_get_peer (analysisSink);
+  downstream = gst_pad_get_peer (analysisSrc);
+
+  if (parent == NULL || !GST_IS_BIN (parent) || upstream == NULL ||
+      downstream == NULL)
+    goto end;
+
+  tee = gst_element_factory_make ("tee", NULL);
+  queue = gst_element_factory_make ("queue", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+
+  /* Leaky downstream, the oldest frame is dropped when a new one comes */
+  g_object_set (G_OBJECT (queue), "leaky", 2, "max-size-buffers", 1,
+                "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  g_object_set (G_OBJECT (sink), "sync", FALSE, "async", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (parent), tee, queue, sink, NULL);
+
+  /* The element was just created, no frame is flowing yet */
+  gst_pad_unlink (upstream, analysisSink);
+  gst_pad_unlink (analysisSrc, downstream);
+
+  teeSink = gst_element_get_static_pad (tee, "sink");
+  teeSrc = gst_element_get_request_pad (tee, "src_%u");
+  gst_pad_link (upstream, teeSink);
+  gst_pad_link (teeSrc, downstream);
+  g_object_unref (teeSink);
+  g_object_unref (teeSrc);
+
+  gst_element_link_many (tee, queue, filter, sink, NULL);
+
+  gst_element_sync_state_with_parent (sink);
+  gst_element_sync_state_with_parent (queue);
+  gst_element_sync_state_with_parent (tee);
+
+  analysisQueue = GST_ELEMENT (g_object_ref (queue) );
+  queueSink = gst_element_get_static_pad (queue, "sink");
+  overrunId = g_signal_connect (queue, "overrun",
+                                G_CALLBACK (analysis_queue_overrun), this);
+  ret = true;
+
+end:
+
+  if (parent != NULL)
+    g_object_unref (parent);
+
+  if (upstream != NULL)
+    g_object_unref (upstream);
+
+  if (downstream != NULL)
+    g_object_unref (downstream);
+
+  return ret;
+}
+
+void
+Filter::scheduleNextAnalysis ()
+{
+  framesToSkip = (skipFrames + 1) * backoff - 1;
+
+  if (analysisFps > 0 && GST_CLOCK_TIME_IS_VALID (lastAnalysis) )
+    nextAnalysis = lastAnalysis + backoff * GST_SECOND / analysisFps;
+}
+
+bool
+Filter::analyseFrame (GstBuffer *buffer)
+{
+  GstClockTime ts = GST_BUFFER_PTS (buffer);
+  bool analyse = true;
+
+  if (framesToSkip > 0) {
+    framesToSkip--;
+    analyse = false;
+  } else if (analysisFps > 0 && GST_CLOCK_TIME_IS_VALID (ts) &&
+             GST_CLOCK_TIME_IS_VALID (nextAnalysis) &&
+             ts < nextAnalysis && ts >= lastAnalysis) {
+    /* Timestamps going back mean a new segment, which is analysed at once */
+    analyse = false;
+  }
+
+  if (!analyse) {
+    droppedFrames++;
+    metrics::filterFramesDropped.inc ();
+    return false;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (ts) ) {
+    if (GST_CLOCK_TIME_IS_VALID (lastAnalysis) && ts > lastAnalysis)
+      analysisPeriod = ts - lastAnalysis;
+    else
+      analysisPeriod = GST_CLOCK_TIME_NONE;
+
+    lastAnalysis = ts;
+  }
+
+  scheduleNextAnalysis ();
+
+  if (asyncAnalysis)
+    return true;
+
+  analysisStart = g_get_monotonic_time ();
+
+  processedFrames++;
+  metrics::filterFramesProcessed.inc ();
+
+  return true;
+}
+
+void
+Filter::frameQueued (GstBuffer *buffer)
+{
+  queueMutex.lock ();
+  /* Pooled buffers come back with the same address, so frames are told */
+  /* apart by a number. Zero is left for frames never tagged */
+  if (++queuedFrame == 0)
+    ++queuedFrame;
+
+  gst_mini_object_set_qdata (GST_MINI_OBJECT (buffer), queued_frame_quark (),
+                             GUINT_TO_POINTER (queuedFrame), NULL);
+  queuedSince = g_get_monotonic_time ();
+  queueMutex.unlock ();
+}
+
+void
+Filter::frameReplaced ()
+{
+  droppedFrames++;
+  metrics::filterFramesDropped.inc ();
+}
+
+void
+Filter::frameDequeued (GstBuffer *buffer)
+{
+  guint frame;
+
+  analysisStart = g_get_monotonic_time ();
+  frame = GPOINTER_TO_UINT (gst_mini_object_get_qdata (GST_MINI_OBJECT (buffer),
+                            queued_frame_quark () ) );
+
+  queueMutex.lock ();
+
+  /* A frame may be queued after the one leaving was, then it is left */
+  /* waiting since the analysis start */
+  if (frame != 0 && frame == queuedFrame)
+    dequeuedSince = queuedSince;
+  else
+    dequeuedSince = analysisStart;
+
+  queueMutex.unlock ();
+}
+
+void
+Filter::frameAnalysed ()
+{
+  GstClockTime cost;
+
+  /* Frames let through without analysing them also get here */
+  if (analysisStart == 0)
+    return;
+
+  cost = (g_get_monotonic_time () - analysisStart) * GST_USECOND;
+  analysisStart = 0;
+  recordAnalysisCost (cost);
+
+  if (asyncAnalysis) {
+    analysisLag = g_get_monotonic_time () - dequeuedSince;
+    processedFrames++;
+    metrics::filterFramesProcessed.inc ();
+    /* The queue already drops what the analyser can not keep up with */
+    return;
+  }
+
+  if (!adaptiveAnalysis || !GST_CLOCK_TIME_IS_VALID (analysisPeriod) )
+    return;
+
+  if (cost * 2 > analysisPeriod && backoff < MAX_ANALYSIS_BACKOFF) {
+    backoff *= 2;
+  } else if (cost * 4 < analysisPeriod && backoff > 1) {
+    /* Halving the period keeps the load under a half */
+    backoff /= 2;
+  } else {
+    return;
+  }
+
+  GST_DEBUG ("Filter %s analysing %d times less frames",
+             GST_ELEMENT_NAME (element), backoff);
+  scheduleNextAnalysis ();
+}
+
+void
+Filter::recordAnalysisCost (GstClockTime cost)
+{
+  gint64 average = analysisCost.load ();
+
+  /* Moving average, so the estimate follows changes in the scene */
+  if (average == 0)
+    analysisCost = cost;
+  else
+    analysisCost = (7 * average + cost) / 8;
+}
+
+void
+Filter::frameBypassed ()
+{
+  gint64 cost = analysisCost.load () / GST_USECOND;
+
+  bypassedFrames++;
+  bypassSavedTime += cost;
+  metrics::filterFramesBypassed.inc ();
+  metrics::filterBypassSavedTime.add (cost);
+}
+
+void
+Filter::addAnalysisEventType (const std::string &eventType)
+{
+  analysisEventTypes.push_back (eventType);
+  updateAnalysisBypass ();
+}
+
+void
+Filter::updateAnalysisBypass ()
+{
+  bool bypass = !analysisEventTypes.empty ();
+  bool changed = false;
+
+  bypassMutex.lock ();
+
+  for (auto it = analysisEventTypes.begin(); it != analysisEventTypes.end(); it++) {
+    if (mediaHandlerManager.getMediaHandlersSetSize (*it) > 0)
+      bypass = false;
+  }
+
+  if (bypass != analysisBypassed) {
+    GST_DEBUG ("Filter %s %s analysing frames", GST_ELEMENT_NAME (element),
+               bypass ? "stops" : "starts");
+    analysisBypassed = bypass;
+    changed = true;
+  }
+
+  bypassMutex.unlock ();
+
+  if (changed)
+    scheduleUpstreamDemandUpdate ();
+}
+
+bool
+Filter::consumesMedia ()
+{
+  return !analysisEventTypes.empty () && !analysisBypassed;
+}
+
+void
+Filter::onDemandChanged (bool demanded)
+{
+  if (analysisEventTypes.empty () )
+    demandBypassed = !demanded;
+}
+
+void
+Filter::unsubscribe (const std::string &callbackToken)
+throw (KmsMediaServerException)
+{
+  MediaElement::unsubscribe (callbackToken);
+  updateAnalysisBypass ();
+}
+
+static void
+throwIllegalRegions (const std::string &regions)
+throw (KmsMediaServerException)
+{
+  KmsMediaServerException except;
+
+  createKmsMediaServerException (except,
+                                 g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                 "Invalid analysis regions '" + regions + "'");
+  throw except;
+}
+
+void
+Filter::setAnalysisArea (const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  std::list<AnalysisRegion> regions;
+  const KmsMediaParam *p;
+  int width, height;
+
+  width = getAnalysisParam (params, FILTER_ANALYSIS_WIDTH_PARAM);
+  height = getAnalysisParam (params, FILTER_ANALYSIS_HEIGHT_PARAM);
+
+  p = getParam (params, FILTER_ANALYSIS_REGIONS_PARAM);
+
+  if (p != NULL) {
+    std::string regionsStr;
+    gchar **rects;
+
+    unmarshalStringParam (regionsStr, *p);
+    rects = g_strsplit (regionsStr.c_str(), ";", -1);
+
+    for (gchar **rect = rects; *rect != NULL; rect++) {
+      AnalysisRegion region;
+
+      if (g_strstrip (*rect) [0] == '\0')
+        continue;
+
+      if (sscanf (*rect, "%d,%d,%d,%d", &region.x, &region.y, &region.width,
+                  &region.height) != 4 || region.x < 0 || region.y < 0 ||
+          region.width <= 0 || region.height <= 0) {
+        g_strfreev (rects);
+        throwIllegalRegions (regionsStr);
+      }
+
+      regions.push_back (region);
+    }
+
+    g_strfreev (rects);
+  }
+
+  areaMutex.lock ();
+  analysisWidth = width;
+  analysisHeight = height;
+  analysisRegions = regions;
+  areaMutex.unlock ();
+}
+
+void
+Filter::reconnectAnalysis ()
+{
+  std::vector < std::shared_ptr<MediaSink> > sinks;
+
+  getMediaSinksByMediaType (sinks, KmsMediaType::type::VIDEO);
+
+  for (auto it = sinks.begin(); it != sinks.end(); it++) {
+    std::shared_ptr<MediaSrc> src = (*it)->getConnectedSrc ();
+
+    /* Connecting again switches to the frames of the new area */
+    if (src != NULL)
+      src->connect (*it);
+  }
+}
+
+std::string
+Filter::getAnalysisCaps ()
+{
+  std::string caps;
+
+  areaMutex.lock ();
+
+  if (!analysisFormat.empty () )
+    caps += ",format=" + analysisFormat;
+
+  if (analysisWidth > 0)
+    caps += ",width=" + std::to_string (analysisWidth);
+
+  if (analysisHeight > 0)
+    caps += ",height=" + std::to_string (analysisHeight);
+
+  areaMutex.unlock ();
+
+  if (caps.empty () )
+    return "";
+
+  return "video/x-raw" + caps;
+}
+
+bool
+Filter::getAnalysisCrop (AnalysisRegion &_return)
+{
+  int right = 0, bottom = 0;
+
+  areaMutex.lock ();
+
+  if (analysisRegions.empty () ) {
+    areaMutex.unlock ();
+    return false;
+  }
+
+  _return.x = G_MAXINT;
+  _return.y = G_MAXINT;
+
+  for (auto it = analysisRegions.begin(); it != analysisRegions.end(); it++) {
+    _return.x = MIN (_return.x, it->x);
+    _return.y = MIN (_return.y, it->y);
+    right = MAX (right, it->x + it->width);
+    bottom = MAX (bottom, it->y + it->height);
+  }
+
+  areaMutex.unlock ();
+
+  _return.width = right - _return.x;
+  _return.height = bottom - _return.y;
+
+  return true;
+}
+
+void
+Filter::invoke (KmsMediaInvocationReturn &_return, const std::string &command,
                 const std::map<std::string, KmsMediaParam> &params)
-  : MediaElement (mediaSet, parent, filterType, params)
+throw (KmsMediaServerException)
 {
+  if (FILTER_GET_PROCESSED_FRAMES == command) {
+    createI32InvocationReturn (_return, (int32_t) processedFrames.load () );
+  } else if (FILTER_GET_DROPPED_FRAMES == command) {
+    createI32InvocationReturn (_return, (int32_t) droppedFrames.load () );
+  } else if (FILTER_SET_ANALYSIS_AREA == command) {
+    setAnalysisArea (params);
+    reconnectAnalysis ();
+    createVoidInvocationReturn (_return);
+  } else if (FILTER_GET_BYPASSED_FRAMES == command) {
+    createI32InvocationReturn (_return, (int32_t) bypassedFrames.load () );
+  } else if (FILTER_GET_BYPASS_SAVED_TIME == command) {
+    createI32InvocationReturn (_return,
+                               (int32_t) (bypassSavedTime.load () / G_TIME_SPAN_MILLISECOND) );
+  } else if (FILTER_GET_ANALYSIS_LAG == command) {
+    createI32InvocationReturn (_return,
+                               (int32_t) (analysisLag.load () / G_TIME_SPAN_MILLISECOND) );
+  } else {
+    MediaElement::invoke (_return, command, params);
+  }
 }
 
 Filter::~Filter() throw ()
 {
+  /* Subclasses have already stopped the element, no frame is in the probes */
+  if (analysisSink != NULL) {
+    if (startProbeId != 0)
+      gst_pad_remove_probe (analysisSink, startProbeId);
+    else if (sinkProbeId != 0)
+      gst_pad_remove_probe (analysisSink, sinkProbeId);
+
+    g_object_unref (analysisSink);
+  }
+
+  if (analysisSrc != NULL) {
+    if (srcProbeId != 0)
+      gst_pad_remove_probe (analysisSrc, srcProbeId);
+
+    g_object_unref (analysisSrc);
+  }
+
+  if (queueSink != NULL) {
+    if (sinkProbeId != 0)
+      gst_pad_remove_probe (queueSink, sinkProbeId);
 
+    g_object_unref (queueSink);
+  }
+
+  if (analysisQueue != NULL) {
+    g_signal_handler_disconnect (analysisQueue, overrunId);
+    g_object_unref (analysisQueue);
+  }
+}
+
+Filter::StaticConstructor Filter::staticConstructor;
+
+Filter::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
 }
 
 } // kurento
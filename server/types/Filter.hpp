@@ -18,18 +18,168 @@
 
 #include "MediaElement.hpp"
 
+#include <atomic>
+
+/* Optional String constructor param with the raw video format, such as */
+/* GRAY8 or RGB, the filter analyses. Filters fed from the same source */
+/* in the same format share a single conversion. Empty disables it */
+#define FILTER_ANALYSIS_FORMAT_PARAM "analysisFormat"
+/* Optional I32 constructor params with the size frames are scaled to */
+/* before being analysed. Missing ones keep the aspect ratio */
+#define FILTER_ANALYSIS_WIDTH_PARAM "analysisWidth"
+#define FILTER_ANALYSIS_HEIGHT_PARAM "analysisHeight"
+/* Optional String constructor param with the regions of the source */
+/* frames that are analysed, as "x,y,width,height" rectangles separated */
+/* by ';'. Frames are cropped to the rectangle enclosing all of them */
+#define FILTER_ANALYSIS_REGIONS_PARAM "analysisRegions"
+/* Invocation taking the analysis size and regions params above, the */
+/* ones not given are reset. Filters with any of them set output the */
+/* frames they analyse */
+#define FILTER_SET_ANALYSIS_AREA "setAnalysisArea"
+
+/* Optional I32 constructor param with the maximum frames per second the */
+/* filter analyses. Other frames go through without being analysed */
+#define FILTER_ANALYSIS_FPS_PARAM "analysisFps"
+/* Optional I32 constructor param with the frames let through without */
+/* being analysed after each analysed frame */
+#define FILTER_SKIP_FRAMES_PARAM "skipFrames"
+/* Optional I32 constructor param. Non zero lowers the analysis rate */
+/* while analysing takes more than half of the stream time */
+#define FILTER_ADAPTIVE_ANALYSIS_PARAM "adaptiveAnalysis"
+/* Optional I32 constructor param. Non zero lets frames through at once */
+/* and analyses them in a branch with its own streaming thread, so what */
+/* analysers draw is not output. Frames arriving while another one waits */
+/* to be analysed replace it, so the rate adapts by itself */
+#define FILTER_ASYNC_ANALYSIS_PARAM "asyncAnalysis"
+
+/* Invocations returning the I32 count of frames analysed and of frames */
+/* let through without being analysed */
+#define FILTER_GET_PROCESSED_FRAMES "getProcessedFrames"
+#define FILTER_GET_DROPPED_FRAMES "getDroppedFrames"
+/* Invocation returning the I32 milliseconds between the last analysed */
+/* frame being let through and its analysis being finished */
+#define FILTER_GET_ANALYSIS_LAG "getAnalysisLag"
+/* Invocations returning the I32 count of frames let through while no */
+/* handler was subscribed to the filter events, and the milliseconds of */
+/* analysis that saved, estimated from the average analysis time */
+#define FILTER_GET_BYPASSED_FRAMES "getBypassedFrames"
+#define FILTER_GET_BYPASS_SAVED_TIME "getBypassSavedTime"
+
 namespace kurento
 {
 
+/* Rectangle of the source frames, in pixels */
+struct AnalysisRegion {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
 class Filter : public MediaElement
 {
 public:
   Filter (MediaSet &mediaSet, std::shared_ptr<MediaObjectImpl> parent,
           const std::string &filterType,
-          const std::map<std::string, KmsMediaParam>& params);
+          const std::map<std::string, KmsMediaParam>& params,
+          const std::string &analysisFormat = "");
   virtual ~Filter() throw ();
 
+  /* Caps of the frames the filter wants, empty if it takes any */
+  std::string getAnalysisCaps ();
+  /* Returns false if the filter analyses whole frames */
+  bool getAnalysisCrop (AnalysisRegion &_return);
+
+  void invoke (KmsMediaInvocationReturn &_return, const std::string &command,
+               const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+  void unsubscribe (const std::string &callbackToken)
+  throw (KmsMediaServerException);
+
+  /* Only filters whose events someone is subscribed to use the media */
+  bool consumesMedia ();
+
+protected:
+  /* Applies the analysis rate params to the element doing the analysis. */
+  /* Subclasses call it once their filter element has been created */
+  void initAnalysis ();
+
+  /* Frames are only analysed while a handler is subscribed to any of */
+  /* the event types added. Filters without any always analyse them */
+  void addAnalysisEventType (const std::string &eventType);
+  /* Subclasses call it after subscribing handlers to their events */
+  void updateAnalysisBypass ();
+
+  void onDemandChanged (bool demanded);
+
 private:
+  void setAnalysisArea (const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+  void reconnectAnalysis ();
+
+  bool analyseFrame (GstBuffer *buffer);
+  void frameAnalysed ();
+  void scheduleNextAnalysis ();
+  void recordAnalysisCost (GstClockTime cost);
+  void frameBypassed ();
+  bool branchAnalysis (GstElement *filter);
+  void frameQueued (GstBuffer *buffer);
+  void frameReplaced ();
+  void frameDequeued (GstBuffer *buffer);
+
+  std::string analysisFormat;
+
+  Glib::Threads::Mutex areaMutex;
+  int analysisWidth = 0;
+  int analysisHeight = 0;
+  std::list<AnalysisRegion> analysisRegions;
+
+  int analysisFps = 0;
+  int skipFrames = 0;
+  bool adaptiveAnalysis = false;
+  bool asyncAnalysis = false;
+
+  GstPad *analysisSink = NULL;
+  GstPad *analysisSrc = NULL;
+  gulong sinkProbeId = 0;
+  gulong srcProbeId = 0;
+  /* Only used in async mode */
+  GstElement *analysisQueue = NULL;
+  GstPad *queueSink = NULL;
+  gulong startProbeId = 0;
+  gulong overrunId = 0;
+
+  /* Only used from the streaming thread */
+  int framesToSkip = 0;
+  int backoff = 1;
+  GstClockTime nextAnalysis = GST_CLOCK_TIME_NONE;
+  GstClockTime lastAnalysis = GST_CLOCK_TIME_NONE;
+  GstClockTime analysisPeriod = GST_CLOCK_TIME_NONE;
+
+  /* Sequence number of the last frame queued for async analysis */
+  Glib::Threads::Mutex queueMutex;
+  guint queuedFrame = 0;
+  gint64 queuedSince = 0;
+  /* Only used from the streaming thread of the analyser, which in async */
+  /* mode is not the one above */
+  gint64 analysisStart = 0;
+  gint64 dequeuedSince = 0;
+
+  std::atomic<int64_t> processedFrames;
+  std::atomic<int64_t> droppedFrames;
+  std::atomic<int64_t> analysisLag;
+  /* Average time spent analysing a frame, in nanoseconds */
+  std::atomic<int64_t> analysisCost;
+
+  Glib::Threads::Mutex bypassMutex;
+  std::list<std::string> analysisEventTypes;
+  std::atomic<int64_t> bypassedFrames;
+  /* Microseconds */
+  std::atomic<int64_t> bypassSavedTime;
+  std::atomic<bool> analysisBypassed;
+  /* Filters without events stop drawing on frames nobody uses */
+  std::atomic<bool> demandBypassed;
+
   class StaticConstructor
   {
   public:
@@ -37,6 +187,14 @@ private:
   };
 
   static StaticConstructor staticConstructor;
+
+  friend GstPadProbeReturn analysis_sink_probe (GstPad *pad,
+      GstPadProbeInfo *info, gpointer filter);
+  friend GstPadProbeReturn analysis_src_probe (GstPad *pad,
+      GstPadProbeInfo *info, gpointer filter);
+  friend GstPadProbeReturn analysis_start_probe (GstPad *pad,
+      GstPadProbeInfo *info, gpointer filter);
+  friend void analysis_queue_overrun (GstElement *queue, gpointer filter);
 };
 
 } // kurento
@@ -23,6 +23,7 @@
 
 #include "utils/utils.hpp"
 #include "utils/marshalling.hpp"
+#include "common/ElementPool.hpp"
 
 #include "protocol/TBinaryProtocol.h"
 #include "transport/TBufferTransports.h"
@@ -34,6 +35,8 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define DISCONNECTION_TIMEOUT 2 /* seconds */
 #define REGISTER_TIMEOUT 3 /* seconds */
 #define TERMINATE_ON_EOS_DEFAULT false;
+#define BROADCAST_DEFAULT false
+#define SEGMENTED_DEFAULT false
 
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::protocol::TBinaryProtocol;
@@ -62,20 +65,8 @@ action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
                      KmsHttpEndPointAction action, gpointer data)
 {
   HttpEndPoint *httpEp = (HttpEndPoint *) data;
-  std::string uriStr = uri;
-  std::string url = httpEp->getUrl();
 
-  GST_DEBUG ("Action requested URI %s", uriStr.c_str() );
-
-  if (url.size() <= uriStr.size() )
-    return;
-
-  /* Remove the initial "http://host:port" to compare the uri */
-  std::string substr = url.substr (url.size() - uriStr.size(),
-                                   std::string::npos);
-
-  if (substr.compare (uriStr) != 0)
-    return;
+  GST_DEBUG ("Action requested URI %s", uri);
 
   http_end_point_raise_petition_event (httpEp, action);
 }
@@ -121,19 +112,7 @@ getUriFromUrl (std::string url)
 void
 kurento_http_end_point_raise_session_terminated_event (HttpEndPoint *httpEp, const gchar *uri)
 {
-  std::string uriStr = uri;
-
-  if (httpEp->url.size() <= uriStr.size() )
-    return;
-
-  /* Remove the initial "http://host:port" to compare the uri */
-  std::string substr = httpEp->url.substr (httpEp->url.size() - uriStr.size(),
-                       std::string::npos);
-
-  if (substr.compare (uriStr) != 0)
-    return;
-
-  GST_DEBUG ("Session terminated URI %s", uriStr.c_str() );
+  GST_DEBUG ("Session terminated URI %s", uri);
 
   if (!g_atomic_int_compare_and_exchange (& (httpEp->sessionStarted), 1, 0) )
     return;
@@ -156,113 +135,91 @@ url_expired_cb (KmsHttpEPServer *server, const gchar *uri, gpointer data)
       uri);
 }
 
-struct MainLoopData {
-  gpointer data;
-  GSourceFunc func;
-  GDestroyNotify destroy;
-  Glib::Mutex *mutex;
+static const KmsHttpEPServerCallbacks http_end_point_callbacks = {
+  action_requested_cb,
+  url_removed_cb,
+  url_expired_cb
 };
 
-static gboolean
-main_loop_wrapper_func (gpointer data)
+void
+HttpEndPoint::registerEndPoint ()
 {
-  struct MainLoopData *mdata = (struct MainLoopData *) data;
+  KmsHttpEPServerFlags flags = KMS_HTTP_EP_SERVER_FLAG_NONE;
+  std::string uri;
+  const gchar *path;
+  gchar *c_uri;
+  gchar *addr;
+  guint port;
 
-  return mdata->func (mdata->data);
-}
+  if (broadcast)
+    flags = (KmsHttpEPServerFlags) (flags | KMS_HTTP_EP_SERVER_FLAG_BROADCAST);
 
-static void
-main_loop_data_destroy (gpointer data)
-{
-  struct MainLoopData *mdata = (struct MainLoopData *) data;
+  if (segmented)
+    flags = (KmsHttpEPServerFlags) (flags | KMS_HTTP_EP_SERVER_FLAG_SEGMENTED);
 
-  if (mdata->destroy != NULL)
-    mdata->destroy (mdata->data);
+  /* Registration is thread safe, no need to wait for the main loop */
+  path = kms_http_ep_server_register_end_point_full (httpepserver, element,
+         disconnectionTimeout, flags);
 
-  mdata->mutex->unlock();
-  g_slice_free (struct MainLoopData, mdata);
-}
+  if (path == NULL)
+    return;
 
-static void
-operate_in_main_loop_context (GSourceFunc func, gpointer data,
-                              GDestroyNotify destroy)
-{
-  struct MainLoopData *mdata;
-  Glib::Mutex mutex;
-
-  mdata = g_slice_new (struct MainLoopData);
-  mdata->data = data;
-  mdata->func = func;
-  mdata->destroy = destroy;
-  mdata->mutex = &mutex;
-
-  mutex.lock ();
-  g_idle_add_full (G_PRIORITY_HIGH_IDLE, main_loop_wrapper_func, mdata,
-                   main_loop_data_destroy);
-  mutex.lock ();
-}
+  /* Server calls back this end point only for its own url */
+  kms_http_ep_server_set_end_point_callbacks (httpepserver, path,
+      &http_end_point_callbacks, this, NULL);
 
-gboolean
-init_http_end_point (gpointer data)
-{
-  HttpEndPoint *httpEp = (HttpEndPoint *) data;
-  std::string uri;
-  const gchar *url;
-  gchar *c_uri;
-  gchar *addr;
-  guint port;
+  if (coalesceSize >= 0 || coalesceLatency >= 0) {
+    guint size, latency;
 
-  httpEp->actionRequestedHandlerId = g_signal_connect (httpepserver, "action-requested",
-                                     G_CALLBACK (action_requested_cb), httpEp);
-  httpEp->urlRemovedHandlerId = g_signal_connect (httpepserver, "url-removed",
-                                G_CALLBACK (url_removed_cb), httpEp);
-  httpEp->urlExpiredHandlerId = g_signal_connect (httpepserver, "url-expired",
-                                G_CALLBACK (url_expired_cb), httpEp);
+    g_object_get (G_OBJECT (httpepserver), KMS_HTTP_EP_SERVER_COALESCE_SIZE,
+                  &size, KMS_HTTP_EP_SERVER_COALESCE_LATENCY, &latency, NULL);
 
-  url = kms_http_ep_server_register_end_point (httpepserver, httpEp->element,
-        httpEp->disconnectionTimeout);
+    if (coalesceSize >= 0)
+      size = coalesceSize;
 
-  if (url == NULL)
-    return FALSE;
+    if (coalesceLatency >= 0)
+      latency = coalesceLatency;
+
+    kms_http_ep_server_set_end_point_coalescing (httpepserver, path, size,
+        latency);
+  }
 
   g_object_get (G_OBJECT (httpepserver), "announced-address", &addr, "port", &port,
                 NULL);
-  c_uri = g_strdup_printf ("http://%s:%d%s", addr, port, url);
+  c_uri = g_strdup_printf ("http://%s:%d%s", addr, port, path);
   uri = c_uri;
 
   g_free (addr);
   g_free (c_uri);
 
-  httpEp->setUrl (uri);
-  httpEp->urlSet = true;
-
-  return FALSE;
+  setUrl (uri);
+  urlSet = true;
 }
 
-gboolean
-dispose_http_end_point (gpointer data)
+void
+HttpEndPoint::unregisterEndPoint ()
 {
-  HttpEndPoint *httpEp = (HttpEndPoint *) data;
-
-  g_signal_handler_disconnect (httpepserver, httpEp->actionRequestedHandlerId);
-  g_signal_handler_disconnect (httpepserver, httpEp->urlExpiredHandlerId);
-  g_signal_handler_disconnect (httpepserver, httpEp->urlRemovedHandlerId);
+  if (!urlSet)
+    return;
 
-  std::string uri = getUriFromUrl (httpEp->url);
+  std::string uri = getUriFromUrl (url);
 
-  if (!uri.empty() )
-    kms_http_ep_server_unregister_end_point (httpepserver, uri.c_str() );
+  if (uri.empty() )
+    return;
 
-  return FALSE;
+  /* No callback will be running once they are cleared */
+  kms_http_ep_server_set_end_point_callbacks (httpepserver, uri.c_str(), NULL,
+      NULL, NULL);
+  kms_http_ep_server_unregister_end_point (httpepserver, uri.c_str() );
 }
 
 void
 HttpEndPoint::init (std::shared_ptr<MediaPipeline> parent,
                     guint disconnectionTimeout, bool terminateOnEOS,
-                    KmsMediaProfile profile)
+                    KmsMediaProfile profile, bool broadcast, bool segmented)
 throw (KmsMediaServerException)
 {
-  element = gst_element_factory_make ("httpendpoint", NULL);
+  element = ElementPool::getInstance ().acquire ("httpendpoint");
 
   g_object_set ( G_OBJECT (element), "accept-eos", terminateOnEOS, NULL);
 
@@ -281,12 +238,13 @@ throw (KmsMediaServerException)
   }
 
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 
   this->disconnectionTimeout = disconnectionTimeout;
+  this->broadcast = broadcast;
+  this->segmented = segmented;
 
-  operate_in_main_loop_context (init_http_end_point, this, NULL);
+  registerEndPoint ();
 
   if (!urlSet) {
     KmsMediaServerException except;
@@ -330,6 +288,9 @@ throw (KmsMediaServerException)
   KmsMediaHttpEndPointConstructorParams httpEpParams;
   guint disconnectionTimeout = DISCONNECTION_TIMEOUT;
   bool terminateOnEOS = TERMINATE_ON_EOS_DEFAULT;
+  bool broadcast = BROADCAST_DEFAULT;
+  bool segmented = SEGMENTED_DEFAULT;
+  bool profileSet = false;
   KmsMediaProfile profile;
 
   profile.mediaMuxer = KmsMediaMuxer::WEBM;
@@ -346,16 +307,51 @@ throw (KmsMediaServerException)
     if (httpEpParams.__isset.terminateOnEOS)
       terminateOnEOS = httpEpParams.terminateOnEOS;
 
-    if (httpEpParams.__isset.profileType)
+    if (httpEpParams.__isset.profileType) {
       profile = httpEpParams.profileType;
+      profileSet = true;
+    }
   }
 
-  init (parent, disconnectionTimeout, terminateOnEOS, profile);
+  p = getParam (params, HTTP_END_POINT_BROADCAST_PARAM);
+
+  if (p != NULL)
+    broadcast = unmarshalI32Param (*p) != 0;
+
+  p = getParam (params, HTTP_END_POINT_SEGMENTED_PARAM);
+
+  if (p != NULL)
+    segmented = unmarshalI32Param (*p) != 0;
+
+  /* HLS clients can only play MP4 segments */
+  if (segmented && !profileSet) {
+    profile.mediaMuxer = KmsMediaMuxer::MP4;
+  } else if (segmented && profile.mediaMuxer != KmsMediaMuxer::MP4) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                   "Segmented HttpEndPoints need the MP4 profile");
+    throw except;
+  }
+
+  p = getParam (params, HTTP_END_POINT_COALESCE_SIZE_PARAM);
+
+  if (p != NULL)
+    coalesceSize = MAX (unmarshalI32Param (*p), 0);
+
+  p = getParam (params, HTTP_END_POINT_COALESCE_LATENCY_PARAM);
+
+  if (p != NULL)
+    coalesceLatency = MAX (unmarshalI32Param (*p), 0);
+
+  init (parent, disconnectionTimeout, terminateOnEOS, profile, broadcast,
+        segmented);
 }
 
 HttpEndPoint::~HttpEndPoint() throw ()
 {
-  operate_in_main_loop_context (dispose_http_end_point, this, NULL);
+  unregisterEndPoint ();
 
   gst_bin_remove (GST_BIN ( (
                               (std::shared_ptr<MediaPipeline> &) parent)->pipeline), element);
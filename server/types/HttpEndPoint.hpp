@@ -20,6 +20,19 @@
 #include "httpendpointserver.hpp"
 #include "KmsMediaProfile_types.h"
 
+/* Optional I32 constructor param. When not zero every GET request to the */
+/* end point URL receives the same stream instead of a single session */
+#define HTTP_END_POINT_BROADCAST_PARAM "broadcast"
+/* Optional I32 constructor param. When not zero the end point URL is an */
+/* HLS playlist whose segments are served from the HttpEPServer cache. */
+/* Segments are fragmented MP4, other profiles are rejected */
+#define HTTP_END_POINT_SEGMENTED_PARAM "segmented"
+/* Optional I32 constructor params. Bytes and milliseconds media may be */
+/* held back to be written in bigger chunks. Zero writes every sample, */
+/* which is the default unless kurento.conf sets other values */
+#define HTTP_END_POINT_COALESCE_SIZE_PARAM "coalesceSize"
+#define HTTP_END_POINT_COALESCE_LATENCY_PARAM "coalesceLatency"
+
 namespace kurento
 {
 
@@ -42,12 +55,20 @@ private:
   std::string url;
   bool urlSet = false;
   guint disconnectionTimeout;
+  bool broadcast = false;
+  bool segmented = false;
+  /* Negative values keep the HttpEPServer defaults */
+  gint coalesceSize = -1;
+  gint coalesceLatency = -1;
 
   void setUrl (const std::string &);
+  void registerEndPoint ();
+  void unregisterEndPoint ();
 
 private:
   void init (std::shared_ptr<MediaPipeline> parent, guint disconnectionTimeout,
-    bool terminateOnEOS, KmsMediaProfile profile)
+    bool terminateOnEOS, KmsMediaProfile profile, bool broadcast,
+    bool segmented)
 throw (KmsMediaServerException);
 
   class StaticConstructor
@@ -57,15 +78,8 @@ throw (KmsMediaServerException);
   };
 
   static StaticConstructor staticConstructor;
-  gulong actionRequestedHandlerId;
-  gulong urlRemovedHandlerId;
-  gulong urlExpiredHandlerId;
   gint sessionStarted = 0;
 
-  /* Functions that operate in main loop context */
-  friend gboolean dispose_http_end_point (gpointer data);
-  friend gboolean init_http_end_point (gpointer data);
-
   friend void http_end_point_raise_petition_event (HttpEndPoint *httpEp, KmsHttpEndPointAction action);
   friend void kurento_http_end_point_raise_session_terminated_event (HttpEndPoint *httpEp, const gchar *uri);
   friend void kurento_http_end_point_eos_detected_cb (GstElement *element, gpointer data);
@@ -18,6 +18,7 @@
 #include "KmsMediaJackVaderFilterType_constants.h"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "KmsMediaErrorCodes_constants.h"
 
 #define GST_CAT_DEFAULT kurento_jack_vader_filter
@@ -30,11 +31,11 @@ namespace kurento
 void
 JackVaderFilter::init (std::shared_ptr<MediaPipeline> parent)
 {
-  element = gst_element_factory_make ("filterelement", NULL);
+  element = MediaElementRegistry::getInstance ().makeElement ("filterelement");
   g_object_set (element, "filter-factory", "jackvader", NULL);
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
+  initAnalysis ();
 }
 
 JackVaderFilter::JackVaderFilter (MediaSet &mediaSet,
@@ -29,16 +29,139 @@ MediaElement::MediaElement (MediaSet &mediaSet,
                             const std::string &elementType,
                             const std::map<std::string, KmsMediaParam> &params)
   : MediaObjectParent (mediaSet, parent, params),
-    KmsMediaElement()
+    KmsMediaElement(), audioEnabled (true), videoEnabled (true),
+    demanded (true)
 {
+  const KmsMediaParam *p;
+
   this->elementType = elementType;
   this->objectType.__set_element (*this);
+
+  p = getParam (params, MEDIA_ELEMENT_MEDIA_TYPES_PARAM);
+
+  if (p != NULL) {
+    std::string mediaTypes;
+    gchar **types;
+
+    unmarshalStringParam (mediaTypes, *p);
+    types = g_strsplit (mediaTypes.c_str(), ";", -1);
+    audioEnabled = videoEnabled = false;
+
+    for (gchar **type = types; *type != NULL; type++) {
+      g_strstrip (*type);
+
+      if (g_strcmp0 (*type, MEDIA_ELEMENT_MEDIA_TYPE_AUDIO) == 0) {
+        audioEnabled = true;
+      } else if (g_strcmp0 (*type, MEDIA_ELEMENT_MEDIA_TYPE_VIDEO) == 0) {
+        videoEnabled = true;
+      } else if (**type != '\0') {
+        KmsMediaServerException except;
+        std::string unknown = *type;
+
+        g_strfreev (types);
+        createKmsMediaServerException (except,
+                                       g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                       "Unknown media type " + unknown);
+        throw except;
+      }
+    }
+
+    g_strfreev (types);
+
+    if (!audioEnabled && !videoEnabled) {
+      KmsMediaServerException except;
+
+      createKmsMediaServerException (except,
+                                     g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                     "Elements need at least one media type");
+      throw except;
+    }
+  }
 }
 
 MediaElement::~MediaElement () throw ()
 {
 }
 
+gboolean
+update_demand (gpointer data)
+{
+  std::weak_ptr<MediaElement> *element = (std::weak_ptr<MediaElement> *) data;
+  std::shared_ptr<MediaElement> locked = element->lock();
+
+  if (locked != NULL)
+    locked->updateDemand ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+delete_element_ref (gpointer data)
+{
+  delete (std::weak_ptr<MediaElement> *) data;
+}
+
+void
+MediaElement::scheduleDemandUpdate ()
+{
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, update_demand,
+                   new std::weak_ptr<MediaElement> (shared_from_this() ),
+                   delete_element_ref);
+}
+
+void
+MediaElement::scheduleUpstreamDemandUpdate ()
+{
+  std::shared_ptr<MediaSink> sinks[2];
+
+  /* Pads of disabled media types are never created, so they are NULL */
+  mutex.lock();
+  sinks[0] = audioMediaSink.lock();
+  sinks[1] = videoMediaSink.lock();
+  mutex.unlock();
+
+  for (int i = 0; i < 2; i++) {
+    std::shared_ptr<MediaSrc> src;
+
+    if (sinks[i] == NULL)
+      continue;
+
+    src = sinks[i]->getConnectedSrc ();
+
+    if (src != NULL)
+      src->getMediaElement ()->scheduleDemandUpdate ();
+  }
+}
+
+void
+MediaElement::updateDemand ()
+{
+  std::shared_ptr<MediaSrc> srcs[2];
+  bool demand = false;
+
+  mutex.lock();
+  srcs[0] = audioMediaSrc.lock();
+  srcs[1] = videoMediaSrc.lock();
+  mutex.unlock();
+
+  for (int i = 0; i < 2; i++) {
+    if (srcs[i] != NULL && srcs[i]->hasDemand () )
+      demand = true;
+  }
+
+  if (demand == demanded)
+    return;
+
+  GST_DEBUG ("Element %" G_GINT64_FORMAT " %s demanded", id,
+             demand ? "is" : "is no longer");
+  demanded = demand;
+  onDemandChanged (demand);
+
+  /* Elements that consume media keep demanding it anyway */
+  if (!consumesMedia () )
+    scheduleUpstreamDemandUpdate ();
+}
+
 std::shared_ptr<MediaSrc>
 MediaElement::getOrCreateAudioMediaSrc()
 {
@@ -131,18 +254,35 @@ MediaElement::getOrCreateVideoMediaSink()
   return locked;
 }
 
+bool
+MediaElement::hasMediaType (const KmsMediaType::type mediaType)
+{
+  if (mediaType == KmsMediaType::type::AUDIO)
+    return audioEnabled;
+  else if (mediaType == KmsMediaType::type::VIDEO)
+    return videoEnabled;
+
+  return false;
+}
+
 void
 MediaElement::getMediaSrcs (std::vector < std::shared_ptr<MediaSrc> > &_return)
 {
-  _return.push_back (getOrCreateAudioMediaSrc() );
-  _return.push_back (getOrCreateVideoMediaSrc() );
+  if (audioEnabled)
+    _return.push_back (getOrCreateAudioMediaSrc() );
+
+  if (videoEnabled)
+    _return.push_back (getOrCreateVideoMediaSrc() );
 }
 
 void
 MediaElement::getMediaSinks (std::vector < std::shared_ptr<MediaSink> > &_return)
 {
-  _return.push_back (getOrCreateAudioMediaSink() );
-  _return.push_back (getOrCreateVideoMediaSink() );
+  if (audioEnabled)
+    _return.push_back (getOrCreateAudioMediaSink() );
+
+  if (videoEnabled)
+    _return.push_back (getOrCreateVideoMediaSink() );
 }
 
 void
@@ -150,6 +290,9 @@ MediaElement::getMediaSrcsByMediaType (
   std::vector < std::shared_ptr<MediaSrc> > &_return,
   const KmsMediaType::type mediaType)
 {
+  if (!hasMediaType (mediaType) )
+    return;
+
   if (mediaType == KmsMediaType::type::AUDIO)
     _return.push_back (getOrCreateAudioMediaSrc() );
   else if (mediaType == KmsMediaType::type::VIDEO)
@@ -161,6 +304,9 @@ MediaElement::getMediaSinksByMediaType (
   std::vector < std::shared_ptr<MediaSink> > &_return,
   const KmsMediaType::type mediaType)
 {
+  if (!hasMediaType (mediaType) )
+    return;
+
   if (mediaType == KmsMediaType::type::AUDIO)
     _return.push_back (getOrCreateAudioMediaSink() );
   else if (mediaType == KmsMediaType::type::VIDEO)
@@ -171,19 +317,41 @@ void
 MediaElement::connect (std::shared_ptr<MediaElement> sink)
 throw (KmsMediaServerException)
 {
-  std::shared_ptr<MediaSrc> audio_src = getOrCreateAudioMediaSrc();
-  std::shared_ptr<MediaSink> audio_sink = sink->getOrCreateAudioMediaSink();
+  bool audio = hasMediaType (KmsMediaType::AUDIO) &&
+               sink->hasMediaType (KmsMediaType::AUDIO);
+  bool video = hasMediaType (KmsMediaType::VIDEO) &&
+               sink->hasMediaType (KmsMediaType::VIDEO);
+  std::shared_ptr<MediaSrc> audio_src;
+  std::shared_ptr<MediaSink> audio_sink;
+
+  if (!audio && !video) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.UNSUPPORTED_MEDIA_TYPE,
+                                   "Elements do not have any media type in common");
+    throw except;
+  }
+
+  /* Only the media types both elements have are connected */
+  if (audio) {
+    audio_src = getOrCreateAudioMediaSrc();
+    audio_sink = sink->getOrCreateAudioMediaSink();
+    audio_src->connect (audio_sink);
+  }
+
+  if (!video)
+    return;
 
   std::shared_ptr<MediaSrc> video_src = getOrCreateVideoMediaSrc();
   std::shared_ptr<MediaSink> video_sink = sink->getOrCreateVideoMediaSink();
 
-  audio_src->connect (audio_sink);
-
   try {
     video_src->connect (video_sink);
   } catch (...) {
     try {
-      audio_src->disconnect (audio_sink);
+      if (audio)
+        audio_src->disconnect (audio_sink);
     } catch (...) {
     }
 
@@ -199,6 +367,16 @@ throw (KmsMediaServerException)
   std::shared_ptr<MediaSrc> mediaSrc;
   std::shared_ptr<MediaSink> mediaSink;
 
+  if ( (mediaType == KmsMediaType::AUDIO || mediaType == KmsMediaType::VIDEO)
+       && (!hasMediaType (mediaType) || !sink->hasMediaType (mediaType) ) ) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.UNSUPPORTED_MEDIA_TYPE,
+                                   "Media type not enabled in both elements");
+    throw except;
+  }
+
   if (mediaType == KmsMediaType::AUDIO) {
     mediaSrc = getOrCreateAudioMediaSrc();
     mediaSink = sink->getOrCreateAudioMediaSink();
@@ -21,6 +21,14 @@
 #include "MediaSink.hpp"
 
 #include <glibmm.h>
+#include <atomic>
+
+/* Optional String constructor param of every element. Media types, */
+/* separated by ';', the element has pads for. Pads and connections of */
+/* other types are never created. All of them by default */
+#define MEDIA_ELEMENT_MEDIA_TYPES_PARAM "mediaTypes"
+#define MEDIA_ELEMENT_MEDIA_TYPE_AUDIO "audio"
+#define MEDIA_ELEMENT_MEDIA_TYPE_VIDEO "video"
 
 namespace kurento
 {
@@ -43,9 +51,31 @@ public:
   void connect (std::shared_ptr<MediaElement> sink) throw (KmsMediaServerException);
   void connect (std::shared_ptr<MediaElement> sink, const KmsMediaType::type mediaType) throw (KmsMediaServerException);
 
+  bool hasMediaType (const KmsMediaType::type mediaType);
+
+  /* Elements are demanded until everything connected after them either */
+  /* goes away or is not demanded either */
+  bool isDemanded () {
+    return demanded;
+  }
+
+  /* Whether media reaching the element is used even if nothing is */
+  /* connected after it. Elements only transforming media return false */
+  virtual bool consumesMedia () {
+    return true;
+  }
+
+  /* Demand is updated from the main loop, one element after another */
+  void scheduleDemandUpdate ();
+
 protected:
   GstElement *element;
 
+  /* Called from the main loop when the element stops or starts being */
+  /* demanded. Sources can stop producing media meanwhile */
+  virtual void onDemandChanged (bool demanded) {};
+  void scheduleUpstreamDemandUpdate ();
+
 private:
   std::weak_ptr<MediaSrc> audioMediaSrc;
   std::weak_ptr<MediaSrc> videoMediaSrc;
@@ -57,8 +87,15 @@ private:
   std::shared_ptr<MediaSink> getOrCreateAudioMediaSink();
   std::shared_ptr<MediaSink> getOrCreateVideoMediaSink();
 
+  bool audioEnabled;
+  bool videoEnabled;
+
   Glib::RecMutex mutex;
 
+  std::atomic<bool> demanded;
+
+  void updateDemand ();
+
   class StaticConstructor
   {
   public:
@@ -68,6 +105,7 @@ private:
   static StaticConstructor staticConstructor;
 
   friend class MediaPad;
+  friend gboolean update_demand (gpointer data);
 };
 
 } // kurento
@@ -23,6 +23,7 @@
 
 #include <gst/gst.h>
 #include "utils/utils.hpp"
+#include "common/Metrics.hpp"
 
 #define GST_CAT_DEFAULT kurento_media_handler
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -107,6 +108,7 @@ send_to_client (gpointer data, gpointer user_data)
                  mh->callbackToken.c_str (), mh->address.c_str (), mh->port);
   }
 
+  metrics::eventQueueDepth.dec ();
   g_slice_free (SendData, data);
 }
 
@@ -117,6 +119,10 @@ MediaHandlerManager::MediaHandlerManager ()
 
 MediaHandlerManager::~MediaHandlerManager ()
 {
+  /* Stop taking queued events, so the ones left are never sent and */
+  /* have to be taken out of the queue depth here */
+  g_thread_pool_set_max_threads (threadPool, 0, NULL);
+  metrics::eventQueueDepth.add (- (int64_t) g_thread_pool_unprocessed (threadPool) );
   g_thread_pool_free (threadPool, TRUE, FALSE);
 }
 
@@ -207,6 +213,7 @@ MediaHandlerManager::sendEvent (std::shared_ptr<KmsMediaEvent> event)
     data->mediaHandler = *mediaHandlerIt;
     data->is_error = false;
     data->event = event;
+    metrics::eventQueueDepth.inc ();
     g_thread_pool_push (threadPool, data, NULL);
   }
 }
@@ -249,6 +256,7 @@ MediaHandlerManager::sendError (std::shared_ptr<KmsMediaError> error)
     data->mediaHandler = it->second;
     data->is_error = true;
     data->error = error;
+    metrics::eventQueueDepth.inc ();
     g_thread_pool_push (threadPool, data, NULL);
   }
 
@@ -16,33 +16,33 @@
 #include "MediaPipeline.hpp"
 
 #include "utils/utils.hpp"
+#include "common/ElementPool.hpp"
+#include "common/MediaElementRegistry.hpp"
+#include "common/PipelineTemplates.hpp"
+#include "common/Metrics.hpp"
+#include "utils/marshalling.hpp"
+#include "MediaElement.hpp"
 #include "KmsMediaDataType_constants.h"
 #include "KmsMediaErrorCodes_constants.h"
 
-#include "KmsMediaPlayerEndPointType_constants.h"
-#include "PlayerEndPoint.hpp"
-#include "KmsMediaRecorderEndPointType_constants.h"
-#include "RecorderEndPoint.hpp"
-#include "KmsMediaRtpEndPointType_constants.h"
-#include "RtpEndPoint.hpp"
-#include "KmsMediaHttpEndPointType_constants.h"
-#include "HttpEndPoint.hpp"
-#include "KmsMediaZBarFilterType_constants.h"
-#include "ZBarFilter.hpp"
-#include "KmsMediaJackVaderFilterType_constants.h"
-#include "JackVaderFilter.hpp"
-#include "KmsMediaPointerDetectorFilterType_constants.h"
-#include "PointerDetectorFilter.hpp"
-#include "KmsMediaWebRtcEndPointType_constants.h"
-#include "WebRtcEndPoint.hpp"
-#include "KmsMediaPlateDetectorFilterType_constants.h"
-#include "PlateDetectorFilter.hpp"
 #include "KmsMediaErrorCodes_constants.h"
 
 #define GST_CAT_DEFAULT kurento_media_pipeline
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaPipeline"
 
+/* Jitter buffer milliseconds of each latency mode */
+#define LOW_LATENCY_JITTER_BUFFER 50
+#define BALANCED_JITTER_BUFFER 100
+
+/* Microseconds getLatency waits for media to reach a sink */
+#define LATENCY_MEASURE_TIMEOUT (300 * G_TIME_SPAN_MILLISECOND)
+/* Buffers measured by getLatency, at most that many per sink */
+#define LATENCY_SAMPLES 8
+
+/* Milliseconds resume waits for the pipeline to play by default */
+#define DEFAULT_RESUME_TIMEOUT 1000
+
 namespace kurento
 {
 
@@ -65,6 +65,13 @@ media_pipeline_receive_message (GstBus *bus, GstMessage *message, gpointer data)
     break;
   }
 
+  case GST_MESSAGE_LATENCY:
+    /* Some element changed its latency, distribute the new one */
+    gst_bin_recalculate_latency (GST_BIN (m->pipeline) );
+    GST_DEBUG ("Pipeline configured latency is %" G_GINT64_FORMAT " ms",
+               m->getConfiguredLatency () / GST_MSECOND);
+    break;
+
   default:
     break;
   }
@@ -75,9 +82,8 @@ MediaPipeline::init ()
 {
   GstBus *bus;
 
-  pipeline = gst_pipeline_new (NULL);
-  g_object_set (G_OBJECT (pipeline), "async-handling", TRUE, NULL);
-  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  /* Pipelines are already playing, either new or taken from the pool */
+  pipeline = ElementPool::getInstance ().acquire (ELEMENT_POOL_PIPELINE);
 
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
   gst_bus_add_signal_watch (bus);
@@ -93,6 +99,7 @@ throw (KmsMediaServerException)
   : MediaObjectParent (mediaSet, params),
     KmsMediaPipeline ()
 {
+  setLatencyMode (params);
   init ();
 }
 
@@ -100,9 +107,16 @@ MediaPipeline::~MediaPipeline() throw()
 {
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
   gst_bus_remove_signal_watch (bus);
+  g_signal_handlers_disconnect_by_data (bus, this);
   g_object_unref (bus);
-  gst_element_set_state (pipeline, GST_STATE_NULL);
-  g_object_unref (pipeline);
+
+  /* Suspended pipelines are not playing, so they are not recycled */
+  if (suspended)
+    metrics::suspendedPipelines.dec ();
+
+  unlockSuspendedElements ();
+
+  ElementPool::getInstance ().releasePipeline (pipeline);
 }
 
 std::shared_ptr<MediaElement>
@@ -111,44 +125,654 @@ throw (KmsMediaServerException)
 {
   std::shared_ptr<MediaElement> element;
 
-  if (g_KmsMediaPlayerEndPointType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<PlayerEndPoint> (new PlayerEndPoint (
-                getMediaSet(), shared_from_this (), params) );
-  } else if (g_KmsMediaRecorderEndPointType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<RecorderEndPoint> (new RecorderEndPoint (
-                getMediaSet(), shared_from_this (), params) );
-  } else if (g_KmsMediaRtpEndPointType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<RtpEndPoint> (new RtpEndPoint (getMediaSet(),
-                                            shared_from_this (), params) );
-  } else if (g_KmsMediaHttpEndPointType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<HttpEndPoint> (new HttpEndPoint (getMediaSet(),
-              shared_from_this (), params) );
-  } else if (g_KmsMediaZBarFilterType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<ZBarFilter> (new ZBarFilter (getMediaSet(),
-                                           shared_from_this (), params) );
-  } else if (g_KmsMediaJackVaderFilterType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<JackVaderFilter> (new JackVaderFilter (
-                getMediaSet(), shared_from_this (), params) );
-  } else if (g_KmsMediaPointerDetectorFilterType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<PointerDetectorFilter> (new PointerDetectorFilter (
-                getMediaSet(), shared_from_this (), params) );
-  } else if (g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<PlateDetectorFilter> (new PlateDetectorFilter (
-                getMediaSet(), shared_from_this (), params) );
-  } else if (g_KmsMediaWebRtcEndPointType_constants.TYPE_NAME.compare (elementType) == 0) {
-    element = std::shared_ptr<WebRtcEndPoint> (new WebRtcEndPoint (
-                getMediaSet(), shared_from_this (), params) );
-  } else {
+  element = MediaElementRegistry::getInstance ().create (elementType,
+            getMediaSet(), shared_from_this (), params);
+
+  registerChild (element);
+  return element;
+}
+
+void
+MediaPipeline::setLatencyMode (const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  const KmsMediaParam *p;
+  std::string mode;
+
+  p = getParam (params, MEDIA_PIPELINE_LATENCY_MODE_PARAM);
+
+  if (p != NULL) {
+    unmarshalStringParam (mode, *p);
+
+    if (mode == MEDIA_PIPELINE_LATENCY_MODE_LOW) {
+      jitterBufferLatency = LOW_LATENCY_JITTER_BUFFER;
+      dropOnLatency = true;
+      leakyAnalysis = true;
+    } else if (mode == MEDIA_PIPELINE_LATENCY_MODE_BALANCED) {
+      jitterBufferLatency = BALANCED_JITTER_BUFFER;
+      leakyAnalysis = true;
+    } else if (mode != MEDIA_PIPELINE_LATENCY_MODE_THROUGHPUT) {
+      KmsMediaServerException except;
+
+      createKmsMediaServerException (except,
+                                     g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                     "Unknown latency mode " + mode);
+      throw except;
+    }
+  }
+
+  p = getParam (params, MEDIA_PIPELINE_LATENCY_BUDGET_PARAM);
+
+  if (p != NULL)
+    jitterBufferLatency = MAX (unmarshalI32Param (*p), 0);
+}
+
+static const gchar *
+get_factory_name (GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  return factory != NULL ? GST_OBJECT_NAME (factory) : NULL;
+}
+
+void
+MediaPipeline::applyLatencyMode (GstElement *element)
+{
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  bool analysis, done = false;
+
+  if ( (jitterBufferLatency < 0 && !leakyAnalysis) || !GST_IS_BIN (element) )
+    return;
+
+  analysis = g_strcmp0 (get_factory_name (element), "filterelement") == 0;
+  it = gst_bin_iterate_recurse (GST_BIN (element) );
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *child = GST_ELEMENT (g_value_get_object (&item) );
+      const gchar *name = get_factory_name (child);
+
+      if (jitterBufferLatency >= 0 && g_strcmp0 (name, "rtpbin") == 0) {
+        g_object_set (child, "latency", (guint) jitterBufferLatency,
+                      "drop-on-latency", (gboolean) dropOnLatency, NULL);
+      } else if (leakyAnalysis && analysis && g_strcmp0 (name, "queue") == 0) {
+        /* Analysing old frames is useless, only the newest one is kept */
+        g_object_set (child, "leaky", 2 /* downstream */, "max-size-buffers", 1,
+                      "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+      }
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      break;
+
+    default:
+      done = true;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+gint64
+MediaPipeline::getConfiguredLatency ()
+{
+  GstClockTime latency = 0;
+  GstQuery *query;
+  gboolean live;
+
+  query = gst_query_new_latency ();
+
+  if (gst_element_query (pipeline, query) )
+    gst_query_parse_latency (query, &live, &latency, NULL);
+
+  gst_query_unref (query);
+
+  return latency;
+}
+
+/* Latency measured for one getLatency request, shared with the probes */
+/* it installs so that it outlives any of them */
+struct LatencySample {
+  Glib::Threads::Mutex mutex;
+  Glib::Threads::Cond cond;
+  /* Smoothed latency seen at the sinks in ns, negative until measured */
+  gint64 latency = -1;
+  guint count = 0;
+};
+
+struct LatencyProbe {
+  std::shared_ptr<LatencySample> sample;
+  guint remaining;
+};
+
+static void
+latency_probe_free (gpointer data)
+{
+  delete (LatencyProbe *) data;
+}
+
+/* A buffer is late at a sink by the running time elapsed since it was */
+/* timestamped. That is the time spent inside the pipeline since it was */
+/* captured or received, not the glass to glass latency of the media */
+static GstPadProbeReturn
+measure_latency_probe (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  LatencyProbe *probe = (LatencyProbe *) data;
+  LatencySample *sample = probe->sample.get ();
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime running_time, now;
+  GstElement *sink;
+  GstEvent *event;
+  GstSegment segment;
+  GstClock *clock;
+  gint64 latency;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer) )
+    return GST_PAD_PROBE_OK;
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+
+  if (event == NULL)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_copy_segment (event, &segment);
+  gst_event_unref (event);
+
+  if (segment.format != GST_FORMAT_TIME)
+    return GST_PAD_PROBE_OK;
+
+  running_time = gst_segment_to_running_time (&segment, GST_FORMAT_TIME,
+                 GST_BUFFER_PTS (buffer) );
+  sink = gst_pad_get_parent_element (pad);
+
+  if (sink == NULL)
+    return GST_PAD_PROBE_OK;
+
+  clock = gst_element_get_clock (sink);
+
+  if (clock == NULL || !GST_CLOCK_TIME_IS_VALID (running_time) ) {
+    if (clock != NULL)
+      gst_object_unref (clock);
+
+    gst_object_unref (sink);
+    return GST_PAD_PROBE_OK;
+  }
+
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (sink);
+  gst_object_unref (clock);
+  gst_object_unref (sink);
+
+  latency = now > running_time ? now - running_time : 0;
+
+  sample->mutex.lock ();
+
+  /* Smoothed over the buffers of every sink seen by this request */
+  if (sample->latency < 0)
+    sample->latency = latency;
+  else
+    sample->latency += (latency - sample->latency) / LATENCY_SAMPLES;
+
+  sample->count++;
+  sample->cond.broadcast ();
+  sample->mutex.unlock ();
+
+  if (--probe->remaining == 0)
+    return GST_PAD_PROBE_REMOVE;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Sinks are created by end points as they negotiate, so they are looked */
+/* up every time the latency is asked for */
+static void
+watch_sinks (GstElement *pipeline, std::shared_ptr<LatencySample> sample,
+             std::list<std::pair<GstPad *, gulong>> &probes)
+{
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  bool done = false;
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline) );
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *child = GST_ELEMENT (g_value_get_object (&item) );
+      LatencyProbe *probe;
+      GstPad *sink;
+      gulong id;
+
+      if (!GST_IS_BIN (child) &&
+          GST_OBJECT_FLAG_IS_SET (child, GST_ELEMENT_FLAG_SINK) ) {
+        sink = gst_element_get_static_pad (child, "sink");
+
+        if (sink != NULL) {
+          probe = new LatencyProbe ();
+          probe->sample = sample;
+          probe->remaining = LATENCY_SAMPLES;
+          id = gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_BUFFER,
+                                  measure_latency_probe, probe,
+                                  latency_probe_free);
+          probes.push_back (std::pair<GstPad *, gulong> (sink, id) );
+        }
+      }
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      break;
+
+    default:
+      done = true;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+gint64
+MediaPipeline::getLatency ()
+{
+  gint64 end_time = g_get_monotonic_time () + LATENCY_MEASURE_TIMEOUT;
+  std::shared_ptr<LatencySample> sample (new LatencySample () );
+  std::list<std::pair<GstPad *, gulong>> probes;
+  gint64 latency;
+
+  watch_sinks (pipeline, sample, probes);
+
+  sample->mutex.lock ();
+
+  while (sample->count < LATENCY_SAMPLES) {
+    if (!sample->cond.wait_until (sample->mutex, end_time) )
+      break;
+  }
+
+  latency = sample->latency;
+  sample->mutex.unlock ();
+
+  /* Probes that already took their buffers are gone, this is a no-op */
+  for (auto it = probes.begin(); it != probes.end(); it++) {
+    gst_pad_remove_probe (it->first, it->second);
+    g_object_unref (it->first);
+  }
+
+  return latency;
+}
+
+static const gchar *
+element_factory_name (GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (factory == NULL)
+    return NULL;
+
+  return gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory) );
+}
+
+/* Finished recordings would be truncated and HTTP muxers would start a */
+/* new stream, so these sinks keep their state while the rest is */
+/* suspended */
+static bool
+holds_sink_state (GstElement *element)
+{
+  const gchar *name = element_factory_name (element);
+
+  return g_strcmp0 (name, "recorderendpoint") == 0 ||
+         g_strcmp0 (name, "httpendpoint") == 0;
+}
+
+/* Going to READY loses the position of players not stopped. Recorders */
+/* not stopped would get running times starting again from zero on */
+/* resume, while their muxer keeps the old base time */
+static bool
+holds_play_state (GstElement *element)
+{
+  const gchar *name = element_factory_name (element);
+  gint state = 0;
+
+  if (g_strcmp0 (name, "playerendpoint") != 0 &&
+      g_strcmp0 (name, "recorderendpoint") != 0)
+    return false;
+
+  g_object_get (G_OBJECT (element), "state", &state, NULL);
+
+  return state != 0 /* stop */;
+}
+
+void
+MediaPipeline::unlockSuspendedElements ()
+{
+  while (!lockedElements.empty () ) {
+    GstElement *element = lockedElements.front ();
+
+    lockedElements.pop_front ();
+    gst_element_set_locked_state (element, FALSE);
+    g_object_unref (element);
+  }
+}
+
+void
+MediaPipeline::suspend () throw (KmsMediaServerException)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  bool done = false, playing = false;
+
+  suspendMutex.lock();
+
+  if (suspended) {
+    suspendMutex.unlock();
+    return;
+  }
+
+  it = gst_bin_iterate_elements (GST_BIN (pipeline) );
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *element = GST_ELEMENT (g_value_get_object (&item) );
+
+      if (holds_play_state (element) ) {
+        playing = true;
+      } else if (holds_sink_state (element) ) {
+        gst_element_set_locked_state (element, TRUE);
+        lockedElements.push_back (GST_ELEMENT (g_object_ref (element) ) );
+      }
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      unlockSuspendedElements ();
+      playing = false;
+      gst_iterator_resync (it);
+      break;
+
+    default:
+      done = true;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  if (playing) {
     KmsMediaServerException except;
 
-    createKmsMediaServerException (except,
-                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_TYPE_NOT_FOUND,
-                                   "There is not any media object type " + elementType);
+    unlockSuspendedElements ();
+    suspendMutex.unlock();
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   "Players and recorders must be stopped before suspending the pipeline");
     throw except;
   }
 
-  registerChild (element);
-  return element;
+  /* Going down to READY stops streaming threads, deactivates buffer */
+  /* pools and closes encoders, while sockets, pads and links remain */
+  if (gst_element_set_state (pipeline, GST_STATE_READY) ==
+      GST_STATE_CHANGE_FAILURE) {
+    KmsMediaServerException except;
+
+    unlockSuspendedElements ();
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+    suspendMutex.unlock();
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   "Pipeline could not be suspended");
+    throw except;
+  }
+
+  suspended = true;
+  metrics::suspendedPipelines.inc ();
+
+  suspendMutex.unlock();
+
+  GST_DEBUG ("Pipeline %" G_GINT64_FORMAT " suspended", id);
+}
+
+gint64
+MediaPipeline::resume (gint64 timeout) throw (KmsMediaServerException)
+{
+  GstStateChangeReturn ret;
+  gint64 start, elapsed;
+
+  suspendMutex.lock();
+
+  if (!suspended) {
+    suspendMutex.unlock();
+    return 0;
+  }
+
+  start = g_get_monotonic_time ();
+  ret = gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  if (ret == GST_STATE_CHANGE_ASYNC)
+    ret = gst_element_get_state (pipeline, NULL, NULL, timeout * GST_MSECOND);
+
+  if (ret == GST_STATE_CHANGE_FAILURE || ret == GST_STATE_CHANGE_ASYNC) {
+    KmsMediaServerException except;
+
+    /* Left suspended, so resuming can be retried */
+    gst_element_set_state (pipeline, GST_STATE_READY);
+    suspendMutex.unlock();
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   ret == GST_STATE_CHANGE_FAILURE ?
+                                   "Pipeline could not be resumed" :
+                                   "Pipeline did not resume within " +
+                                   std::to_string (timeout) + " ms");
+    throw except;
+  }
+
+  unlockSuspendedElements ();
+
+  /* Encoders were closed, decoders downstream need a key frame again */
+  gst_element_send_event (pipeline, createForceKeyUnitEvent () );
+
+  elapsed = (g_get_monotonic_time () - start) / 1000;
+  suspended = false;
+  metrics::suspendedPipelines.dec ();
+  metrics::pipelineResumeTime.set (elapsed);
+
+  suspendMutex.unlock();
+
+  GST_DEBUG ("Pipeline %" G_GINT64_FORMAT " resumed in %" G_GINT64_FORMAT " ms",
+             id, elapsed);
+
+  return elapsed;
+}
+
+/* Elements created by the template being built on the current thread */
+struct TemplateCollector {
+  MediaPipeline *pipeline;
+  std::list<GstElement *> elements;
+};
+
+static __thread TemplateCollector *templateCollector = NULL;
+
+void
+MediaPipeline::addElement (GstElement *element)
+{
+  applyLatencyMode (element);
+  gst_bin_add (GST_BIN (pipeline), element);
+
+  if (templateCollector != NULL && templateCollector->pipeline == this) {
+    templateCollector->elements.push_back (GST_ELEMENT (gst_object_ref (element) ) );
+    return;
+  }
+
+  gst_element_sync_state_with_parent (element);
+}
+
+void
+MediaPipeline::createFromTemplate (std::map<std::string, KmsMediaObjectRef> &_return,
+                                   const std::string &name,
+                                   const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  std::shared_ptr<const PipelineTemplate> pipelineTemplate;
+  std::map<std::string, std::shared_ptr<MediaElement>> elements;
+  TemplateCollector collector;
+
+  pipelineTemplate = PipelineTemplates::getInstance ().getTemplate (name);
+
+  collector.pipeline = this;
+  templateCollector = &collector;
+
+  try {
+    for (auto it = pipelineTemplate->elements.begin();
+         it != pipelineTemplate->elements.end(); it++) {
+      std::map<std::string, KmsMediaParam> elementParams = it->params;
+      std::string prefix = it->name + ".";
+
+      for (auto param = params.begin(); param != params.end(); param++) {
+        if (param->first.compare (0, prefix.size(), prefix) == 0)
+          elementParams[param->first.substr (prefix.size() )] = param->second;
+      }
+
+      elements[it->name] = createMediaElement (it->type, elementParams);
+    }
+
+    /* Elements are linked before they start playing */
+    for (auto it = pipelineTemplate->elements.begin();
+         it != pipelineTemplate->elements.end(); it++) {
+      for (auto sink = it->sinks.begin(); sink != it->sinks.end(); sink++)
+        elements[it->name]->connect (elements[*sink]);
+    }
+  } catch (...) {
+    templateCollector = NULL;
+
+    for (auto it = collector.elements.begin(); it != collector.elements.end(); it++)
+      g_object_unref (*it);
+
+    for (auto it = elements.begin(); it != elements.end(); it++)
+      getMediaSet().remove (*it->second, true);
+
+    throw;
+  }
+
+  templateCollector = NULL;
+
+  for (auto it = collector.elements.begin(); it != collector.elements.end(); it++) {
+    /* It could have been released by another request meanwhile */
+    if (GST_OBJECT_PARENT (*it) == GST_OBJECT (pipeline) )
+      gst_element_sync_state_with_parent (*it);
+
+    g_object_unref (*it);
+  }
+
+  for (auto it = elements.begin(); it != elements.end(); it++)
+    _return[it->first] = *it->second;
+
+  GST_DEBUG ("Created %zu elements from template %s", elements.size(),
+             name.c_str() );
+}
+
+static gint
+count_children (GstBin *bin, const std::string &factory)
+{
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  bool done = false;
+  gint count = 0;
+
+  it = gst_bin_iterate_elements (bin);
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *child = GST_ELEMENT (g_value_get_object (&item) );
+
+      if (g_strcmp0 (element_factory_name (child), factory.c_str() ) == 0)
+        count++;
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      count = 0;
+      gst_iterator_resync (it);
+      break;
+
+    default:
+      done = true;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return count;
+}
+
+void
+MediaPipeline::invoke (KmsMediaInvocationReturn &_return,
+                       const std::string &command,
+                       const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  std::string name;
+
+  if (MEDIA_PIPELINE_REGISTER_TEMPLATE == command) {
+    std::string definition;
+
+    getStringParam (name, params, MEDIA_PIPELINE_TEMPLATE_PARAM_NAME);
+    getStringParam (definition, params, MEDIA_PIPELINE_TEMPLATE_PARAM_DEFINITION);
+    PipelineTemplates::getInstance ().registerTemplate (name, definition, params);
+    createVoidInvocationReturn (_return);
+  } else if (MEDIA_PIPELINE_GET_LATENCY == command) {
+    gint64 latency = getLatency ();
+
+    createI32InvocationReturn (_return, latency < 0 ? -1 : latency / GST_MSECOND);
+  } else if (MEDIA_PIPELINE_SUSPEND == command) {
+    suspend ();
+    createVoidInvocationReturn (_return);
+  } else if (MEDIA_PIPELINE_RESUME == command) {
+    const KmsMediaParam *p;
+    gint64 timeout = DEFAULT_RESUME_TIMEOUT;
+
+    p = getParam (params, MEDIA_PIPELINE_RESUME_PARAM_TIMEOUT);
+
+    if (p != NULL)
+      timeout = MAX (unmarshalI32Param (*p), 0);
+
+    createI32InvocationReturn (_return, resume (timeout) );
+  } else if (MEDIA_PIPELINE_GET_STATE == command) {
+    GstState state;
+
+    gst_element_get_state (pipeline, &state, NULL, 0);
+    createI32InvocationReturn (_return, state);
+  } else if (MEDIA_PIPELINE_COUNT_ELEMENTS == command) {
+    std::string factory;
+
+    getStringParam (factory, params, MEDIA_PIPELINE_COUNT_ELEMENTS_PARAM_FACTORY);
+    createI32InvocationReturn (_return, count_children (GST_BIN (pipeline), factory) );
+  } else if (MEDIA_PIPELINE_CREATE_FROM_TEMPLATE == command) {
+    std::map<std::string, KmsMediaObjectRef> refs;
+
+    getStringParam (name, params, MEDIA_PIPELINE_TEMPLATE_PARAM_NAME);
+    createFromTemplate (refs, name, params);
+    _return.__set_dataType (MEDIA_PIPELINE_OBJECT_REF_MAP_DATA_TYPE);
+    marshalKmsMediaObjectRefMap (_return.data, refs);
+    _return.__isset.data = true;
+  } else {
+    MediaObjectParent::invoke (_return, command, params);
+  }
 }
 
 std::shared_ptr<Mixer>
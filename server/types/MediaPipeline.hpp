@@ -19,6 +19,55 @@
 #include "MediaObjectParent.hpp"
 #include "MediaHandler.hpp"
 #include <common/MediaSet.hpp>
+#include <list>
+
+/* Invocation registering a template of media elements and connections */
+/* that can be created at once in any pipeline. See PipelineTemplates */
+#define MEDIA_PIPELINE_REGISTER_TEMPLATE "registerTemplate"
+#define MEDIA_PIPELINE_TEMPLATE_PARAM_NAME "name"
+#define MEDIA_PIPELINE_TEMPLATE_PARAM_DEFINITION "definition"
+/* Invocation creating the elements of a template in this pipeline. It */
+/* returns a map from element names to their object refs */
+#define MEDIA_PIPELINE_CREATE_FROM_TEMPLATE "createFromTemplate"
+#define MEDIA_PIPELINE_OBJECT_REF_MAP_DATA_TYPE "KmsMediaObjectRefMap"
+
+/* Optional String constructor param trading latency for resilience. Low */
+/* latency shortens jitter buffers and drops late packets, balanced only */
+/* shortens them, and throughput keeps the GStreamer defaults. Analysis */
+/* filters drop frames they can not keep up with except in throughput */
+#define MEDIA_PIPELINE_LATENCY_MODE_PARAM "latencyMode"
+#define MEDIA_PIPELINE_LATENCY_MODE_LOW "lowLatency"
+#define MEDIA_PIPELINE_LATENCY_MODE_BALANCED "balanced"
+#define MEDIA_PIPELINE_LATENCY_MODE_THROUGHPUT "throughput"
+/* Optional I32 constructor param. Milliseconds of jitter buffering, it */
+/* overrides the one given by the latency mode */
+#define MEDIA_PIPELINE_LATENCY_BUDGET_PARAM "latencyBudget"
+/* Invocation returning the latency measured in ms inside the pipeline, */
+/* from the running time of a few buffers to their arrival at a sink. It */
+/* does not include capture, network or rendering, and it is -1 if no */
+/* media reaches a sink within 300 ms */
+#define MEDIA_PIPELINE_GET_LATENCY "getLatency"
+/* End to end ms each latency mode is meant to stay within */
+#define MEDIA_PIPELINE_LATENCY_LOW_BUDGET 150
+#define MEDIA_PIPELINE_LATENCY_BALANCED_BUDGET 300
+/* Invocations putting an idle pipeline on hold and back. Suspended */
+/* pipelines stop their streaming threads and release encoders and */
+/* buffer pools, but keep every object id and connection. HTTP end */
+/* points and recorders keep their state so streams and files are left */
+/* intact, and suspending fails while any player or recorder is not */
+/* stopped. Resume returns the ms it took to play again, failing if it */
+/* does not play within the optional I32 timeout */
+#define MEDIA_PIPELINE_SUSPEND "suspend"
+#define MEDIA_PIPELINE_RESUME "resume"
+#define MEDIA_PIPELINE_RESUME_PARAM_TIMEOUT "timeout"
+/* Invocation returning the I32 GstState the pipeline is in, such as 2 */
+/* while suspended in READY and 4 once PLAYING */
+#define MEDIA_PIPELINE_GET_STATE "getState"
+/* Debug invocation returning the I32 number of elements made by the */
+/* String factory that sit right in the pipeline, outside end points */
+/* and filters, such as the shared conversions of analysis filters */
+#define MEDIA_PIPELINE_COUNT_ELEMENTS "countElements"
+#define MEDIA_PIPELINE_COUNT_ELEMENTS_PARAM_FACTORY "factory"
 
 namespace kurento
 {
@@ -42,10 +91,39 @@ public:
       KmsMediaParam > & params = emptyParams)
   throw (KmsMediaServerException);
 
+  void invoke (KmsMediaInvocationReturn &_return, const std::string &command,
+               const std::map<std::string, KmsMediaParam> & params) throw (KmsMediaServerException);
+
+  /* Adds @element and brings it to the state of the pipeline. Elements */
+  /* of a template are delayed until the whole template is connected */
+  void addElement (GstElement *element);
+
   GstElement *pipeline;
 
 private:
   void init ();
+  void setLatencyMode (const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+  void applyLatencyMode (GstElement *element);
+  gint64 getConfiguredLatency ();
+  gint64 getLatency ();
+  void suspend () throw (KmsMediaServerException);
+  gint64 resume (gint64 timeout) throw (KmsMediaServerException);
+  void unlockSuspendedElements ();
+  void createFromTemplate (std::map<std::string, KmsMediaObjectRef> &_return,
+                           const std::string &name,
+                           const std::map<std::string, KmsMediaParam> &params)
+  throw (KmsMediaServerException);
+
+  Glib::Threads::Mutex suspendMutex;
+  bool suspended = false;
+  /* Sinks left playing while suspended, locked in their state */
+  std::list<GstElement *> lockedElements;
+
+  /* Negative keeps the jitter buffer latency of each end point */
+  gint jitterBufferLatency = -1;
+  bool dropOnLatency = false;
+  bool leakyAnalysis = false;
 
   class StaticConstructor
   {
@@ -15,14 +15,193 @@
 
 #include "MediaSink.hpp"
 #include "MediaElement.hpp"
+#include "utils/utils.hpp"
 
 #define GST_CAT_DEFAULT kurento_media_sink
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaSink"
 
+/* Microseconds a new source waits for the old one to be idle */
+#define SWITCH_IDLE_TIMEOUT (G_TIME_SPAN_SECOND)
+/* Microseconds between checks that the old source is still there */
+#define SWITCH_IDLE_CHECK (10 * G_TIME_SPAN_MILLISECOND)
+
+struct _SwitchData {
+  volatile gint ref_count;
+  GMutex mutex;
+  GCond cond;
+  GstPad *src;
+  GstPad *sink;
+  gulong probe;
+  gboolean video;
+  gboolean idle_requested;
+  gboolean key_requested;
+  gboolean linked;
+  gboolean cancelled;
+};
+
 namespace kurento
 {
 
+static SwitchData *
+switch_data_new (GstPad *src, GstPad *sink, gboolean video)
+{
+  SwitchData *data;
+
+  data = g_slice_new0 (SwitchData);
+  data->ref_count = 1;
+  g_mutex_init (&data->mutex);
+  g_cond_init (&data->cond);
+  data->src = GST_PAD (gst_object_ref (src) );
+  data->sink = GST_PAD (gst_object_ref (sink) );
+  data->video = video;
+
+  return data;
+}
+
+static gpointer
+switch_data_ref (SwitchData *data)
+{
+  g_atomic_int_inc (&data->ref_count);
+
+  return data;
+}
+
+static void
+switch_data_unref (gpointer user_data)
+{
+  SwitchData *data = (SwitchData *) user_data;
+
+  if (!g_atomic_int_dec_and_test (&data->ref_count) )
+    return;
+
+  gst_object_unref (data->src);
+  gst_object_unref (data->sink);
+  g_mutex_clear (&data->mutex);
+  g_cond_clear (&data->cond);
+
+  g_slice_free (SwitchData, data);
+}
+
+/* Must be called with the lock held */
+static void
+switch_data_link (SwitchData *data, GstPad *old_src)
+{
+  if (data->cancelled || data->linked)
+    return;
+
+  if (old_src != NULL)
+    gst_pad_unlink (old_src, data->sink);
+
+  if (gst_pad_link (data->src, data->sink) != GST_PAD_LINK_OK)
+    GST_WARNING ("Can not link %" GST_PTR_FORMAT " to switch source",
+                 data->sink);
+
+  data->linked = TRUE;
+  g_cond_broadcast (&data->cond);
+}
+
+static GstPadProbeReturn
+switch_when_idle (GstPad *old_src, GstPadProbeInfo *info, gpointer user_data)
+{
+  SwitchData *data = (SwitchData *) user_data;
+
+  /* Nothing is being pushed by the old source while this is called */
+  g_mutex_lock (&data->mutex);
+  switch_data_link (data, old_src);
+  g_mutex_unlock (&data->mutex);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Must be called with the lock held. Holds the streaming thread of the */
+/* new source until the old one is swapped out by its idle probe, so the */
+/* key frame being pushed is not lost */
+static void
+switch_data_wait_linked (SwitchData *data)
+{
+  gint64 end_time = g_get_monotonic_time () + SWITCH_IDLE_TIMEOUT;
+
+  while (!data->linked && !data->cancelled) {
+    /* Old pad may be released before its idle probe is called */
+    if (!gst_pad_is_linked (data->sink) ) {
+      switch_data_link (data, NULL);
+      break;
+    }
+
+    if (g_get_monotonic_time () >= end_time) {
+      GST_WARNING ("Old source of %" GST_PTR_FORMAT " did not get idle",
+                   data->sink);
+      break;
+    }
+
+    g_cond_wait_until (&data->cond, &data->mutex,
+                       MIN (end_time, g_get_monotonic_time () + SWITCH_IDLE_CHECK) );
+  }
+}
+
+/* Buffers of the new source are dropped until its first key frame, */
+/* which waits for the old source to be idle and goes through once the */
+/* pads are swapped */
+static GstPadProbeReturn
+wait_key_frame (GstPad *src, GstPadProbeInfo *info, gpointer user_data)
+{
+  SwitchData *data = (SwitchData *) user_data;
+  GstBuffer *buffer;
+  GstPad *old_src = NULL;
+  gboolean linked;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    buffer = gst_buffer_list_get (GST_PAD_PROBE_INFO_BUFFER_LIST (info), 0);
+  else
+    buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (data->video && (buffer == NULL ||
+                      GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ) ) {
+    gboolean request;
+
+    g_mutex_lock (&data->mutex);
+    request = data->linked && !data->cancelled && !data->key_requested;
+    data->key_requested |= request;
+    g_mutex_unlock (&data->mutex);
+
+    /* The old source stayed busy and the key frame was dropped, ask again */
+    if (request)
+      gst_pad_send_event (src, createForceKeyUnitEvent () );
+
+    return GST_PAD_PROBE_DROP;
+  }
+
+  g_mutex_lock (&data->mutex);
+
+  if (!data->linked && !data->cancelled && !data->idle_requested) {
+    old_src = gst_pad_get_peer (data->sink);
+
+    if (old_src == NULL)
+      switch_data_link (data, NULL);
+    else
+      data->idle_requested = TRUE;
+  }
+
+  g_mutex_unlock (&data->mutex);
+
+  if (old_src != NULL) {
+    /* The old source may be pushing right now, so the pads are swapped */
+    /* once it is done. It may happen right away */
+    gst_pad_add_probe (old_src, GST_PAD_PROBE_TYPE_IDLE, switch_when_idle,
+                       switch_data_ref (data), switch_data_unref);
+    gst_object_unref (old_src);
+  }
+
+  g_mutex_lock (&data->mutex);
+  switch_data_wait_linked (data);
+  linked = data->linked && !data->cancelled;
+  g_mutex_unlock (&data->mutex);
+
+  /* If cancelled, the probe is removed with the pad */
+  return linked ? GST_PAD_PROBE_REMOVE : GST_PAD_PROBE_DROP;
+}
+
 MediaSink::MediaSink (std::shared_ptr<MediaElement> parent, KmsMediaType::type mediaType)
   : MediaPad (parent, KmsMediaPadDirection::SINK, mediaType)
 {
@@ -41,6 +220,8 @@ MediaSink::~MediaSink() throw ()
   if (connectedSrcLocked != NULL) {
     connectedSrcLocked->disconnect (this);
   }
+
+  cancelSwitch ();
 }
 
 std::string
@@ -122,6 +303,19 @@ MediaSink::linkPad (std::shared_ptr<MediaSrc> mediaSrc, GstPad *src)
   if ( (sink = gst_element_get_static_pad (getElement(), getPadName().c_str() ) ) == NULL)
     sink = gst_element_get_request_pad (getElement(), getPadName().c_str() );
 
+  cancelSwitch ();
+
+  if (gst_pad_is_linked (sink) && connectedSrcLocked != NULL &&
+      mediaSrc->parent != parent) {
+    /* Media keeps flowing from the current source until the new one */
+    /* produces a key frame, so the sink never runs out of data */
+    switchPad (src, sink);
+    connectedSrcLocked->removeSink (this);
+    connectedSrc = std::weak_ptr<MediaSrc> (mediaSrc);
+    ret = true;
+    goto end;
+  }
+
   if (gst_pad_is_linked (sink) ) {
     unlink (connectedSrcLocked, sink);
   }
@@ -186,6 +380,58 @@ end:
   return ret;
 }
 
+void
+MediaSink::switchPad (GstPad *src, GstPad *sink)
+{
+  SwitchData *data;
+
+  GST_DEBUG ("Switching %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, sink, src);
+
+  data = switch_data_new (src, sink, mediaType == KmsMediaType::type::VIDEO);
+  data->probe = gst_pad_add_probe (src, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER |
+                                   GST_PAD_PROBE_TYPE_BUFFER_LIST), wait_key_frame,
+                                   switch_data_ref (data), switch_data_unref);
+  pendingSwitch = data;
+
+  if (data->video)
+    gst_pad_send_event (src, createForceKeyUnitEvent () );
+}
+
+void
+MediaSink::cancelSwitch ()
+{
+  SwitchData *data;
+  GstElement *element;
+  gboolean linked;
+
+  mutex.lock();
+  data = pendingSwitch;
+  pendingSwitch = NULL;
+  mutex.unlock();
+
+  if (data == NULL)
+    return;
+
+  g_mutex_lock (&data->mutex);
+  linked = data->linked;
+  data->cancelled = TRUE;
+  g_cond_broadcast (&data->cond);
+  g_mutex_unlock (&data->mutex);
+
+  if (!linked) {
+    /* The new source was never linked, so nobody else will release it */
+    gst_pad_remove_probe (data->src, data->probe);
+    element = gst_pad_get_parent_element (data->src);
+
+    if (element != NULL) {
+      gst_element_release_request_pad (element, data->src);
+      g_object_unref (element);
+    }
+  }
+
+  switch_data_unref (data);
+}
+
 void
 MediaSink::unlink (std::shared_ptr<MediaSrc> mediaSrc, GstPad *sink)
 {
@@ -212,6 +458,8 @@ MediaSink::unlinkUnchecked (GstPad *sink)
   GstPad *peer;
   GstPad *sinkPad;
 
+  cancelSwitch ();
+
   if (sink == NULL)
     sinkPad = gst_element_get_static_pad (getElement(), getPadName().c_str() );
   else
@@ -21,6 +21,8 @@
 
 #include <glibmm.h>
 
+typedef struct _SwitchData SwitchData;
+
 namespace kurento
 {
 
@@ -40,8 +42,12 @@ private:
   bool linkPad (std::shared_ptr<MediaSrc> mediaSrc, GstPad *pad);
   void unlink (std::shared_ptr<MediaSrc> mediaSrc, GstPad *sink);
   void unlinkUnchecked (GstPad *sink);
+  void switchPad (GstPad *src, GstPad *sink);
+  void cancelSwitch ();
 
   std::weak_ptr <MediaSrc> connectedSrc;
+  /* Source pad waiting for a key frame to replace the linked one */
+  SwitchData *pendingSwitch = NULL;
 
   Glib::RecMutex mutex;
 
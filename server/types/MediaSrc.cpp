@@ -16,8 +16,10 @@
 #include "MediaSrc.hpp"
 
 #include "MediaElement.hpp"
+#include "Filter.hpp"
 #include "KmsMediaErrorCodes_constants.h"
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 
 #define GST_CAT_DEFAULT kurento_media_src
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -57,10 +59,20 @@ create_tmp_data (std::shared_ptr<MediaSrc> src, std::shared_ptr<MediaSink> sink)
   return tmp;
 }
 
+static GstPadProbeReturn
+release_when_idle (GstPad *pad, GstPadProbeInfo *info, gpointer parent)
+{
+  gst_element_release_request_pad (GST_ELEMENT (parent), pad);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
 static void
 pad_unlinked (GstPad *pad, GstPad *peer, GstElement *parent)
 {
-  gst_element_release_request_pad (parent, pad);
+  /* A buffer may still be being pushed, so it is released afterwards */
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_IDLE, release_when_idle,
+                     g_object_ref (parent), g_object_unref);
 }
 
 gboolean
@@ -70,21 +82,19 @@ link_media_elements (std::shared_ptr<MediaSrc> src, std::shared_ptr<MediaSink> s
   GstPad *pad;
 
   src->mutex.lock ();
-  pad = gst_element_get_request_pad (src->getElement(), src->getPadName() );
+  pad = src->requestPad (sink);
 
   if (pad == NULL)
     goto end;
 
   GST_WARNING ("Connecting pad %s", src->getPadName() );
 
-  g_signal_connect (G_OBJECT (pad), "unlinked", G_CALLBACK (pad_unlinked),
-                    src->getElement() );
-
   if (sink->linkPad (src, pad) ) {
     src->connectedSinks.push_back (std::weak_ptr<MediaSink> (sink) );
+    src->getMediaElement ()->scheduleDemandUpdate ();
     ret = TRUE;
   } else {
-    gst_element_release_request_pad (src->getElement(), pad);
+    gst_element_release_request_pad (GST_ELEMENT (GST_OBJECT_PARENT (pad) ), pad);
     ret = FALSE;
   }
 
@@ -140,9 +150,274 @@ MediaSrc::~MediaSrc() throw ()
     }
   }
 
+  for (auto it = converters.begin(); it != converters.end(); it++)
+    removeConverter (it->second);
+
   mutex.unlock();
 }
 
+void
+MediaSrc::removeConverter (Converter &converter)
+{
+  std::list<GstElement *> &elements = converter.elements;
+  GstPad *sink, *peer;
+
+  sink = gst_element_get_static_pad (elements.front(), "sink");
+  peer = gst_pad_get_peer (sink);
+
+  if (peer != NULL) {
+    gst_pad_unlink (peer, sink);
+    g_object_unref (peer);
+  }
+
+  g_object_unref (sink);
+
+  for (auto e = elements.begin(); e != elements.end(); e++) {
+    GstBin *bin = GST_BIN (GST_OBJECT_PARENT (*e) );
+
+    if (bin != NULL)
+      gst_bin_remove (bin, *e);
+
+    gst_element_set_state (*e, GST_STATE_NULL);
+    g_object_unref (*e);
+  }
+}
+
+static gboolean
+has_src_pads (GstElement *element)
+{
+  gboolean ret;
+
+  GST_OBJECT_LOCK (element);
+  ret = element->numsrcpads > 0;
+  GST_OBJECT_UNLOCK (element);
+
+  return ret;
+}
+
+void
+MediaSrc::removeUnusedConverters ()
+{
+  mutex.lock();
+
+  for (auto it = converters.begin(); it != converters.end();) {
+    /* A filter may have taken a new pad since it was scheduled */
+    if (!has_src_pads (it->second.tee) ) {
+      GST_DEBUG ("Removing unused conversion %s", it->first.c_str() );
+      removeConverter (it->second);
+      it = converters.erase (it);
+    } else {
+      it++;
+    }
+  }
+
+  mutex.unlock();
+}
+
+static void
+delete_src_ref (gpointer data)
+{
+  delete (std::weak_ptr<MediaSrc> *) data;
+}
+
+gboolean
+remove_unused_converters (gpointer data)
+{
+  std::shared_ptr<MediaSrc> src = ( (std::weak_ptr<MediaSrc> *) data)->lock();
+
+  if (src != NULL)
+    src->removeUnusedConverters ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+converter_pad_removed (GstElement *tee, GstPad *pad, gpointer data)
+{
+  std::weak_ptr<MediaSrc> *src = (std::weak_ptr<MediaSrc> *) data;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC || has_src_pads (tee) )
+    return;
+
+  /* Might be the streaming thread of the tee, so it is torn down later */
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, remove_unused_converters,
+                   new std::weak_ptr<MediaSrc> (*src), delete_src_ref);
+}
+
+static void
+delete_src_closure_ref (gpointer data, GClosure *closure)
+{
+  delete_src_ref (data);
+}
+
+static GstPadProbeReturn
+set_crop_margins (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  AnalysisRegion *region = (AnalysisRegion *) data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  const GstStructure *st;
+  GstElement *crop;
+  GstCaps *caps;
+  gint width, height, left, top;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+
+  gst_event_parse_caps (event, &caps);
+  st = gst_caps_get_structure (caps, 0);
+
+  if (!gst_structure_get_int (st, "width", &width) ||
+      !gst_structure_get_int (st, "height", &height) )
+    return GST_PAD_PROBE_OK;
+
+  /* Margins depend on the source size, which is only known now */
+  left = MIN (region->x, width - 1);
+  top = MIN (region->y, height - 1);
+
+  crop = gst_pad_get_parent_element (pad);
+  g_object_set (crop, "left", left, "top", top,
+                "right", MAX (0, width - left - region->width),
+                "bottom", MAX (0, height - top - region->height), NULL);
+  g_object_unref (crop);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+delete_region (gpointer data)
+{
+  delete (AnalysisRegion *) data;
+}
+
+GstElement *
+MediaSrc::getConverter (const std::string &caps, const AnalysisRegion *crop)
+{
+  MediaElementRegistry &registry = MediaElementRegistry::getInstance ();
+  GstElement *convert, *scale, *filter, *tee, *first;
+  GstPad *src, *sink;
+  GstCaps *filterCaps;
+  GstBin *pipeline;
+  Converter converter;
+  std::string key = caps;
+
+  if (crop != NULL) {
+    key += " crop=" + std::to_string (crop->x) + "," + std::to_string (crop->y) +
+           "," + std::to_string (crop->width) + "," + std::to_string (crop->height);
+  }
+
+  auto it = converters.find (key);
+
+  if (it != converters.end() )
+    return it->second.tee;
+
+  pipeline = GST_BIN (GST_OBJECT_PARENT (getElement() ) );
+
+  if (pipeline == NULL)
+    return NULL;
+
+  src = gst_element_get_request_pad (getElement(), getPadName() );
+
+  if (src == NULL)
+    return NULL;
+
+  convert = registry.makeElement ("videoconvert");
+  scale = registry.makeElement ("videoscale");
+  filter = registry.makeElement ("capsfilter");
+  tee = registry.makeElement ("tee");
+
+  filterCaps = gst_caps_from_string (caps.empty() ? "video/x-raw" : caps.c_str() );
+  g_object_set (filter, "caps", filterCaps, NULL);
+  gst_caps_unref (filterCaps);
+
+  /* A filter unlinked while others are still linking must not stop the */
+  /* source. The property is not there before GStreamer 1.6 */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (tee), "allow-not-linked") )
+    g_object_set (tee, "allow-not-linked", TRUE, NULL);
+
+  g_signal_connect_data (tee, "pad-removed", G_CALLBACK (converter_pad_removed),
+                         new std::weak_ptr<MediaSrc> (shared_from_this() ),
+                         delete_src_closure_ref, (GConnectFlags) 0);
+
+  converter.tee = tee;
+  converter.elements.push_back (GST_ELEMENT (g_object_ref (convert) ) );
+  converter.elements.push_back (GST_ELEMENT (g_object_ref (scale) ) );
+  converter.elements.push_back (GST_ELEMENT (g_object_ref (filter) ) );
+  converter.elements.push_back (GST_ELEMENT (g_object_ref (tee) ) );
+
+  gst_bin_add_many (pipeline, convert, scale, filter, tee, NULL);
+  gst_element_link_many (convert, scale, filter, tee, NULL);
+  first = convert;
+
+  if (crop != NULL) {
+    /* Cropping first saves converting the pixels that are not analysed */
+    GstElement *videocrop = registry.makeElement ("videocrop");
+
+    if (videocrop != NULL) {
+      GstPad *cropSink = gst_element_get_static_pad (videocrop, "sink");
+
+      gst_pad_add_probe (cropSink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                         set_crop_margins, new AnalysisRegion (*crop), delete_region);
+      g_object_unref (cropSink);
+
+      converter.elements.push_front (GST_ELEMENT (g_object_ref (videocrop) ) );
+      gst_bin_add (pipeline, videocrop);
+      gst_element_link (videocrop, convert);
+      first = videocrop;
+    }
+  }
+
+  for (auto e = converter.elements.rbegin(); e != converter.elements.rend(); e++)
+    gst_element_sync_state_with_parent (*e);
+
+  sink = gst_element_get_static_pad (first, "sink");
+  g_signal_connect (G_OBJECT (src), "unlinked", G_CALLBACK (pad_unlinked),
+                    getElement() );
+  gst_pad_link (src, sink);
+  g_object_unref (sink);
+  g_object_unref (src);
+
+  GST_DEBUG ("Converting to %s for analysis filters", key.c_str() );
+  converters[key] = converter;
+
+  return tee;
+}
+
+GstPad *
+MediaSrc::requestPad (std::shared_ptr<MediaSink> mediaSink)
+{
+  std::shared_ptr<Filter> filter;
+  GstElement *element = getElement();
+  GstPad *pad;
+
+  if (mediaType == KmsMediaType::type::VIDEO) {
+    filter = std::dynamic_pointer_cast<Filter> (mediaSink->getMediaElement() );
+
+    /* Every filter analysing the same format and area takes the same frames */
+    if (filter) {
+      std::string caps = filter->getAnalysisCaps();
+      AnalysisRegion crop;
+      bool cropped = filter->getAnalysisCrop (crop);
+
+      if (!caps.empty() || cropped)
+        element = getConverter (caps, cropped ? &crop : NULL);
+    }
+  }
+
+  if (element == NULL)
+    return NULL;
+
+  if (element == getElement() )
+    pad = gst_element_get_request_pad (element, getPadName() );
+  else
+    pad = gst_element_get_request_pad (element, "src_%u");
+
+  if (pad != NULL)
+    g_signal_connect (G_OBJECT (pad), "unlinked", G_CALLBACK (pad_unlinked),
+                      element);
+
+  return pad;
+}
+
 const gchar *
 MediaSrc::getPadName ()
 {
@@ -162,7 +437,7 @@ MediaSrc::connect (std::shared_ptr<MediaSink> mediaSink) throw (KmsMediaServerEx
 
   mutex.lock();
 
-  pad = gst_element_get_request_pad (getElement(), getPadName() );
+  pad = requestPad (mediaSink);
 
   if (pad == NULL) {
     struct tmp_data *tmp;
@@ -178,14 +453,13 @@ MediaSrc::connect (std::shared_ptr<MediaSink> mediaSink) throw (KmsMediaServerEx
     return;
   }
 
-  g_signal_connect (G_OBJECT (pad), "unlinked", G_CALLBACK (pad_unlinked), getElement() );
-
   ret = mediaSink->linkPad (shared_from_this(), pad);
 
   if (ret) {
     connectedSinks.push_back (std::weak_ptr<MediaSink> (mediaSink) );
+    getMediaElement ()->scheduleDemandUpdate ();
   } else {
-    gst_element_release_request_pad (getElement(), pad);
+    gst_element_release_request_pad (GST_ELEMENT (GST_OBJECT_PARENT (pad) ), pad);
   }
 
   g_object_unref (pad);
@@ -211,6 +485,7 @@ MediaSrc::removeSink (MediaSink *mediaSink)
 {
   std::shared_ptr<MediaSink> sinkLocked;
   std::vector< std::weak_ptr<MediaSink> >::iterator it;
+  bool removed = false;
 
   mutex.lock();
 
@@ -224,12 +499,43 @@ MediaSrc::removeSink (MediaSink *mediaSink)
 
     if (sinkLocked == NULL || sinkLocked->id == mediaSink->id) {
       it = connectedSinks.erase (it);
+      removed = true;
     } else {
       it++;
     }
   }
 
   mutex.unlock();
+
+  if (removed)
+    getMediaElement ()->scheduleDemandUpdate ();
+}
+
+bool
+MediaSrc::hasDemand ()
+{
+  bool demand = false;
+
+  mutex.lock();
+
+  for (auto it = connectedSinks.begin(); it != connectedSinks.end(); it++) {
+    std::shared_ptr<MediaSink> sinkLocked = (*it).lock();
+    std::shared_ptr<MediaElement> element;
+
+    if (sinkLocked == NULL)
+      continue;
+
+    element = sinkLocked->getMediaElement ();
+
+    if (element->consumesMedia () || element->isDemanded () ) {
+      demand = true;
+      break;
+    }
+  }
+
+  mutex.unlock();
+
+  return demand;
 }
 
 void
@@ -18,11 +18,13 @@
 
 #include "MediaPad.hpp"
 #include <glibmm.h>
+#include <list>
 
 namespace kurento
 {
 
 class MediaSink;
+struct AnalysisRegion;
 
 class MediaSrc : public MediaPad, public std::enable_shared_from_this<MediaSrc>
 {
@@ -34,10 +36,27 @@ public:
   void disconnect (std::shared_ptr<MediaSink> mediaSink);
   void getConnectedSinks (std::vector < std::shared_ptr<MediaSink> > &_return);
 
+  /* Whether any connected sink belongs to an element using the media */
+  bool hasDemand ();
+
 private:
+  struct Converter {
+    GstElement *tee;
+    std::list<GstElement *> elements;
+  };
+
   std::vector < std::weak_ptr<MediaSink> > connectedSinks;
+  /* Conversions shared by the filters analysing this source, indexed */
+  /* by the caps they produce and the region they crop */
+  std::map<std::string, Converter> converters;
+
   void removeSink (MediaSink *mediaSink);
   void disconnect (MediaSink *mediaSink);
+  GstPad *requestPad (std::shared_ptr<MediaSink> mediaSink);
+  GstElement *getConverter (const std::string &caps,
+                            const AnalysisRegion *crop);
+  void removeConverter (Converter &converter);
+  void removeUnusedConverters ();
 
   Glib::RecMutex mutex;
 
@@ -53,6 +72,7 @@ private:
 
   friend class MediaSink;
   friend gboolean link_media_elements(std::shared_ptr<MediaSrc> src, std::shared_ptr<MediaSink> sink);
+  friend gboolean remove_unused_converters (gpointer data);
 };
 
 } // kurento
@@ -16,6 +16,7 @@
 #include "PlateDetectorFilter.hpp"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "utils/marshalling.hpp"
 #include "KmsMediaDataType_constants.h"
 #include "KmsMediaErrorCodes_constants.h"
@@ -24,6 +25,8 @@
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoPlateDetectorFilter"
 
+#define DEFAULT_APPEARANCE_TIMEOUT 2000 /* ms */
+
 namespace kurento
 {
 
@@ -56,24 +59,46 @@ plate_detector_receive_message (GstBus *bus, GstMessage *message, gpointer plate
   plateNumberStr = plateNumber;
   typeStr = type;
   g_free (plateNumber);
-  filter->raiseEvent (typeStr, plateNumberStr);
+
+  if (filter->appearances.isNewAppearance (plateNumberStr,
+      g_get_monotonic_time () ) )
+    filter->raiseEvent (typeStr, plateNumberStr);
 }
 
 /* default constructor */
 PlateDetectorFilter::PlateDetectorFilter (
   MediaSet &mediaSet, std::shared_ptr<MediaPipeline> parent,
   const std::map<std::string, KmsMediaParam> &params)
-  : Filter (mediaSet, parent, g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, params)
+  : Filter (mediaSet, parent, g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, params),
+    appearances (DEFAULT_APPEARANCE_TIMEOUT * G_TIME_SPAN_MILLISECOND)
 {
+  gint64 appearanceTimeout = DEFAULT_APPEARANCE_TIMEOUT;
   GstElement *plateDetector;
+  const KmsMediaParam *p;
   GstBus *bus;
 
-  element = gst_element_factory_make ("filterelement", NULL);
+  p = getParam (params, PLATE_DETECTOR_APPEARANCE_TIMEOUT_PARAM);
+
+  if (p != NULL)
+    appearanceTimeout = unmarshalI32Param (*p);
+
+  if (appearanceTimeout < 0) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except,
+                                   g_KmsMediaErrorCodes_constants.MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                                   "Param '" PLATE_DETECTOR_APPEARANCE_TIMEOUT_PARAM
+                                   "' can not be negative");
+    throw except;
+  }
+
+  appearances.setTimeout (appearanceTimeout * G_TIME_SPAN_MILLISECOND);
+
+  element = MediaElementRegistry::getInstance ().makeElement ("filterelement");
 
   g_object_set (element, "filter-factory", "platedetector", NULL);
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 
   bus = gst_pipeline_get_bus (GST_PIPELINE (parent->pipeline) );
   bus_handler_id = g_signal_connect (bus, "message", G_CALLBACK (plate_detector_receive_message ), this);
@@ -83,6 +108,9 @@ PlateDetectorFilter::PlateDetectorFilter (
   this->plateDetector = plateDetector;
   // There is no need to reference platedetector because its life cycle is the same as the filter life cycle
   g_object_unref (plateDetector);
+
+  initAnalysis ();
+  addAnalysisEventType (g_KmsMediaPlateDetectorFilterType_constants.EVENT_PLATE_DETECTED);
 }
 
 PlateDetectorFilter::~PlateDetectorFilter() throw ()
@@ -116,9 +144,10 @@ PlateDetectorFilter::subscribe (std::string &_return, const std::string &eventTy
                                 const int32_t handlerPort)
 throw (KmsMediaServerException)
 {
-  if (g_KmsMediaPlateDetectorFilterType_constants.EVENT_PLATE_DETECTED == eventType)
+  if (g_KmsMediaPlateDetectorFilterType_constants.EVENT_PLATE_DETECTED == eventType) {
     mediaHandlerManager.addMediaHandler (_return, eventType, handlerAddress, handlerPort);
-  else
+    updateAnalysisBypass ();
+  } else
     Filter::subscribe (_return, eventType, handlerAddress, handlerPort);
 }
 
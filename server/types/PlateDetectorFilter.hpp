@@ -17,8 +17,13 @@
 #define __PLATE_DETECTOR_FILTER_HPP__
 
 #include "Filter.hpp"
+#include "common/PlateAppearances.hpp"
 #include "KmsMediaPlateDetectorFilterType_constants.h"
 
+/* Optional I32 constructor param with the milliseconds a plate has to */
+/* go unrecognised to be reported again when it is recognised later */
+#define PLATE_DETECTOR_APPEARANCE_TIMEOUT_PARAM "appearanceTimeout"
+
 namespace kurento
 {
 
@@ -35,6 +40,9 @@ private:
   gulong bus_handler_id;
   GstElement *plateDetector;
 
+  /* Only used from the main loop */
+  PlateAppearances appearances;
+
   void raiseEvent (const std::string &type, const std::string &plateNumber);
   void subscribe (std::string &_return, const std::string &eventType,
                   const std::string &handlerAddress,
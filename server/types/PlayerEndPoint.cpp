@@ -21,6 +21,7 @@
 #include "KmsMediaErrorCodes_constants.h"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "utils/marshalling.hpp"
 
 #define GST_CAT_DEFAULT kurento_player_end_point
@@ -33,6 +34,8 @@ namespace kurento
 void
 player_eos (GstElement *player, PlayerEndPoint *self)
 {
+  /* Not locked, stopping the player waits for this streaming thread */
+  self->started = false;
   self->sendEvent (g_KmsMediaPlayerEndPointType_constants.EVENT_EOS);
 }
 
@@ -51,7 +54,7 @@ player_invalid_media (GstElement *player, PlayerEndPoint *self)
 void
 PlayerEndPoint::init (std::shared_ptr<MediaPipeline> parent, const std::string &uri)
 {
-  element = gst_element_factory_make ("playerendpoint", NULL);
+  element = MediaElementRegistry::getInstance ().makeElement ("playerendpoint");
 
   g_object_set (G_OBJECT (element), "uri", uri.c_str(), NULL);
 
@@ -60,8 +63,7 @@ PlayerEndPoint::init (std::shared_ptr<MediaPipeline> parent, const std::string &
   g_signal_connect (element, "invalid-media", G_CALLBACK (player_invalid_media), this);
 
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 }
 
 PlayerEndPoint::PlayerEndPoint (MediaSet &mediaSet,
@@ -69,7 +71,8 @@ PlayerEndPoint::PlayerEndPoint (MediaSet &mediaSet,
                                 const std::map<std::string, KmsMediaParam> &params)
 throw (KmsMediaServerException)
   : UriEndPoint (mediaSet, parent,
-                 g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params)
+                 g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params),
+  started (false)
 {
   const KmsMediaParam *p;
   KmsMediaUriEndPointConstructorParams uriEpParams;
@@ -96,6 +99,55 @@ PlayerEndPoint::~PlayerEndPoint() throw ()
   g_object_unref (element);
 }
 
+void
+PlayerEndPoint::start ()
+{
+  stateMutex.lock ();
+  started = true;
+
+  if (isDemanded () )
+    UriEndPoint::start ();
+  else
+    GST_DEBUG ("Player %" G_GINT64_FORMAT " starts when demanded", id);
+
+  stateMutex.unlock ();
+}
+
+void
+PlayerEndPoint::pause ()
+{
+  stateMutex.lock ();
+  started = false;
+  UriEndPoint::pause ();
+  stateMutex.unlock ();
+}
+
+void
+PlayerEndPoint::stop ()
+{
+  stateMutex.lock ();
+  started = false;
+  UriEndPoint::stop ();
+  stateMutex.unlock ();
+}
+
+void
+PlayerEndPoint::onDemandChanged (bool demanded)
+{
+  stateMutex.lock ();
+
+  /* Demand is read again, it may have changed while waiting for the lock */
+  if (started) {
+    /* Pausing stops decoding until somebody uses the media again */
+    if (isDemanded () )
+      UriEndPoint::start ();
+    else
+      UriEndPoint::pause ();
+  }
+
+  stateMutex.unlock ();
+}
+
 void
 PlayerEndPoint::subscribe (std::string &_return, const std::string &eventType, const std::string &handlerAddress, const int32_t handlerPort)
 throw (KmsMediaServerException)
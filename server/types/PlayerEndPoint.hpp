@@ -32,9 +32,23 @@ public:
   void subscribe (std::string &_return, const std::string &eventType,
                   const std::string &handlerAddress, const int32_t handlerPort) throw (KmsMediaServerException);
 
+  /* Playback only goes on while the player is demanded */
+  void start ();
+  void pause ();
+  void stop ();
+
+protected:
+  void onDemandChanged (bool demanded);
+
 private:
   void init (std::shared_ptr<MediaPipeline> parent, const std::string &uri);
 
+  /* Serialises changes of started and of the element state, so demand */
+  /* changes never undo a later start, pause or stop */
+  Glib::Threads::Mutex stateMutex;
+  /* Whether playback was started and not paused or stopped since */
+  std::atomic<bool> started;
+
   class StaticConstructor
   {
   public:
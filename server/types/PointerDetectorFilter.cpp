@@ -18,6 +18,7 @@
 #include "KmsMediaPointerDetectorFilterType_constants.h"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "utils/marshalling.hpp"
 #include "KmsMediaDataType_constants.h"
 #include "KmsMediaErrorCodes_constants.h"
@@ -82,12 +83,11 @@ PointerDetectorFilter::PointerDetectorFilter (
   const KmsMediaParam *p;
   KmsMediaPointerDetectorWindowSet windowSet;
 
-  element = gst_element_factory_make ("filterelement", NULL);
+  element = MediaElementRegistry::getInstance ().makeElement ("filterelement");
 
   g_object_set (element, "filter-factory", "pointerdetector", NULL);
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (parent->pipeline) );
   GstElement *pointerDetector;
@@ -106,36 +106,19 @@ PointerDetectorFilter::PointerDetectorFilter (
     throw except;
   }
 
+  windowsLayout = gst_structure_new_empty ("windowsLayout");
+
   p = getParam (params,
                 g_KmsMediaPointerDetectorFilterType_constants.CONSTRUCTOR_PARAMS_DATA_TYPE);
 
   if (p != NULL) {
-    GstStructure *buttonsLayout;
     //there are data about windows
     unmarshalStruct (windowSet, p->data);
-    /* set the window layout list */
-    buttonsLayout = gst_structure_new_empty  ("windowsLayout");
-
-    for (auto it = windowSet.windows.begin(); it != windowSet.windows.end(); ++it) {
-      KmsMediaPointerDetectorWindow windowInfo = *it;
-      GstStructure *buttonsLayoutAux;
-      buttonsLayoutAux = gst_structure_new (
-                           windowInfo.id.c_str(),
-                           "upRightCornerX", G_TYPE_INT, windowInfo.topRightCornerX,
-                           "upRightCornerY", G_TYPE_INT, windowInfo.topRightCornerY,
-                           "width", G_TYPE_INT, windowInfo.width,
-                           "height", G_TYPE_INT, windowInfo.height,
-                           "id", G_TYPE_STRING, windowInfo.id.c_str(),
-                           NULL);
-      gst_structure_set (buttonsLayout,
-                         windowInfo.id.c_str(), GST_TYPE_STRUCTURE, buttonsLayoutAux,
-                         NULL);
-
-      gst_structure_free (buttonsLayoutAux);
-    }
 
-    g_object_set (G_OBJECT (this->pointerDetector), WINDOWS_LAYOUT, buttonsLayout, NULL);
-    gst_structure_free (buttonsLayout);
+    for (auto it = windowSet.windows.begin(); it != windowSet.windows.end(); ++it)
+      setWindow (*it);
+
+    applyWindowsLayout ();
   }
 
   windowSet.windows.clear();
@@ -144,6 +127,10 @@ PointerDetectorFilter::PointerDetectorFilter (
   g_object_unref (bus);
   // There is no need to reference pointerdetector because its life cycle is the same as the filter life cycle
   g_object_unref (pointerDetector);
+
+  initAnalysis ();
+  addAnalysisEventType (g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_IN);
+  addAnalysisEventType (g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_OUT);
 }
 
 PointerDetectorFilter::~PointerDetectorFilter() throw ()
@@ -155,6 +142,9 @@ PointerDetectorFilter::~PointerDetectorFilter() throw ()
   gst_bin_remove (GST_BIN ( ( (std::shared_ptr<MediaPipeline> &) parent)->pipeline), element);
   gst_element_set_state (element, GST_STATE_NULL);
   g_object_unref (element);
+
+  if (windowsLayout != NULL)
+    gst_structure_free (windowsLayout);
 }
 
 void
@@ -178,70 +168,123 @@ PointerDetectorFilter::raiseEvent (const std::string &type, const std::string &w
 }
 
 void
-PointerDetectorFilter::addWindow (KmsMediaPointerDetectorWindow window)
+PointerDetectorFilter::setWindow (const KmsMediaPointerDetectorWindow &window)
 {
-  GstStructure *buttonsLayout, *buttonsLayoutAux;
-
-  buttonsLayoutAux = gst_structure_new (
-                       window.id.c_str(),
-                       "upRightCornerX", G_TYPE_INT, window.topRightCornerX,
-                       "upRightCornerY", G_TYPE_INT, window.topRightCornerY,
-                       "width", G_TYPE_INT, window.width,
-                       "height", G_TYPE_INT, window.height,
-                       "id", G_TYPE_STRING, window.id.c_str(),
-                       NULL);
-
-  /* The function obtains the actual window list */
-  g_object_get (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, &buttonsLayout, NULL);
-  gst_structure_set (buttonsLayout,
-                     window.id.c_str(), GST_TYPE_STRUCTURE, buttonsLayoutAux,
+  GstStructure *windowLayout;
+
+  windowLayout = gst_structure_new (
+                   window.id.c_str(),
+                   "upRightCornerX", G_TYPE_INT, window.topRightCornerX,
+                   "upRightCornerY", G_TYPE_INT, window.topRightCornerY,
+                   "width", G_TYPE_INT, window.width,
+                   "height", G_TYPE_INT, window.height,
+                   "id", G_TYPE_STRING, window.id.c_str(),
+                   NULL);
+
+  gst_structure_set (windowsLayout,
+                     window.id.c_str(), GST_TYPE_STRUCTURE, windowLayout,
                      NULL);
+  gst_structure_free (windowLayout);
+}
 
-  g_object_set (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, buttonsLayout, NULL);
+void
+PointerDetectorFilter::unsetWindow (const std::string &id)
+{
+  if (!gst_structure_has_field (windowsLayout, id.c_str() ) ) {
+    GST_WARNING ("There is no window %s in the layout", id.c_str() );
+    return;
+  }
 
-  gst_structure_free (buttonsLayout);
-  gst_structure_free (buttonsLayoutAux);
+  gst_structure_remove_field (windowsLayout, id.c_str() );
 }
 
+/* The detector copies the whole layout, so it is set once per change */
 void
-PointerDetectorFilter::removeWindow (std::string id)
+PointerDetectorFilter::applyWindowsLayout ()
 {
-  GstStructure *buttonsLayout;
-  gint len;
+  g_object_set (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, windowsLayout, NULL);
+}
 
-  /* The function obtains the actual window list */
-  g_object_get (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, &buttonsLayout, NULL);
-  len = gst_structure_n_fields (buttonsLayout);
+/* Read back from the detector, so it tells what it really got */
+std::string
+PointerDetectorFilter::getWindows ()
+{
+  GstStructure *layout = NULL;
+  std::string windows;
 
-  if (len == 0) {
-    GST_WARNING ("There are no windows in the layout");
-    return;
-  }
+  g_object_get (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, &layout, NULL);
 
-  for (int i = 0; i < len; i++) {
-    const gchar *name;
-    name = gst_structure_nth_field_name (buttonsLayout, i);
+  if (layout == NULL)
+    return windows;
 
-    if ( g_strcmp0 (name, id.c_str() ) == 0) {
-      /* this window will be removed */
-      gst_structure_remove_field (buttonsLayout, name);
-    }
+  for (gint i = 0; i < gst_structure_n_fields (layout); i++) {
+    const gchar *id = gst_structure_nth_field_name (layout, i);
+    GstStructure *window;
+    gint x = 0, y = 0, width = 0, height = 0;
+
+    if (!gst_structure_get (layout, id, GST_TYPE_STRUCTURE, &window, NULL) )
+      continue;
+
+    gst_structure_get_int (window, "upRightCornerX", &x);
+    gst_structure_get_int (window, "upRightCornerY", &y);
+    gst_structure_get_int (window, "width", &width);
+    gst_structure_get_int (window, "height", &height);
+    gst_structure_free (window);
+
+    if (!windows.empty () )
+      windows += ";";
+
+    windows += std::string (id) + "," + std::to_string (x) + "," +
+               std::to_string (y) + "," + std::to_string (width) + "," +
+               std::to_string (height);
   }
 
-  /* Set the buttons layout list without the window with id = id */
-  g_object_set (G_OBJECT (pointerDetector), WINDOWS_LAYOUT, buttonsLayout, NULL);
+  gst_structure_free (layout);
+
+  return windows;
+}
+
+void
+PointerDetectorFilter::addWindow (KmsMediaPointerDetectorWindow window)
+{
+  windowsMutex.lock ();
+  setWindow (window);
+  applyWindowsLayout ();
+  windowsMutex.unlock ();
+}
 
-  gst_structure_free (buttonsLayout);
+void
+PointerDetectorFilter::removeWindow (std::string id)
+{
+  windowsMutex.lock ();
+  unsetWindow (id);
+  applyWindowsLayout ();
+  windowsMutex.unlock ();
 }
 
 void
 PointerDetectorFilter::clearWindows()
 {
-  GstStructure *buttonsLayout;
+  windowsMutex.lock ();
+  gst_structure_remove_all_fields (windowsLayout);
+  applyWindowsLayout ();
+  windowsMutex.unlock ();
+}
 
-  buttonsLayout = gst_structure_new_empty  ("buttonsLayout");
-  g_object_set (G_OBJECT (this->pointerDetector), WINDOWS_LAYOUT, buttonsLayout, NULL);
-  gst_structure_free (buttonsLayout);
+void
+PointerDetectorFilter::setWindows (const std::set<KmsMediaPointerDetectorWindow> &add,
+                                   const std::list<std::string> &remove)
+{
+  windowsMutex.lock ();
+
+  for (auto it = remove.begin(); it != remove.end(); it++)
+    unsetWindow (*it);
+
+  for (auto it = add.begin(); it != add.end(); it++)
+    setWindow (*it);
+
+  applyWindowsLayout ();
+  windowsMutex.unlock ();
 }
 
 void
@@ -269,6 +312,38 @@ throw (KmsMediaServerException)
     removeWindow (id);
   } else if (g_KmsMediaPointerDetectorFilterType_constants.CLEAR_WINDOWS.compare (command) == 0) {
     clearWindows();
+  } else if (POINTER_DETECTOR_SET_WINDOWS == command) {
+    KmsMediaPointerDetectorWindowSet add;
+    std::list<std::string> remove;
+    const KmsMediaParam *p;
+
+    p = getParam (params, POINTER_DETECTOR_SET_WINDOWS_PARAM_ADD);
+
+    if (p != NULL)
+      unmarshalStruct (add, p->data);
+
+    p = getParam (params, POINTER_DETECTOR_SET_WINDOWS_PARAM_REMOVE);
+
+    if (p != NULL) {
+      std::string ids;
+      gchar **idv;
+
+      unmarshalStringParam (ids, *p);
+      idv = g_strsplit (ids.c_str(), ";", -1);
+
+      for (gchar **id = idv; *id != NULL; id++) {
+        if ( (*id) [0] != '\0')
+          remove.push_back (*id);
+      }
+
+      g_strfreev (idv);
+    }
+
+    setWindows (add.windows, remove);
+  } else if (POINTER_DETECTOR_GET_WINDOWS == command) {
+    createStringInvocationReturn (_return, getWindows () );
+  } else {
+    Filter::invoke (_return, command, params);
   }
 }
 
@@ -278,11 +353,11 @@ PointerDetectorFilter::subscribe (std::string &_return, const std::string &event
                                   const int32_t handlerPort)
 throw (KmsMediaServerException)
 {
-  if (g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_IN == eventType)
-    mediaHandlerManager.addMediaHandler (_return, eventType, handlerAddress, handlerPort);
-  else  if (g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_OUT == eventType)
+  if (g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_IN == eventType ||
+      g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_OUT == eventType) {
     mediaHandlerManager.addMediaHandler (_return, eventType, handlerAddress, handlerPort);
-  else
+    updateAnalysisBypass ();
+  } else
     Filter::subscribe (_return, eventType, handlerAddress, handlerPort);
 }
 
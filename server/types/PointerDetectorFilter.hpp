@@ -19,6 +19,18 @@
 #include "Filter.hpp"
 #include "KmsMediaPointerDetectorFilterType_types.h"
 
+/* Invocation adding and removing many windows at once, so the detector */
+/* gets a single new layout. Windows are removed before adding others */
+#define POINTER_DETECTOR_SET_WINDOWS "setWindows"
+/* Optional KmsMediaPointerDetectorWindowSet param with the windows added */
+#define POINTER_DETECTOR_SET_WINDOWS_PARAM_ADD "add"
+/* Optional String param with the ids of the windows removed, separated */
+/* by ';' */
+#define POINTER_DETECTOR_SET_WINDOWS_PARAM_REMOVE "remove"
+/* Invocation returning the String layout the detector has, as */
+/* "id,x,y,width,height" windows separated by ';' */
+#define POINTER_DETECTOR_GET_WINDOWS "getWindows"
+
 namespace kurento
 {
 
@@ -41,10 +53,20 @@ private:
 
   GstElement *pointerDetector;
 
+  /* Kept here so changes do not need to get the layout from the detector */
+  Glib::Threads::Mutex windowsMutex;
+  GstStructure *windowsLayout = NULL;
+
   void raiseEvent (const std::string &type, const std::string &windowID);
   void addWindow(KmsMediaPointerDetectorWindow windowInfo);
   void removeWindow(std::string id);
   void clearWindows();
+  void setWindows (const std::set<KmsMediaPointerDetectorWindow> &add,
+                   const std::list<std::string> &remove);
+  void setWindow (const KmsMediaPointerDetectorWindow &window);
+  void unsetWindow (const std::string &id);
+  void applyWindowsLayout ();
+  std::string getWindows ();
   void subscribe (std::string &_return, const std::string &eventType,
                   const std::string &handlerAddress,
                   const int32_t handlerPort)
@@ -21,12 +21,16 @@
 #include "KmsMediaErrorCodes_constants.h"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "utils/marshalling.hpp"
+#include "httpendpointserver.hpp"
 
 #define GST_CAT_DEFAULT kurento_recorder_end_point
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoRecorderEndPoint"
 
+#define FINALIZATION_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
 namespace kurento
 {
 
@@ -35,7 +39,7 @@ RecorderEndPoint::init (std::shared_ptr<MediaPipeline> parent,
                         const std::string &uri,
                         KmsMediaProfile profile)
 {
-  element = gst_element_factory_make ("recorderendpoint", NULL);
+  element = MediaElementRegistry::getInstance ().makeElement ("recorderendpoint");
 
   g_object_set (G_OBJECT (element), "uri", uri.c_str(), NULL);
 
@@ -43,19 +47,20 @@ RecorderEndPoint::init (std::shared_ptr<MediaPipeline> parent,
   case KmsMediaMuxer::WEBM:
     //value 0 means KMS_RECORDING_PROFILE_WEBM
     g_object_set ( G_OBJECT (element), "profile", 0, NULL);
+    contentType = "video/webm";
     GST_INFO ("Set WEBM profile");
     break;
 
   case KmsMediaMuxer::MP4:
     //value 1 means KMS_RECORDING_PROFILE_MP4
     g_object_set ( G_OBJECT (element), "profile", 1, NULL);
+    contentType = "video/mp4";
     GST_INFO ("Set MP4 profile");
     break;
   }
 
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 }
 
 RecorderEndPoint::RecorderEndPoint (MediaSet &mediaSet,
@@ -63,7 +68,8 @@ RecorderEndPoint::RecorderEndPoint (MediaSet &mediaSet,
                                     const std::map<std::string, KmsMediaParam> &params)
 throw (KmsMediaServerException)
   : UriEndPoint (mediaSet, parent,
-                 g_KmsMediaRecorderEndPointType_constants.TYPE_NAME, params)
+                 g_KmsMediaRecorderEndPointType_constants.TYPE_NAME, params),
+  finalization (new Finalization () )
 {
   const KmsMediaParam *p;
   KmsMediaUriEndPointConstructorParams uriEpParams;
@@ -98,11 +104,251 @@ throw (KmsMediaServerException)
 
 RecorderEndPoint::~RecorderEndPoint() throw ()
 {
+  unregisterDownload ();
+
   gst_bin_remove (GST_BIN ( ( (std::shared_ptr<MediaPipeline> &) parent)->pipeline), element);
   gst_element_set_state (element, GST_STATE_NULL);
   g_object_unref (element);
 }
 
+std::string
+RecorderEndPoint::getDownloadUrl () throw (KmsMediaServerException)
+{
+  std::string url;
+  const gchar *path;
+  GError *err = NULL;
+  gchar *filename;
+  gchar *addr;
+  guint port;
+  gint state;
+
+  filename = g_filename_from_uri (getUri ().c_str (), NULL, NULL);
+
+  if (filename == NULL) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   "Only local recordings can be downloaded");
+    throw except;
+  }
+
+  /* Held until the file is registered so a START can not sneak in */
+  downloadMutex.lock ();
+  g_object_get (G_OBJECT (element), "state", &state, NULL);
+
+  if (state != 0 /* stop */ || !waitFinalization () ) {
+    KmsMediaServerException except;
+
+    downloadMutex.unlock ();
+    g_free (filename);
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   state != 0 ?
+                                   "Recording must be stopped before it is downloaded" :
+                                   "Recording is still being finalized");
+    throw except;
+  }
+
+  if (downloadPath.empty () ) {
+    path = kms_http_ep_server_register_file (httpepserver, filename,
+           contentType.empty () ? NULL : contentType.c_str (), &err);
+
+    if (path != NULL)
+      downloadPath = path;
+  }
+
+  path = downloadPath.empty () ? NULL : downloadPath.c_str ();
+
+  if (path != NULL) {
+    gchar *c_url;
+
+    g_object_get (G_OBJECT (httpepserver), "announced-address", &addr, "port",
+                  &port, NULL);
+    c_url = g_strdup_printf ("http://%s:%d%s", addr, port, path);
+    url = c_url;
+    g_free (c_url);
+    g_free (addr);
+  }
+
+  downloadMutex.unlock ();
+  g_free (filename);
+
+  if (url.empty () ) {
+    KmsMediaServerException except;
+    std::string message = "Cannot serve recording";
+
+    if (err != NULL) {
+      message += ": ";
+      message += err->message;
+      g_error_free (err);
+    }
+
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNEXPECTED_ERROR,
+                                   message);
+    throw except;
+  }
+
+  return url;
+}
+
+void
+RecorderEndPoint::unregisterDownload ()
+{
+  downloadMutex.lock ();
+
+  if (!downloadPath.empty () ) {
+    kms_http_ep_server_unregister_file (httpepserver, downloadPath.c_str () );
+    downloadPath.clear ();
+  }
+
+  downloadMutex.unlock ();
+}
+
+static GstPadProbeReturn
+finalization_eos_probe (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  auto finalization =
+    * (std::shared_ptr<RecorderEndPoint::Finalization> *) data;
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info) ) != GST_EVENT_EOS)
+    return GST_PAD_PROBE_OK;
+
+  GST_DEBUG ("Recording finalized in %" GST_PTR_FORMAT, pad);
+
+  finalization->mutex.lock ();
+  finalization->finished = true;
+  finalization->cond.broadcast ();
+  finalization->mutex.unlock ();
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+delete_finalization_ref (gpointer data)
+{
+  delete (std::shared_ptr<RecorderEndPoint::Finalization> *) data;
+}
+
+/* The file is complete once EOS reaches the sinks writing it, muxers */
+/* write their index when they get it */
+void
+RecorderEndPoint::watchFinalization ()
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  bool found = false;
+
+  finalization->mutex.lock ();
+  finalization->finished = false;
+  finalization->mutex.unlock ();
+
+  it = gst_bin_iterate_recurse (GST_BIN (element) );
+
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *child = GST_ELEMENT (g_value_get_object (&item) );
+    GstPad *sink;
+
+    if (!GST_IS_BIN (child) &&
+        GST_OBJECT_FLAG_IS_SET (child, GST_ELEMENT_FLAG_SINK) ) {
+      sink = gst_element_get_static_pad (child, "sink");
+
+      if (sink != NULL) {
+        gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                           finalization_eos_probe,
+                           new std::shared_ptr<Finalization> (finalization),
+                           delete_finalization_ref);
+        g_object_unref (sink);
+        found = true;
+      }
+    }
+
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  if (!found) {
+    /* Nothing to wait for, stop is all there is */
+    finalization->mutex.lock ();
+    finalization->finished = true;
+    finalization->mutex.unlock ();
+  }
+}
+
+bool
+RecorderEndPoint::waitFinalization ()
+{
+  gint64 end_time = g_get_monotonic_time () + FINALIZATION_TIMEOUT;
+  bool finished;
+
+  finalization->mutex.lock ();
+
+  while (!finalization->finished) {
+    if (!finalization->cond.wait_until (finalization->mutex, end_time) )
+      break;
+  }
+
+  finished = finalization->finished;
+  finalization->mutex.unlock ();
+
+  return finished;
+}
+
+void
+RecorderEndPoint::invoke (KmsMediaInvocationReturn &_return,
+                          const std::string &command,
+                          const std::map<std::string, KmsMediaParam> &params)
+throw (KmsMediaServerException)
+{
+  if (RECORDER_END_POINT_GET_DOWNLOAD_URL == command) {
+    createStringInvocationReturn (_return, getDownloadUrl () );
+    return;
+  }
+
+  if (g_KmsMediaUriEndPointType_constants.START.compare (command) == 0) {
+    /* File is going to change, it can not be served any more */
+    downloadMutex.lock ();
+
+    if (!downloadPath.empty () ) {
+      kms_http_ep_server_unregister_file (httpepserver, downloadPath.c_str () );
+      downloadPath.clear ();
+    }
+
+    try {
+      UriEndPoint::invoke (_return, command, params);
+    } catch (...) {
+      downloadMutex.unlock ();
+      throw;
+    }
+
+    downloadMutex.unlock ();
+    return;
+  }
+
+  if (g_KmsMediaUriEndPointType_constants.STOP.compare (command) == 0) {
+    gint state;
+
+    downloadMutex.lock ();
+    g_object_get (G_OBJECT (element), "state", &state, NULL);
+
+    /* Probes must be there before stop sends EOS */
+    if (state != 0 /* stop */)
+      watchFinalization ();
+
+    try {
+      UriEndPoint::invoke (_return, command, params);
+    } catch (...) {
+      downloadMutex.unlock ();
+      throw;
+    }
+
+    downloadMutex.unlock ();
+    return;
+  }
+
+  UriEndPoint::invoke (_return, command, params);
+}
+
 RecorderEndPoint::StaticConstructor RecorderEndPoint::staticConstructor;
 
 RecorderEndPoint::StaticConstructor::StaticConstructor()
@@ -19,6 +19,14 @@
 #include "UriEndPoint.hpp"
 #include "KmsMediaProfile_types.h"
 
+#include <glibmm.h>
+
+/* Invocation returning the http URL a stopped recording can be downloaded */
+/* from, without any media pipeline. It waits for the file to be finalized */
+/* after stop and is valid until recording starts again or the end point */
+/* is released */
+#define RECORDER_END_POINT_GET_DOWNLOAD_URL "getDownloadUrl"
+
 namespace kurento
 {
 
@@ -30,9 +38,30 @@ public:
   throw (KmsMediaServerException);
   ~RecorderEndPoint() throw ();
 
+  void invoke (KmsMediaInvocationReturn &_return, const std::string &command,
+               const std::map<std::string, KmsMediaParam> & params) throw (KmsMediaServerException);
+
+  /* Shared with the EOS probes so they can outlive the end point */
+  struct Finalization {
+    Glib::Threads::Mutex mutex;
+    Glib::Threads::Cond cond;
+    bool finished;
+
+    Finalization () : finished (true) {}
+  };
+
 private:
+  Glib::Threads::Mutex downloadMutex;
+  std::string downloadPath;
+  std::string contentType;
+  std::shared_ptr<Finalization> finalization;
+
   void init (std::shared_ptr<MediaPipeline> parent, const std::string &uri,
     KmsMediaProfile profile);
+  std::string getDownloadUrl () throw (KmsMediaServerException);
+  void unregisterDownload ();
+  void watchFinalization ();
+  bool waitFinalization ();
 
   class StaticConstructor
   {
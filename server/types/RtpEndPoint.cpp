@@ -17,6 +17,7 @@
 
 #include "KmsMediaRtpEndPointType_constants.h"
 #include "media_config.hpp"
+#include "common/ElementPool.hpp"
 
 #include "utils/utils.hpp"
 #include "KmsMediaDataType_constants.h"
@@ -28,12 +29,11 @@ namespace kurento
 void
 RtpEndPoint::init (std::shared_ptr<MediaPipeline> parent)
 {
-  element = gst_element_factory_make ("rtpendpoint", NULL);
+  element = ElementPool::getInstance ().acquire ("rtpendpoint");
 
-  g_object_set (element, "pattern-sdp", sdpPattern, NULL);
+  g_object_set (element, "pattern-sdp", getSdpPattern (), NULL);
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 }
 
 RtpEndPoint::RtpEndPoint (MediaSet &mediaSet,
@@ -18,7 +18,7 @@
 #include "KmsMediaErrorCodes_constants.h"
 #include "KmsMediaSdpEndPointType_constants.h"
 #include "KmsMediaSessionEndPointType_constants.h"
-#include <gst/sdp/gstsdpmessage.h>
+#include "media_config.hpp"
 #include "utils/utils.hpp"
 #include "utils/marshalling.hpp"
 
@@ -39,7 +39,9 @@ SdpEndPoint::SdpEndPoint (MediaSet &mediaSet,
 
 SdpEndPoint::~SdpEndPoint() throw ()
 {
-
+  /* Subclasses have already released the element using it */
+  if (sdpPatternCopy != NULL)
+    gst_sdp_message_free (sdpPatternCopy);
 }
 
 static GstSDPMessage *
@@ -84,6 +86,39 @@ sdp_to_str (std::string &_return, const GstSDPMessage *sdp)
   free (sdpGchar);
 }
 
+GstSDPMessage *
+SdpEndPoint::getSdpPattern ()
+{
+  std::string pattern, filtered;
+  gchar **lines;
+  bool keep = true;
+
+  if (sdpPatternCopy != NULL)
+    return sdpPatternCopy;
+
+  sdp_to_str (pattern, sdpPattern);
+  lines = g_strsplit (pattern.c_str(), "\r\n", -1);
+
+  /* Each m-line starts a section that lasts until the next one */
+  for (gchar **line = lines; *line != NULL; line++) {
+    if (g_str_has_prefix (*line, "m=audio") )
+      keep = hasMediaType (KmsMediaType::type::AUDIO);
+    else if (g_str_has_prefix (*line, "m=video") )
+      keep = hasMediaType (KmsMediaType::type::VIDEO);
+    else if (g_str_has_prefix (*line, "m=") )
+      keep = true;
+
+    if (keep && (*line) [0] != '\0')
+      filtered += std::string (*line) + "\r\n";
+  }
+
+  g_strfreev (lines);
+
+  sdpPatternCopy = str_to_sdp (filtered);
+
+  return sdpPatternCopy;
+}
+
 void
 SdpEndPoint::generateOffer (std::string &_return)
 {
@@ -18,6 +18,8 @@
 
 #include "EndPoint.hpp"
 
+#include <gst/sdp/gstsdpmessage.h>
+
 namespace kurento
 {
 
@@ -41,7 +43,13 @@ public:
   void invoke (KmsMediaInvocationReturn &_return, const std::string &command,
                const std::map<std::string, KmsMediaParam> & params) throw (KmsMediaServerException);
 
+protected:
+  /* Copy of the configured pattern without the m-lines of the media */
+  /* types the element has no pads for. It is kept until destruction */
+  GstSDPMessage *getSdpPattern ();
+
 private:
+  GstSDPMessage *sdpPatternCopy = NULL;
 
   class StaticConstructor
   {
@@ -59,6 +59,16 @@ UriEndPoint::getUri ()
   return uri;
 }
 
+int
+UriEndPoint::getState ()
+{
+  gint state;
+
+  g_object_get (G_OBJECT (element), "state", &state, NULL);
+
+  return state;
+}
+
 void
 UriEndPoint::start ()
 {
@@ -85,6 +95,8 @@ throw (KmsMediaServerException)
 {
   if (g_KmsMediaUriEndPointType_constants.GET_URI.compare (command) == 0) {
     createStringInvocationReturn (_return, getUri () );
+  } else if (URI_END_POINT_GET_STATE == command) {
+    createI32InvocationReturn (_return, getState () );
   } else if (g_KmsMediaUriEndPointType_constants.START.compare (command) == 0) {
     start ();
     createVoidInvocationReturn (_return);
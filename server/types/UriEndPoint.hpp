@@ -20,6 +20,10 @@
 
 #include "KmsMediaUriEndPointType_types.h"
 
+/* Invocation returning the I32 state the element is in: 0 stopped, */
+/* 1 started and 2 paused */
+#define URI_END_POINT_GET_STATE "getState"
+
 namespace kurento
 {
 
@@ -32,9 +36,10 @@ public:
   virtual ~UriEndPoint() throw ();
 
   std::string getUri ();
-  void start ();
-  void pause ();
-  void stop ();
+  int getState ();
+  virtual void start ();
+  virtual void pause ();
+  virtual void stop ();
 
   void invoke (KmsMediaInvocationReturn &_return,
                const std::string &command,
@@ -16,6 +16,7 @@
 #include "WebRtcEndPoint.hpp"
 #include "utils/utils.hpp"
 #include "media_config.hpp"
+#include "common/ElementPool.hpp"
 
 #include "KmsMediaWebRtcEndPointType_constants.h"
 #include "KmsMediaErrorCodes_constants.h"
@@ -33,8 +34,8 @@ WebRtcEndPoint::WebRtcEndPoint (MediaSet &mediaSet,
   : SdpEndPoint (mediaSet, parent,
                  g_KmsMediaWebRtcEndPointType_constants.TYPE_NAME, params)
 {
-  element = gst_element_factory_make ("webrtcendpoint", NULL);
-  g_object_set (element, "pattern-sdp", sdpPattern, NULL);
+  element = ElementPool::getInstance ().acquire ("webrtcendpoint");
+  g_object_set (element, "pattern-sdp", getSdpPattern (), NULL);
 
   //set properties
   GST_INFO ("stun port %d\n", stunServerPort);
@@ -54,8 +55,7 @@ WebRtcEndPoint::WebRtcEndPoint (MediaSet &mediaSet,
   }
 
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 }
 
 WebRtcEndPoint::~WebRtcEndPoint() throw ()
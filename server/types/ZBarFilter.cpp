@@ -18,6 +18,7 @@
 #include "KmsMediaZBarFilterType_constants.h"
 
 #include "utils/utils.hpp"
+#include "common/MediaElementRegistry.hpp"
 #include "KmsMediaDataType_constants.h"
 #include "KmsMediaErrorCodes_constants.h"
 
@@ -28,6 +29,9 @@
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoZBarFilter"
 
+/* zbar only scans the luma plane, I420 keeps colour for the viewers */
+#define ZBAR_ANALYSIS_FORMAT "I420"
+
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::protocol::TBinaryProtocol;
 
@@ -67,12 +71,11 @@ zbar_receive_message (GstBus *bus, GstMessage *message, gpointer zbar)
 void
 ZBarFilter::init (std::shared_ptr<MediaPipeline> parent)
 {
-  element = gst_element_factory_make ("filterelement", NULL);
+  element = MediaElementRegistry::getInstance ().makeElement ("filterelement");
 
   g_object_set (element, "filter-factory", "zbar", NULL);
   g_object_ref (element);
-  gst_bin_add (GST_BIN (parent->pipeline), element);
-  gst_element_sync_state_with_parent (element);
+  parent->addElement (element);
 
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (parent->pipeline) );
   GstElement *zbar;
@@ -80,7 +83,11 @@ ZBarFilter::init (std::shared_ptr<MediaPipeline> parent)
   g_object_get (G_OBJECT (element), "filter", &zbar, NULL);
 
   this->zbar = zbar;
+  /* QoS would drop late frames from the output too, the analysis rate is */
+  /* lowered by the filter analysis params instead */
   g_object_set (G_OBJECT (zbar), "qos", FALSE, NULL);
+  initAnalysis ();
+  addAnalysisEventType (g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND);
 
   bus_handler_id = g_signal_connect (bus, "message", G_CALLBACK (zbar_receive_message), this);
   g_object_unref (bus);
@@ -92,7 +99,8 @@ ZBarFilter::ZBarFilter (MediaSet &mediaSet,
                         std::shared_ptr<MediaPipeline> parent,
                         const std::map<std::string, KmsMediaParam> &params)
 throw (KmsMediaServerException)
-  : Filter (mediaSet, parent, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params)
+  : Filter (mediaSet, parent, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params,
+            ZBAR_ANALYSIS_FORMAT)
 {
   init (parent);
 }
@@ -152,9 +160,10 @@ ZBarFilter::subscribe (std::string &_return, const std::string &eventType,
                        const std::string &handlerAddress,
                        const int32_t handlerPort) throw (KmsMediaServerException)
 {
-  if (g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND == eventType)
+  if (g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND == eventType) {
     mediaHandlerManager.addMediaHandler (_return, eventType, handlerAddress, handlerPort);
-  else
+    updateAnalysisBypass ();
+  } else
     Filter::subscribe (_return, eventType, handlerAddress, handlerPort);
 }
 
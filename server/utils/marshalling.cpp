@@ -155,6 +155,67 @@ unmarshalStringParam (std::string &_return, const KmsMediaParam &param) throw (K
   }
 }
 
+void
+marshalKmsMediaObjectRefMap (std::string &_return,
+                             const std::map<std::string, KmsMediaObjectRef> &refs)
+throw (KmsMediaServerException)
+{
+  boost::shared_ptr<TMemoryBuffer> transport (new TMemoryBuffer() );
+  TBinaryProtocol protocol (transport);
+
+  try {
+    protocol.writeMapBegin (apache::thrift::protocol::T_STRING,
+                            apache::thrift::protocol::T_STRUCT, refs.size () );
+
+    for (auto it = refs.begin(); it != refs.end(); it++) {
+      protocol.writeString (it->first);
+      it->second.write (&protocol);
+    }
+
+    protocol.writeMapEnd ();
+    _return.clear();
+    transport->appendBufferToString (_return);
+  } catch (...) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.MARSHALL_ERROR,
+                                   "Cannot marshal KmsMediaObjectRef map");
+    throw except;
+  }
+}
+
+void
+unmarshalKmsMediaObjectRefMap (std::map<std::string, KmsMediaObjectRef> &_return,
+                               const std::string &data)
+throw (KmsMediaServerException)
+{
+  boost::shared_ptr<TMemoryBuffer> transport;
+
+  try {
+    apache::thrift::protocol::TType keyType, valueType;
+    uint32_t size;
+
+    transport = boost::shared_ptr<TMemoryBuffer> (new TMemoryBuffer ( (uint8_t *) data.data(), data.size () ) );
+    TBinaryProtocol protocol = TBinaryProtocol (transport);
+    protocol.readMapBegin (keyType, valueType, size);
+
+    for (uint32_t i = 0; i < size; i++) {
+      std::string name;
+
+      protocol.readString (name);
+      _return[name].read (&protocol);
+    }
+
+    protocol.readMapEnd ();
+  } catch (...) {
+    KmsMediaServerException except;
+
+    createKmsMediaServerException (except, g_KmsMediaErrorCodes_constants.UNMARSHALL_ERROR,
+                                   "Cannot unmarshal KmsMediaObjectRef map");
+    throw except;
+  }
+}
+
 void
 createKmsMediaObjectConstructorParams (
   std::map<std::string, KmsMediaParam> & _return,
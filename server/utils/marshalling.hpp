@@ -108,6 +108,12 @@ throw (KmsMediaServerException)
   createStringParam ( (KmsMediaParam &) _return, data);
 }
 
+inline void createI32InvocationReturn (KmsMediaInvocationReturn &_return, const int32_t i)
+throw (KmsMediaServerException)
+{
+  createI32Param ( (KmsMediaParam &) _return, i);
+}
+
 inline void unmarshalStringInvocationReturn (std::string &_return,
     const KmsMediaInvocationReturn &invocationReturn)
 throw (KmsMediaServerException)
@@ -126,6 +132,13 @@ throw (KmsMediaServerException)
   unmarshalStringParam (_return, (KmsMediaEventData) eventData);
 }
 
+void marshalKmsMediaObjectRefMap (std::string &_return,
+                                  const std::map<std::string, KmsMediaObjectRef> &refs)
+throw (KmsMediaServerException);
+void unmarshalKmsMediaObjectRefMap (std::map<std::string, KmsMediaObjectRef> &_return,
+                                    const std::string &data)
+throw (KmsMediaServerException);
+
 void createKmsMediaObjectConstructorParams (std::map<std::string, KmsMediaParam> & _return,
     bool excludeFromGC, int32_t garbageCollectorPeriod = g_KmsMediaServer_constants.DEFAULT_GARBAGE_COLLECTOR_PERIOD)
 throw (KmsMediaServerException);
@@ -113,4 +113,18 @@ getParam (const std::map<std::string, KmsMediaParam> &params, const std::string
   return NULL;
 }
 
+GstEvent *
+createForceKeyUnitEvent ()
+{
+  GstStructure *s;
+
+  /* Same as gst_video_event_new_upstream_force_key_unit */
+  s = gst_structure_new ("GstForceKeyUnit",
+                         "running-time", GST_TYPE_CLOCK_TIME, GST_CLOCK_TIME_NONE,
+                         "all-headers", G_TYPE_BOOLEAN, TRUE,
+                         "count", G_TYPE_UINT, 0, NULL);
+
+  return gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, s);
+}
+
 } // kurento
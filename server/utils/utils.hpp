@@ -18,6 +18,8 @@
 
 #include "KmsMediaServer_types.h"
 
+#include <gst/gst.h>
+
 namespace kurento
 {
 
@@ -34,6 +36,9 @@ void setStringParam (std::map<std::string, KmsMediaParam>& params, const std::st
 
 const KmsMediaParam *getParam (const std::map<std::string, KmsMediaParam>& params, const std::string &paramName);
 
+/* Upstream event asking encoders for a key frame with all its headers */
+GstEvent *createForceKeyUnitEvent ();
+
 } // kurento
 
 #endif /* __UTILS_HPP__ */
@@ -0,0 +1,247 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#define BOOST_TEST_MODULE element_pool_test
+#include <boost/test/unit_test.hpp>
+
+#include "common/ElementPool.hpp"
+#include "media_config.hpp"
+#include "httpendpointserver.hpp"
+
+/* Normally defined by main.cpp */
+GstSDPMessage *sdpPattern;
+KmsHttpEPServer *httpepserver;
+std::string stunServerAddress, pemCertificate;
+gint stunServerPort;
+
+#define POOL_SIZE 2
+#define REFILL_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+using namespace kurento;
+
+struct GstInit {
+  GstInit () {
+    gst_init (NULL, NULL);
+  }
+};
+
+BOOST_GLOBAL_FIXTURE (GstInit);
+
+static bool
+wait_available (ElementPool &pool, const std::string &factory, guint n)
+{
+  gint64 end_time = g_get_monotonic_time () + REFILL_TIMEOUT;
+
+  while (pool.getAvailable (factory) != n) {
+    if (g_get_monotonic_time () > end_time)
+      return false;
+
+    g_usleep (10000);
+  }
+
+  return true;
+}
+
+static bool
+has_metric (ElementPool &pool, const std::string &metric)
+{
+  std::string metrics;
+
+  pool.collect (metrics);
+
+  return metrics.find (metric) != std::string::npos;
+}
+
+BOOST_AUTO_TEST_SUITE (element_pool_test)
+
+BOOST_AUTO_TEST_CASE ( acquire_without_pool )
+{
+  ElementPool pool;
+  GstElement *element;
+
+  element = pool.acquire ("fakesink");
+  BOOST_REQUIRE (element != NULL);
+  BOOST_CHECK (g_object_is_floating (element) );
+  BOOST_CHECK_EQUAL (pool.getAvailable ("fakesink"), 0);
+
+  gst_object_unref (gst_object_ref_sink (element) );
+}
+
+BOOST_AUTO_TEST_CASE ( acquire_refills_pool )
+{
+  ElementPool pool;
+  GstElement *element;
+
+  pool.setSize ("fakesink", POOL_SIZE);
+  BOOST_REQUIRE (wait_available (pool, "fakesink", POOL_SIZE) );
+
+  element = pool.acquire ("fakesink");
+  BOOST_REQUIRE (element != NULL);
+  /* Owned by the caller as if it was just created */
+  BOOST_CHECK (g_object_is_floating (element) );
+  BOOST_CHECK_EQUAL (GST_STATE (element), GST_STATE_NULL);
+  BOOST_CHECK (has_metric (pool,
+                           "kms_element_pool_hits_total{factory=\"fakesink\"} 1\n") );
+
+  BOOST_CHECK (wait_available (pool, "fakesink", POOL_SIZE) );
+
+  gst_object_unref (gst_object_ref_sink (element) );
+
+  /* Shrinking drops the extra elements right away */
+  pool.setSize ("fakesink", 1);
+  BOOST_CHECK_EQUAL (pool.getAvailable ("fakesink"), 1);
+}
+
+BOOST_AUTO_TEST_CASE ( acquire_pipeline_playing )
+{
+  ElementPool pool;
+  GstElement *pipeline;
+
+  pool.setSize (ELEMENT_POOL_PIPELINE, 1);
+  BOOST_REQUIRE (wait_available (pool, ELEMENT_POOL_PIPELINE, 1) );
+
+  pipeline = pool.acquire (ELEMENT_POOL_PIPELINE);
+  BOOST_REQUIRE (pipeline != NULL);
+  BOOST_CHECK (GST_IS_PIPELINE (pipeline) );
+  BOOST_CHECK_EQUAL (GST_STATE (pipeline), GST_STATE_PLAYING);
+
+  gst_object_ref_sink (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+BOOST_AUTO_TEST_CASE ( reset_pipeline_is_clean )
+{
+  GstElement *pipeline;
+  GstClockTime running_time;
+  GstMessage *msg;
+  GstClock *clock;
+  GstBus *bus;
+
+  pipeline = gst_pipeline_new (NULL);
+  g_object_set (G_OBJECT (pipeline), "async-handling", TRUE, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* Leave behind what a used pipeline has */
+  gst_pipeline_set_delay (GST_PIPELINE (pipeline), GST_SECOND);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
+  gst_bus_post (bus, gst_message_new_application (GST_OBJECT (pipeline),
+                gst_structure_new_empty ("stale") ) );
+  g_usleep (G_USEC_PER_SEC / 2);
+
+  BOOST_REQUIRE (ElementPool::resetPipeline (pipeline) );
+
+  BOOST_CHECK_EQUAL (GST_STATE (pipeline), GST_STATE_PLAYING);
+  BOOST_CHECK_EQUAL (gst_pipeline_get_delay (GST_PIPELINE (pipeline) ), 0);
+
+  msg = gst_bus_pop_filtered (bus, GST_MESSAGE_APPLICATION);
+  BOOST_CHECK (msg == NULL);
+
+  if (msg != NULL)
+    gst_message_unref (msg);
+
+  /* Running time starts again as in a new pipeline */
+  clock = gst_element_get_clock (pipeline);
+  BOOST_REQUIRE (clock != NULL);
+  running_time = gst_clock_get_time (clock) -
+                 gst_element_get_base_time (pipeline);
+  BOOST_CHECK (running_time < GST_SECOND / 4);
+  gst_object_unref (clock);
+
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+BOOST_AUTO_TEST_CASE ( release_recycles_empty_pipeline )
+{
+  ElementPool pool;
+  GstElement *pipeline, *other;
+  bool recycled = false;
+  gint i;
+
+  /* Refill thread competes for the same room, retry when it wins */
+  for (i = 0; i < 10 && !recycled; i++) {
+    pool.setSize (ELEMENT_POOL_PIPELINE, 0);
+    pool.setSize (ELEMENT_POOL_PIPELINE, 1);
+    BOOST_REQUIRE (wait_available (pool, ELEMENT_POOL_PIPELINE, 1) );
+
+    pipeline = pool.acquire (ELEMENT_POOL_PIPELINE);
+    gst_object_ref_sink (pipeline);
+    other = pool.acquire (ELEMENT_POOL_PIPELINE);
+    gst_object_ref_sink (other);
+
+    g_object_ref (pipeline);
+    pool.releasePipeline (pipeline);
+
+    BOOST_REQUIRE (wait_available (pool, ELEMENT_POOL_PIPELINE, 1) );
+    recycled = GST_OBJECT_REFCOUNT_VALUE (pipeline) > 1;
+
+    if (recycled) {
+      GstElement *element = pool.acquire (ELEMENT_POOL_PIPELINE);
+
+      BOOST_CHECK (element == pipeline);
+      BOOST_CHECK_EQUAL (GST_STATE (element), GST_STATE_PLAYING);
+      gst_object_unref (gst_object_ref_sink (element) );
+    }
+
+    gst_element_set_state (other, GST_STATE_NULL);
+    gst_object_unref (other);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (pipeline);
+  }
+
+  BOOST_CHECK (recycled);
+}
+
+BOOST_AUTO_TEST_CASE ( release_destroys_busy_pipeline )
+{
+  ElementPool pool;
+  GstElement *pipeline;
+
+  pool.setSize (ELEMENT_POOL_PIPELINE, 1);
+  BOOST_REQUIRE (wait_available (pool, ELEMENT_POOL_PIPELINE, 1) );
+
+  pipeline = pool.acquire (ELEMENT_POOL_PIPELINE);
+  gst_object_ref_sink (pipeline);
+  gst_bin_add (GST_BIN (pipeline), gst_element_factory_make ("fakesink",
+               NULL) );
+  BOOST_REQUIRE (wait_available (pool, ELEMENT_POOL_PIPELINE, 1) );
+  pool.setSize (ELEMENT_POOL_PIPELINE, 2);
+
+  /* Pipelines with elements left are never reused, even with room */
+  g_object_ref (pipeline);
+  pool.releasePipeline (pipeline);
+  BOOST_CHECK_EQUAL (GST_OBJECT_REFCOUNT_VALUE (pipeline), 1);
+  BOOST_CHECK_EQUAL (GST_STATE (pipeline), GST_STATE_NULL);
+
+  gst_object_unref (pipeline);
+}
+
+BOOST_AUTO_TEST_CASE ( saved_time_is_estimated )
+{
+  ElementPool pool;
+
+  pool.setSize ("fakesink", 1);
+  BOOST_REQUIRE (wait_available (pool, "fakesink", 1) );
+  gst_object_unref (gst_object_ref_sink (pool.acquire ("fakesink") ) );
+
+  BOOST_CHECK (has_metric (pool,
+                           "kms_element_pool_estimated_saved_microseconds_total"
+                           "{factory=\"fakesink\"}") );
+  BOOST_CHECK (!has_metric (pool, "kms_element_pool_saved_microseconds_total") );
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,756 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+/* Load generator for KmsHttpEPServer. Http end points are fed by appsrc */
+/* elements pushing synthetic VP8 frames, while a client thread with its */
+/* own main context keeps thousands of GET and multipart POST requests */
+/* open over loopback. Results are written as a single JSON object so */
+/* they can be compared between commits */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+#include <libsoup/soup.h>
+#include <KmsHttpEPServer.h>
+
+#define GST_CAT_DEFAULT _http_ep_server_benchmark_
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "http_ep_server_benchmark"
+
+#define DEFAULT_HOST "localhost"
+#define DISCONNECTION_TIMEOUT 2 /* seconds */
+#define POST_BOUNDARY "kmsbenchmarkboundary"
+
+static gint get_clients = 1000;
+static gint get_end_points = 100;
+static gint post_clients = 100;
+static gint duration = 10;
+static gint port = 9092;
+static gint workers = 0;
+static gint payload_size = 1400;
+static gint rate = 30;
+static gint keyframe_interval = 30;
+static gint coalesce_size = 64 * 1024;
+static gint coalesce_latency = 20;
+static gint register_interval = 100;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+  {
+    "get-clients", 'g', 0, G_OPTION_ARG_INT, &get_clients,
+    "Concurrent GET clients (default 1000)", "N"
+  },
+  {
+    "get-end-points", 'e', 0, G_OPTION_ARG_INT, &get_end_points,
+    "End points shared by GET clients (default 100)", "N"
+  },
+  {
+    "post-clients", 'p', 0, G_OPTION_ARG_INT, &post_clients,
+    "Concurrent multipart POST clients, each on its own end point "
+    "(default 100)", "N"
+  },
+  {
+    "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+    "Seconds the load is kept (default 10)", "SECONDS"
+  },
+  {
+    "port", 0, 0, G_OPTION_ARG_INT, &port, "Server port (default 9092)",
+    "PORT"
+  },
+  {
+    "workers", 'w', 0, G_OPTION_ARG_INT, &workers,
+    "Server worker threads (default 0)", "N"
+  },
+  {
+    "payload", 0, 0, G_OPTION_ARG_INT, &payload_size,
+    "Bytes of every frame pushed or posted (default 1400)", "BYTES"
+  },
+  {
+    "rate", 'r', 0, G_OPTION_ARG_INT, &rate,
+    "Frames per second of every stream (default 30)", "FPS"
+  },
+  {
+    "keyframe-interval", 0, 0, G_OPTION_ARG_INT, &keyframe_interval,
+    "Frames between key frames (default 30)", "N"
+  },
+  {
+    "coalesce-size", 0, 0, G_OPTION_ARG_INT, &coalesce_size,
+    "Server coalesce-size property (default 65536)", "BYTES"
+  },
+  {
+    "coalesce-latency", 0, 0, G_OPTION_ARG_INT, &coalesce_latency,
+    "Server coalesce-latency property (default 20)", "MS"
+  },
+  {
+    "register-interval", 0, 0, G_OPTION_ARG_INT, &register_interval,
+    "Milliseconds between end points registered while clients are "
+    "streaming, 0 disables it (default 100)", "MS"
+  },
+  {
+    "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+    "Append results to this file instead of stdout", "FILE"
+  },
+  {NULL}
+};
+
+typedef struct _BenchClient {
+  SoupMessage *msg;
+  gchar *url;
+  gint64 start;
+  gint64 ttfb;
+  guint64 bytes;
+  guint64 chunks;
+  gboolean failed;
+} BenchClient;
+
+typedef struct _BenchSnapshot {
+  gint64 time;
+  gint64 process_cpu;
+  gint64 thread_cpu;
+  glong rss;
+} BenchSnapshot;
+
+static KmsHttpEPServer *httpepserver;
+static GMainLoop *loop;
+static GstElement *pipeline;
+static GSList *sources;
+static GThread *client_thread;
+static guint feed_id;
+static guint register_id;
+static guint64 frames;
+
+static GMainLoop *client_loop;
+static SoupSession *session;
+static BenchClient *clients;
+static gint n_clients;
+static gchar *post_payload;
+
+static GArray *register_times;
+static GArray *loaded_register_times;
+static BenchSnapshot before, after;
+
+static gint64
+timeval_to_us (struct timeval *tv)
+{
+  return (gint64) tv->tv_sec * G_USEC_PER_SEC + tv->tv_usec;
+}
+
+static gint64
+get_cpu_time (int who)
+{
+  struct rusage usage;
+
+  if (getrusage (who, &usage) != 0)
+    return 0;
+
+  return timeval_to_us (&usage.ru_utime) + timeval_to_us (&usage.ru_stime);
+}
+
+/* Resident set size of the whole process in KiB */
+static glong
+get_rss ()
+{
+  gchar *contents, *line;
+  glong rss = 0;
+
+  if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL) )
+    return 0;
+
+  line = strstr (contents, "VmRSS:");
+
+  if (line != NULL)
+    rss = strtol (line + strlen ("VmRSS:"), NULL, 10);
+
+  g_free (contents);
+
+  return rss;
+}
+
+/* Must be called from the client thread so its own CPU time can be */
+/* subtracted from the one of the server */
+static void
+take_snapshot (BenchSnapshot *snapshot)
+{
+  snapshot->time = g_get_monotonic_time ();
+  snapshot->process_cpu = get_cpu_time (RUSAGE_SELF);
+  snapshot->thread_cpu = get_cpu_time (RUSAGE_THREAD);
+  snapshot->rss = get_rss ();
+}
+
+static void
+raise_fd_limit ()
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) != 0)
+    return;
+
+  limit.rlim_cur = limit.rlim_max;
+
+  if (setrlimit (RLIMIT_NOFILE, &limit) != 0)
+    GST_WARNING ("Can not raise the limit of open files");
+}
+
+static gint
+compare_int64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = * (const gint64 *) a;
+  gint64 y = * (const gint64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Sorts @values and returns the requested percentile */
+static gint64
+percentile (GArray *values, gdouble p)
+{
+  guint index;
+
+  if (values->len == 0)
+    return -1;
+
+  g_array_sort (values, compare_int64);
+  index = (guint) (p * (values->len - 1) );
+
+  return g_array_index (values, gint64, index);
+}
+
+/********************************************/
+/*         Client thread functions          */
+/********************************************/
+
+static void
+got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
+{
+  BenchClient *client = (BenchClient *) data;
+
+  if (client->ttfb < 0)
+    client->ttfb = g_get_monotonic_time () - client->start;
+
+  client->bytes += chunk->length;
+  client->chunks++;
+}
+
+static void
+wrote_body_data_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
+{
+  BenchClient *client = (BenchClient *) data;
+
+  if (client->ttfb < 0)
+    client->ttfb = g_get_monotonic_time () - client->start;
+
+  client->bytes += chunk->length;
+  client->chunks++;
+}
+
+static void
+request_finished_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  BenchClient *client = (BenchClient *) data;
+
+  /* Requests are expected to be alive until the benchmark cancels them */
+  if (msg->status_code != SOUP_STATUS_CANCELLED) {
+    GST_WARNING ("Request to %s finished with status %d", client->url,
+                 msg->status_code);
+    client->failed = TRUE;
+  }
+
+  client->msg = NULL;
+}
+
+static gboolean
+post_data_cb (gpointer data)
+{
+  gint i;
+
+  for (i = get_clients; i < n_clients; i++) {
+    BenchClient *client = &clients[i];
+
+    if (client->msg == NULL)
+      continue;
+
+    soup_message_body_append (client->msg->request_body, SOUP_MEMORY_STATIC,
+                              post_payload, payload_size);
+    soup_session_unpause_message (session, client->msg);
+  }
+
+  return TRUE;
+}
+
+static void
+queue_get (BenchClient *client)
+{
+  client->msg = soup_message_new (SOUP_METHOD_GET, client->url);
+
+  /* Do not keep received media, it would be accounted as server memory */
+  soup_message_body_set_accumulate (client->msg->response_body, FALSE);
+  g_signal_connect (client->msg, "got-chunk", G_CALLBACK (got_chunk_cb),
+                    client);
+}
+
+static void
+queue_post (BenchClient *client)
+{
+  const gchar *part = "--" POST_BOUNDARY "\r\n"
+                      "Content-Type: video/webm\r\n\r\n";
+
+  client->msg = soup_message_new (SOUP_METHOD_POST, client->url);
+
+  soup_message_headers_set_encoding (client->msg->request_headers,
+                                     SOUP_ENCODING_CHUNKED);
+  soup_message_headers_replace (client->msg->request_headers, "Content-Type",
+                                "multipart/form-data; boundary=" POST_BOUNDARY);
+  soup_message_body_set_accumulate (client->msg->request_body, FALSE);
+  soup_message_body_append (client->msg->request_body, SOUP_MEMORY_STATIC,
+                            part, strlen (part) );
+  g_signal_connect (client->msg, "wrote-body-data",
+                    G_CALLBACK (wrote_body_data_cb), client);
+}
+
+static gboolean
+stop_clients_cb (gpointer data)
+{
+  take_snapshot (&after);
+  soup_session_abort (session);
+  g_main_loop_quit (client_loop);
+
+  return FALSE;
+}
+
+static gpointer
+client_thread_func (gpointer data)
+{
+  GMainContext *context;
+  GSource *source;
+  gint i;
+
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+  client_loop = g_main_loop_new (context, FALSE);
+
+  session = soup_session_async_new_with_options (SOUP_SESSION_ASYNC_CONTEXT,
+            context, SOUP_SESSION_MAX_CONNS, n_clients,
+            SOUP_SESSION_MAX_CONNS_PER_HOST, n_clients, NULL);
+
+  take_snapshot (&before);
+
+  for (i = 0; i < n_clients; i++) {
+    BenchClient *client = &clients[i];
+
+    if (i < get_clients)
+      queue_get (client);
+    else
+      queue_post (client);
+
+    client->start = g_get_monotonic_time ();
+    soup_session_queue_message (session, client->msg, request_finished_cb,
+                                client);
+  }
+
+  if (post_clients > 0) {
+    source = g_timeout_source_new (1000 / rate);
+    g_source_set_callback (source, post_data_cb, NULL, NULL);
+    g_source_attach (source, context);
+    g_source_unref (source);
+  }
+
+  source = g_timeout_source_new_seconds (duration);
+  g_source_set_callback (source, stop_clients_cb, NULL, NULL);
+  g_source_attach (source, context);
+  g_source_unref (source);
+
+  g_main_loop_run (client_loop);
+
+  g_object_unref (session);
+  g_main_loop_unref (client_loop);
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+
+  g_main_loop_quit (loop);
+
+  return NULL;
+}
+
+/********************************************/
+/*          Server side functions           */
+/********************************************/
+
+static gboolean
+feed_cb (gpointer data)
+{
+  GstBuffer *buffer;
+  GSList *l;
+
+  buffer = gst_buffer_new_allocate (NULL, payload_size, NULL);
+  gst_buffer_memset (buffer, 0, frames & 0xff, payload_size);
+
+  if (frames++ % keyframe_interval != 0)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  for (l = sources; l != NULL; l = l->next) {
+    GstFlowReturn ret;
+
+    g_signal_emit_by_name (l->data, "push-buffer", buffer, &ret);
+
+    if (ret != GST_FLOW_OK)
+      GST_WARNING ("Could not push buffer to %s",
+                   GST_ELEMENT_NAME (l->data) );
+  }
+
+  gst_buffer_unref (buffer);
+
+  return TRUE;
+}
+
+static void
+post_pad_added_cb (GstElement *httpep, GstPad *pad, gpointer data)
+{
+  GstElement *fakesink;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add (GST_BIN (pipeline), fakesink);
+  gst_element_sync_state_with_parent (fakesink);
+
+  if (gst_pad_link (pad, (GstPad *) fakesink->sinkpads->data) != GST_PAD_LINK_OK)
+    GST_WARNING ("Can not link %" GST_PTR_FORMAT, pad);
+}
+
+static gchar *
+register_end_point (GstElement *httpep, KmsHttpEPServerFlags flags)
+{
+  const gchar *uri;
+  gint64 elapsed;
+
+  elapsed = g_get_monotonic_time ();
+  uri = kms_http_ep_server_register_end_point_full (httpepserver, httpep,
+        DISCONNECTION_TIMEOUT, flags);
+  elapsed = g_get_monotonic_time () - elapsed;
+
+  if (uri == NULL)
+    return NULL;
+
+  g_array_append_val (register_times, elapsed);
+
+  return g_strdup_printf ("http://%s:%d%s", DEFAULT_HOST, port, uri);
+}
+
+/* Registration cost is also measured while the server is moving media, */
+/* that is when contention with workers on the server lock shows up */
+static gboolean
+register_under_load_cb (gpointer data)
+{
+  GstElement *httpep;
+  const gchar *uri;
+  gint64 elapsed;
+
+  httpep = gst_element_factory_make ("httpendpoint", NULL);
+  gst_object_ref_sink (httpep);
+
+  elapsed = g_get_monotonic_time ();
+  uri = kms_http_ep_server_register_end_point_full (httpepserver, httpep,
+        DISCONNECTION_TIMEOUT, KMS_HTTP_EP_SERVER_FLAG_NONE);
+  elapsed = g_get_monotonic_time () - elapsed;
+
+  if (uri != NULL) {
+    g_array_append_val (loaded_register_times, elapsed);
+    kms_http_ep_server_unregister_end_point (httpepserver, uri);
+  } else {
+    GST_WARNING ("Can not register end point under load");
+  }
+
+  gst_object_unref (httpep);
+
+  return TRUE;
+}
+
+static GstElement *
+create_get_end_point ()
+{
+  GstElement *appsrc, *agnosticbin, *httpep;
+  GstCaps *caps;
+
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  httpep = gst_element_factory_make ("httpendpoint", NULL);
+
+  if (appsrc == NULL || agnosticbin == NULL || httpep == NULL) {
+    GST_ERROR ("Missing elements, check GST_PLUGIN_PATH");
+    exit (1);
+  }
+
+  caps = gst_caps_new_simple ("video/x-vp8", "width", G_TYPE_INT, 320,
+                              "height", G_TYPE_INT, 240, "framerate",
+                              GST_TYPE_FRACTION, rate, 1, NULL);
+  g_object_set (appsrc, "is-live", TRUE, "do-timestamp", TRUE, "format",
+                GST_FORMAT_TIME, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add_many (GST_BIN (pipeline), appsrc, agnosticbin, httpep, NULL);
+  gst_element_link (appsrc, agnosticbin);
+  gst_element_link_pads (agnosticbin, NULL, httpep, "video_sink");
+
+  sources = g_slist_prepend (sources, appsrc);
+
+  return httpep;
+}
+
+static void
+http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  KmsHttpEPServerFlags flags = KMS_HTTP_EP_SERVER_FLAG_NONE;
+  GstElement *httpep = NULL;
+  gint i;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  /* Many viewers of the same end point need it to be shared */
+  if (get_clients > get_end_points)
+    flags = KMS_HTTP_EP_SERVER_FLAG_BROADCAST;
+
+  for (i = 0; i < n_clients; i++) {
+    BenchClient *client = &clients[i];
+
+    if (i < get_clients) {
+      if (i < get_end_points) {
+        httpep = create_get_end_point ();
+        client->url = register_end_point (httpep, flags);
+      } else {
+        client->url = g_strdup (clients[i % get_end_points].url);
+      }
+    } else {
+      httpep = gst_element_factory_make ("httpendpoint", NULL);
+      g_signal_connect (httpep, "pad-added", G_CALLBACK (post_pad_added_cb),
+                        NULL);
+      gst_bin_add (GST_BIN (pipeline), httpep);
+      client->url = register_end_point (httpep, KMS_HTTP_EP_SERVER_FLAG_NONE);
+    }
+
+    if (client->url == NULL) {
+      GST_ERROR ("Can not register end point for client %d", i);
+      g_main_loop_quit (loop);
+      return;
+    }
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  feed_id = g_timeout_add (1000 / rate, feed_cb, NULL);
+
+  client_thread = g_thread_new ("clients", client_thread_func, NULL);
+
+  if (register_interval > 0)
+    register_id = g_timeout_add (register_interval, register_under_load_cb,
+                                 NULL);
+}
+
+static void
+print_results ()
+{
+  guint64 get_bytes = 0, post_bytes = 0, get_chunks = 0, post_chunks = 0;
+  gint get_failures = 0, post_failures = 0, get_served = 0;
+  gdouble seconds, server_cpu;
+  GArray *ttfb;
+  GString *json;
+  gint i;
+
+  ttfb = g_array_new (FALSE, FALSE, sizeof (gint64) );
+
+  for (i = 0; i < n_clients; i++) {
+    BenchClient *client = &clients[i];
+
+    if (i < get_clients) {
+      get_bytes += client->bytes;
+      get_chunks += client->chunks;
+      get_failures += client->failed;
+
+      if (client->ttfb >= 0) {
+        g_array_append_val (ttfb, client->ttfb);
+        get_served++;
+      }
+    } else {
+      post_bytes += client->bytes;
+      post_chunks += client->chunks;
+      post_failures += client->failed;
+    }
+  }
+
+  seconds = (after.time - before.time) / (gdouble) G_USEC_PER_SEC;
+  server_cpu = (after.process_cpu - before.process_cpu) -
+               (after.thread_cpu - before.thread_cpu);
+
+  json = g_string_new ("{");
+  g_string_append_printf (json, "\"get_clients\": %d, \"get_end_points\": %d, "
+                          "\"post_clients\": %d, \"workers\": %d, "
+                          "\"payload\": %d, \"rate\": %d, "
+                          "\"coalesce_size\": %d, \"coalesce_latency\": %d, ",
+                          get_clients, get_end_points, post_clients, workers,
+                          payload_size, rate, coalesce_size, coalesce_latency);
+  g_string_append_printf (json, "\"duration_s\": %.3f, ", seconds);
+  g_string_append_printf (json, "\"get_served\": %d, \"get_failures\": %d, "
+                          "\"post_failures\": %d, ", get_served, get_failures,
+                          post_failures);
+  g_string_append_printf (json, "\"get_bytes\": %" G_GUINT64_FORMAT ", "
+                          "\"get_chunks\": %" G_GUINT64_FORMAT ", "
+                          "\"get_throughput_bps\": %.0f, ", get_bytes,
+                          get_chunks, get_bytes * 8 / seconds);
+  g_string_append_printf (json, "\"post_bytes\": %" G_GUINT64_FORMAT ", "
+                          "\"post_chunks\": %" G_GUINT64_FORMAT ", "
+                          "\"post_throughput_bps\": %.0f, ", post_bytes,
+                          post_chunks, post_bytes * 8 / seconds);
+  g_string_append_printf (json, "\"ttfb_us\": {\"p50\": %" G_GINT64_FORMAT
+                          ", \"p90\": %" G_GINT64_FORMAT ", \"p99\": %"
+                          G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT "}, ",
+                          percentile (ttfb, 0.5), percentile (ttfb, 0.9),
+                          percentile (ttfb, 0.99), percentile (ttfb, 1.0) );
+  g_string_append_printf (json, "\"register_us\": {\"p50\": %" G_GINT64_FORMAT
+                          ", \"p99\": %" G_GINT64_FORMAT ", \"max\": %"
+                          G_GINT64_FORMAT "}, ",
+                          percentile (register_times, 0.5),
+                          percentile (register_times, 0.99),
+                          percentile (register_times, 1.0) );
+  g_string_append_printf (json, "\"register_loaded_us\": {\"samples\": %u, "
+                          "\"p50\": %" G_GINT64_FORMAT ", \"p99\": %"
+                          G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT
+                          "}, ", loaded_register_times->len,
+                          percentile (loaded_register_times, 0.5),
+                          percentile (loaded_register_times, 0.99),
+                          percentile (loaded_register_times, 1.0) );
+  g_string_append_printf (json, "\"server_cpu_percent\": %.2f, "
+                          "\"cpu_us_per_connection_s\": %.2f, ",
+                          100 * server_cpu / (seconds * G_USEC_PER_SEC),
+                          server_cpu / seconds / n_clients);
+  g_string_append_printf (json, "\"rss_before_kb\": %ld, \"rss_after_kb\": %ld, "
+                          "\"rss_kb_per_connection\": %.2f}\n",
+                          before.rss, after.rss,
+                          (after.rss - before.rss) / (gdouble) n_clients);
+
+  if (output != NULL) {
+    FILE *file = fopen (output, "a");
+
+    if (file == NULL) {
+      g_printerr ("Can not open %s\n", output);
+    } else {
+      fputs (json->str, file);
+      fclose (file);
+    }
+  } else {
+    fputs (json->str, stdout);
+  }
+
+  g_string_free (json, TRUE);
+  g_array_free (ttfb, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gint i;
+
+  context = g_option_context_new ("- load generator for KmsHttpEPServer");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group () );
+
+  if (!g_option_context_parse (context, &argc, &argv, &error) ) {
+    g_printerr ("option parsing failed: %s\n", error->message);
+    g_error_free (error);
+    exit (1);
+  }
+
+  g_option_context_free (context);
+
+  if (get_clients < 0 || post_clients < 0 || get_clients + post_clients == 0 ||
+      duration <= 0 || rate <= 0 || rate > 1000 || payload_size <= 0 ||
+      keyframe_interval <= 0 || workers < 0 || coalesce_size < 0 ||
+      coalesce_latency < 0 || register_interval < 0) {
+    g_printerr ("Invalid arguments\n");
+    exit (1);
+  }
+
+  if (get_end_points <= 0 || get_end_points > get_clients)
+    get_end_points = MAX (get_clients, 1);
+
+  setenv ("GST_PLUGIN_PATH", "./plugins", FALSE);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+
+  raise_fd_limit ();
+
+  n_clients = get_clients + post_clients;
+  clients = g_new0 (BenchClient, n_clients);
+
+  for (i = 0; i < n_clients; i++)
+    clients[i].ttfb = -1;
+
+  post_payload = (gchar *) g_malloc (payload_size);
+  memset (post_payload, 0xa5, payload_size);
+  register_times = g_array_new (FALSE, FALSE, sizeof (gint64) );
+  loaded_register_times = g_array_new (FALSE, FALSE, sizeof (gint64) );
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new ("benchmark-pipeline");
+
+  httpepserver = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, port,
+                                         KMS_HTTP_EP_SERVER_INTERFACE, DEFAULT_HOST,
+                                         KMS_HTTP_EP_SERVER_WORKERS, (guint) workers,
+                                         KMS_HTTP_EP_SERVER_COALESCE_SIZE, (guint) coalesce_size,
+                                         KMS_HTTP_EP_SERVER_COALESCE_LATENCY,
+                                         (guint) coalesce_latency, NULL);
+
+  kms_http_ep_server_start (httpepserver, http_server_start_cb);
+
+  g_main_loop_run (loop);
+
+  if (register_id != 0)
+    g_source_remove (register_id);
+
+  if (client_thread != NULL) {
+    g_thread_join (client_thread);
+    print_results ();
+  }
+
+  if (feed_id != 0)
+    g_source_remove (feed_id);
+
+  kms_http_ep_server_stop (httpepserver);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_object_unref (httpepserver);
+
+  for (i = 0; i < n_clients; i++)
+    g_free (clients[i].url);
+
+  g_free (clients);
+  g_free (post_payload);
+  g_slist_free (sources);
+  g_array_free (register_times, TRUE);
+  g_array_free (loaded_register_times, TRUE);
+  g_main_loop_unref (loop);
+
+  return client_thread != NULL ? 0 : 1;
+}
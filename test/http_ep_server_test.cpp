@@ -15,9 +15,14 @@
 #define BOOST_TEST_MODULE http_ep_server
 #include <boost/test/unit_test.hpp>
 
+#include <unistd.h>
+#include <string.h>
 #include <gst/gst.h>
+#include <glib/gstdio.h>
 #include <libsoup/soup.h>
 #include <KmsHttpEPServer.h>
+#include <KmsHttpSegmentCache.h>
+#include <KmsHttpTimerQueue.h>
 #include <kmshttpendpointaction.h>
 
 #define GST_CAT_DEFAULT _http_endpoint_server_test_
@@ -721,4 +726,1065 @@ BOOST_AUTO_TEST_CASE ( expired_cookie_http_end_point_test )
   tear_down_test_case ();
 }
 
+/********************************************/
+/* Functions and variables used for test 6  */
+/********************************************/
+
+#define WORKERS 4
+
+static void
+t6_action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                        KmsHttpEndPointAction action, gpointer data)
+{
+  GST_DEBUG ("Action %d requested on %s", action, uri);
+  BOOST_CHECK ( action == KMS_HTTP_END_POINT_ACTION_GET );
+
+  /* Signals must be emitted in the main context, not in workers */
+  BOOST_CHECK (g_main_context_is_owner (g_main_context_default () ) );
+
+  BOOST_CHECK (kms_http_ep_server_unregister_end_point (httpepserver, uri) );
+}
+
+BOOST_AUTO_TEST_CASE ( workers_http_end_point_test )
+{
+  guint workers;
+
+  init_test_case ();
+
+  /* Replace default server by a multi-threaded one */
+  g_object_unref (G_OBJECT (httpepserver) );
+  httpepserver = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, DEFAULT_PORT,
+                                         KMS_HTTP_EP_SERVER_INTERFACE, DEFAULT_HOST,
+                                         KMS_HTTP_EP_SERVER_WORKERS, WORKERS, NULL);
+
+  g_object_get (G_OBJECT (httpepserver), KMS_HTTP_EP_SERVER_WORKERS, &workers,
+                NULL);
+  BOOST_CHECK_EQUAL (workers, WORKERS);
+
+  g_signal_connect (httpepserver, "url-removed", G_CALLBACK (url_removed_cb),
+                    NULL);
+  g_signal_connect (httpepserver, "action-requested",
+                    G_CALLBACK (t6_action_requested_cb), NULL);
+
+  kms_http_ep_server_start (httpepserver, http_server_start_cb);
+
+  g_main_loop_run (loop);
+
+  BOOST_CHECK_EQUAL (signal_count, urls_registered);
+
+  GST_DEBUG ("Test finished");
+
+  /* Stop Http End Point Server and destroy it */
+  kms_http_ep_server_stop (httpepserver);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 7  */
+/********************************************/
+
+#define T7_VIEWERS 3
+#define T7_MAX_TIME 10 /* seconds */
+
+static const gchar *t7_uri;
+static guint t7_served;
+
+static gboolean
+t7_quit_cb (gpointer data)
+{
+  g_main_loop_quit (loop);
+
+  return FALSE;
+}
+
+static void
+t7_got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
+{
+  gboolean *got_data = (gboolean *) data;
+
+  if (*got_data)
+    return;
+
+  *got_data = TRUE;
+  GST_DEBUG ("Viewer %p got %" G_GSIZE_FORMAT " bytes", (gpointer) msg,
+             chunk->length);
+
+  /* Client is done, let the server see the connection closing */
+  g_idle_add_full (G_PRIORITY_DEFAULT, t5_cancel_cb, g_object_ref (msg),
+                   g_object_unref);
+
+  if (++t7_served == T7_VIEWERS)
+    g_idle_add (t7_quit_cb, NULL);
+}
+
+static void
+t7_http_req_callback (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  GST_DEBUG ("Viewer %p finished with status %d", (gpointer) msg,
+             msg->status_code);
+  BOOST_CHECK (msg->status_code == SOUP_STATUS_CANCELLED);
+}
+
+static void
+t7_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  gchar *url;
+  gint i;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  t7_uri = kms_http_ep_server_register_end_point_full (httpepserver, httpep,
+           DISCONNECTION_TIMEOUT, KMS_HTTP_EP_SERVER_FLAG_BROADCAST);
+  BOOST_CHECK (t7_uri != NULL);
+
+  if (t7_uri == NULL) {
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  urls = g_slist_prepend (urls, (gpointer *) g_strdup (t7_uri) );
+  url = g_strdup_printf ("http://%s:%d%s", DEFAULT_HOST, DEFAULT_PORT, t7_uri);
+
+  /* All viewers share the same URL and none of them sends a cookie */
+  for (i = 0; i < T7_VIEWERS; i++) {
+    SoupMessage *msg = soup_message_new (HTTP_GET, url);
+    gboolean *got_data = g_new0 (gboolean, 1);
+
+    g_signal_connect_data (msg, "got-chunk", G_CALLBACK (t7_got_chunk_cb),
+                           got_data, (GClosureNotify) g_free, (GConnectFlags) 0);
+    soup_session_queue_message (session, msg, t7_http_req_callback, NULL);
+  }
+
+  g_free (url);
+}
+
+static void
+t7_action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                        KmsHttpEndPointAction action, gpointer data)
+{
+  GST_DEBUG ("Action %d requested on %s", action, uri);
+  BOOST_CHECK ( action == KMS_HTTP_END_POINT_ACTION_GET );
+
+  if (++counted == 1) {
+    GST_DEBUG ("Starting pipeline");
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  }
+}
+
+BOOST_AUTO_TEST_CASE ( broadcast_http_end_point_test )
+{
+  GstElement *videotestsrc, *encoder, *agnosticbin;
+  GSource *timeout;
+  guint bus_watch_id1;
+  GstBus *srcbus;
+
+  init_test_case ();
+  t7_served = 0;
+
+  /* Let all the viewers be connected at the same time */
+  g_object_set (G_OBJECT (session), SOUP_SESSION_MAX_CONNS_PER_HOST,
+                T7_VIEWERS, NULL);
+
+  pipeline = gst_pipeline_new ("src-pipeline");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  encoder = gst_element_factory_make ("vp8enc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  httpep = gst_element_factory_make ("httpendpoint", NULL);
+
+  srcbus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
+  bus_watch_id1 = gst_bus_add_watch (srcbus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (srcbus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (srcbus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, encoder, agnosticbin,
+                    httpep, NULL);
+  gst_element_link (videotestsrc, encoder);
+  gst_element_link (encoder, agnosticbin);
+  gst_element_link_pads (agnosticbin, NULL, httpep, "video_sink");
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+                "pattern", 18, NULL);
+
+  g_signal_connect (httpepserver, "action-requested",
+                    G_CALLBACK (t7_action_requested_cb), NULL);
+
+  kms_http_ep_server_start (httpepserver, t7_http_server_start_cb);
+
+  timeout = g_timeout_source_new_seconds (T7_MAX_TIME);
+  g_source_set_callback (timeout, t7_quit_cb, NULL, NULL);
+  g_source_attach (timeout, NULL);
+
+  g_main_loop_run (loop);
+
+  /* One encoded stream has been delivered to every viewer */
+  BOOST_CHECK_EQUAL (counted, T7_VIEWERS);
+  BOOST_CHECK_EQUAL (t7_served, T7_VIEWERS);
+
+  GST_DEBUG ("Test finished");
+
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+  kms_http_ep_server_stop (httpepserver);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline) );
+  g_source_remove (bus_watch_id1);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 8  */
+/********************************************/
+
+#define T8_SEGMENT_SIZE 100
+
+static SoupBuffer *
+t8_new_segment ()
+{
+  return soup_buffer_new (SOUP_MEMORY_TAKE, g_malloc0 (T8_SEGMENT_SIZE),
+                          T8_SEGMENT_SIZE);
+}
+
+static void
+t8_insert (KmsHttpSegmentCache *cache, const gchar *path)
+{
+  SoupBuffer *segment = t8_new_segment ();
+
+  kms_http_segment_cache_insert (cache, path, segment);
+  soup_buffer_free (segment);
+}
+
+static gboolean
+t8_contains (KmsHttpSegmentCache *cache, const gchar *path)
+{
+  SoupBuffer *segment = kms_http_segment_cache_lookup (cache, path);
+
+  if (segment == NULL)
+    return FALSE;
+
+  soup_buffer_free (segment);
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_CASE ( segment_cache_test )
+{
+  KmsHttpSegmentCache *cache;
+
+  cache = kms_http_segment_cache_new (3 * T8_SEGMENT_SIZE);
+
+  t8_insert (cache, "/a/seg0.m4s");
+  t8_insert (cache, "/a/seg1.m4s");
+  t8_insert (cache, "/b/seg0.m4s");
+  BOOST_CHECK_EQUAL (kms_http_segment_cache_get_size (cache),
+                     3 * T8_SEGMENT_SIZE);
+
+  /* Least recently used segment is the one evicted */
+  BOOST_CHECK (t8_contains (cache, "/a/seg0.m4s") );
+  t8_insert (cache, "/b/seg1.m4s");
+
+  BOOST_CHECK (t8_contains (cache, "/a/seg0.m4s") );
+  BOOST_CHECK (!t8_contains (cache, "/a/seg1.m4s") );
+  BOOST_CHECK (t8_contains (cache, "/b/seg0.m4s") );
+  BOOST_CHECK (t8_contains (cache, "/b/seg1.m4s") );
+  BOOST_CHECK_EQUAL (kms_http_segment_cache_get_size (cache),
+                     3 * T8_SEGMENT_SIZE);
+
+  kms_http_segment_cache_remove_prefix (cache, "/b/");
+  BOOST_CHECK (t8_contains (cache, "/a/seg0.m4s") );
+  BOOST_CHECK (!t8_contains (cache, "/b/seg0.m4s") );
+  BOOST_CHECK_EQUAL (kms_http_segment_cache_get_size (cache), T8_SEGMENT_SIZE);
+
+  kms_http_segment_cache_unref (cache);
+}
+
+/********************************************/
+/* Functions and variables used for test 9  */
+/********************************************/
+
+#define T9_SEGMENT_DURATION 1 /* seconds */
+#define T9_MAX_TIME 15 /* seconds */
+#define T9_POLL_INTERVAL 500 /* milliseconds */
+
+static const gchar *t9_uri;
+static gboolean t9_segment_served;
+static guint t9_pending_segments;
+
+static void t9_request_playlist ();
+
+static gboolean
+t9_poll_cb (gpointer data)
+{
+  t9_request_playlist ();
+
+  return FALSE;
+}
+
+static void
+t9_segment_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  GST_DEBUG ("Segment status code %d", msg->status_code);
+
+  BOOST_CHECK (msg->status_code == SOUP_STATUS_OK);
+  BOOST_CHECK (msg->response_body->length > 0);
+  BOOST_CHECK_EQUAL (soup_message_headers_get_content_length (
+                       msg->response_headers), msg->response_body->length);
+  BOOST_CHECK (soup_message_headers_get_one (msg->response_headers,
+               "Cache-Control") != NULL);
+
+  /* Every segment starts a new fragment */
+  BOOST_CHECK (msg->response_body->length >= 8 && (
+                 memcmp (msg->response_body->data + 4, "moof", 4) == 0 ||
+                 memcmp (msg->response_body->data + 4, "styp", 4) == 0) );
+
+  t9_segment_served = TRUE;
+
+  if (--t9_pending_segments == 0)
+    g_main_loop_quit (loop);
+}
+
+static void
+t9_playlist_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  gchar **lines, **line;
+  GSList *segments = NULL, *l;
+
+  BOOST_CHECK (msg->status_code == SOUP_STATUS_OK);
+
+  if (msg->status_code != SOUP_STATUS_OK) {
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  BOOST_CHECK (g_str_has_prefix (msg->response_body->data, "#EXTM3U") );
+
+  lines = g_strsplit (msg->response_body->data, "\n", -1);
+
+  for (line = lines; *line != NULL; line++) {
+    if (**line != '\0' && **line != '#')
+      segments = g_slist_append (segments, g_strdup (*line) );
+  }
+
+  g_strfreev (lines);
+
+  if (segments == NULL) {
+    /* First segment is not ready yet */
+    g_timeout_add (T9_POLL_INTERVAL, t9_poll_cb, NULL);
+    return;
+  }
+
+  t9_pending_segments = g_slist_length (segments);
+
+  for (l = segments; l != NULL; l = l->next) {
+    const gchar *segment = (const gchar *) l->data;
+    SoupMessage *seg_msg;
+    SoupURI *uri;
+
+    uri = soup_uri_new_with_base (soup_message_get_uri (msg), segment);
+    seg_msg = soup_message_new_from_uri (HTTP_GET, uri);
+
+    GST_DEBUG ("Requesting segment %s", segment);
+    soup_session_queue_message (session, seg_msg, t9_segment_cb, NULL);
+
+    soup_uri_free (uri);
+  }
+
+  g_slist_free_full (segments, g_free);
+}
+
+static void
+t9_request_playlist ()
+{
+  SoupMessage *msg;
+  gchar *url;
+
+  url = g_strdup_printf ("http://%s:%d%s", DEFAULT_HOST, DEFAULT_PORT, t9_uri);
+  msg = soup_message_new (HTTP_GET, url);
+  soup_session_queue_message (session, msg, t9_playlist_cb, NULL);
+  g_free (url);
+}
+
+static void
+t9_missing_segment_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  BOOST_CHECK (msg->status_code == SOUP_STATUS_NOT_FOUND);
+
+  t9_request_playlist ();
+}
+
+static void
+t9_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  SoupMessage *msg;
+  gchar *url, *dir;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  /* HLS clients can only play MP4 segments */
+  g_object_set (G_OBJECT (httpep), "profile", 0 /* webm */, NULL);
+  BOOST_CHECK (kms_http_ep_server_register_end_point_full (httpepserver, httpep,
+               DISCONNECTION_TIMEOUT, KMS_HTTP_EP_SERVER_FLAG_SEGMENTED) == NULL);
+
+  g_object_set (G_OBJECT (httpep), "profile", 1 /* mp4 */, NULL);
+  t9_uri = kms_http_ep_server_register_end_point_full (httpepserver, httpep,
+           DISCONNECTION_TIMEOUT, KMS_HTTP_EP_SERVER_FLAG_SEGMENTED);
+  BOOST_CHECK (t9_uri != NULL);
+
+  if (t9_uri == NULL) {
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  BOOST_CHECK (g_str_has_suffix (t9_uri, ".m3u8") );
+  urls = g_slist_prepend (urls, (gpointer *) g_strdup (t9_uri) );
+
+  /* Segments that have never been produced are not found */
+  dir = g_path_get_dirname (t9_uri);
+  url = g_strdup_printf ("http://%s:%d%s/seg1000.m4s", DEFAULT_HOST,
+                         DEFAULT_PORT, dir);
+  msg = soup_message_new (HTTP_GET, url);
+  soup_session_queue_message (session, msg, t9_missing_segment_cb, NULL);
+  g_free (url);
+  g_free (dir);
+}
+
+static void
+t9_action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                        KmsHttpEndPointAction action, gpointer data)
+{
+  /* Only the first playlist request of the session is notified */
+  BOOST_CHECK_EQUAL (uri, t9_uri);
+
+  if (++counted == 1) {
+    GST_DEBUG ("Starting pipeline");
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  }
+}
+
+BOOST_AUTO_TEST_CASE ( segmented_http_end_point_test )
+{
+  GstElement *videotestsrc, *encoder, *agnosticbin;
+  GSource *timeout;
+  guint bus_watch_id1;
+  GstBus *srcbus;
+
+  init_test_case ();
+  t9_segment_served = FALSE;
+
+  /* Replace default server by one producing short segments */
+  g_object_unref (G_OBJECT (httpepserver) );
+  httpepserver = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, DEFAULT_PORT,
+                                         KMS_HTTP_EP_SERVER_INTERFACE, DEFAULT_HOST,
+                                         KMS_HTTP_EP_SERVER_SEGMENT_DURATION, T9_SEGMENT_DURATION, NULL);
+
+  pipeline = gst_pipeline_new ("src-pipeline");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  encoder = gst_element_factory_make ("x264enc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  httpep = gst_element_factory_make ("httpendpoint", NULL);
+
+  srcbus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
+  bus_watch_id1 = gst_bus_add_watch (srcbus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (srcbus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (srcbus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, encoder, agnosticbin,
+                    httpep, NULL);
+  gst_element_link (videotestsrc, encoder);
+  gst_element_link (encoder, agnosticbin);
+  gst_element_link_pads (agnosticbin, NULL, httpep, "video_sink");
+
+  /* Make sure several key frames are produced per segment */
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+                "pattern", 18, NULL);
+  g_object_set (G_OBJECT (encoder), "key-int-max", 10, NULL);
+
+  g_signal_connect (httpepserver, "action-requested",
+                    G_CALLBACK (t9_action_requested_cb), NULL);
+
+  kms_http_ep_server_start (httpepserver, t9_http_server_start_cb);
+
+  timeout = g_timeout_source_new_seconds (T9_MAX_TIME);
+  g_source_set_callback (timeout, t7_quit_cb, NULL, NULL);
+  g_source_attach (timeout, NULL);
+
+  g_main_loop_run (loop);
+
+  BOOST_CHECK (t9_segment_served);
+  BOOST_CHECK_EQUAL (counted, 1);
+
+  GST_DEBUG ("Test finished");
+
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+  kms_http_ep_server_stop (httpepserver);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline) );
+  g_source_remove (bus_watch_id1);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 10 */
+/********************************************/
+
+static void
+t10_action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                         KmsHttpEndPointAction action, gpointer data)
+{
+  /* Only the callbacks set for this uri are called */
+  BOOST_CHECK_EQUAL (uri, (const gchar *) data);
+  BOOST_CHECK ( action == KMS_HTTP_END_POINT_ACTION_GET );
+
+  BOOST_CHECK (kms_http_ep_server_unregister_end_point (httpepserver, uri) );
+}
+
+static void
+t10_url_removed_cb (KmsHttpEPServer *server, const gchar *uri, gpointer data)
+{
+  BOOST_CHECK_EQUAL (uri, (const gchar *) data);
+
+  if (++signal_count == urls_registered)
+    g_idle_add ( (GSourceFunc) checking_registered_urls, &expected_404);
+}
+
+static const KmsHttpEPServerCallbacks t10_callbacks = {
+  t10_action_requested_cb,
+  t10_url_removed_cb,
+  NULL
+};
+
+static void
+t10_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  GSList *l;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    return;
+  }
+
+  register_http_end_points (MAX_REGISTERED_HTTP_END_POINTS);
+
+  for (l = urls; l != NULL; l = l->next)
+    BOOST_CHECK (kms_http_ep_server_set_end_point_callbacks (httpepserver,
+                 (const gchar *) l->data, &t10_callbacks, l->data, NULL) );
+
+  BOOST_CHECK (!kms_http_ep_server_set_end_point_callbacks (httpepserver,
+               "/not-registered", &t10_callbacks, NULL, NULL) );
+
+  session_cb = http_req_callback;
+
+  g_idle_add ( (GSourceFunc) checking_registered_urls, &expected_200);
+}
+
+BOOST_AUTO_TEST_CASE ( callbacks_http_end_point_test )
+{
+  init_test_case ();
+
+  /* No global signal handlers, end points are reached by their uri */
+  kms_http_ep_server_start (httpepserver, t10_http_server_start_cb);
+
+  g_main_loop_run (loop);
+
+  BOOST_CHECK_EQUAL (signal_count, urls_registered);
+
+  GST_DEBUG ("Test finished");
+
+  /* Stop Http End Point Server and destroy it */
+  kms_http_ep_server_stop (httpepserver);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 11 */
+/********************************************/
+
+#define T11_METRIC "kms_test_metric 42\n"
+
+static gboolean t11_notified;
+
+static void
+t11_append_metrics (KmsHttpEPServer *self, GString *metrics, gpointer data)
+{
+  g_string_append (metrics, T11_METRIC);
+}
+
+static void
+t11_notify (gpointer data)
+{
+  t11_notified = TRUE;
+}
+
+static void
+t11_metrics_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  const gchar *body;
+
+  GST_DEBUG ("Metrics status code %d", msg->status_code);
+  BOOST_CHECK (msg->status_code == SOUP_STATUS_OK);
+
+  if (msg->status_code == SOUP_STATUS_OK) {
+    BOOST_CHECK (g_str_has_prefix (soup_message_headers_get_content_type (
+                                     msg->response_headers, NULL), "text/plain") );
+
+    body = msg->response_body->data;
+    BOOST_CHECK (strstr (body, "# TYPE kms_http_requests_total counter") != NULL);
+    BOOST_CHECK (strstr (body, "kms_http_get_sessions ") != NULL);
+    BOOST_CHECK (strstr (body, T11_METRIC) != NULL);
+  }
+
+  g_main_loop_quit (loop);
+}
+
+static void
+t11_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  SoupMessage *msg;
+  gchar *url;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  url = g_strdup_printf ("http://%s:%d" KMS_HTTP_EP_SERVER_METRICS_PATH,
+                         DEFAULT_HOST, DEFAULT_PORT);
+  msg = soup_message_new (HTTP_GET, url);
+  soup_session_queue_message (session, msg, t11_metrics_cb, NULL);
+  g_free (url);
+}
+
+BOOST_AUTO_TEST_CASE ( metrics_http_ep_server_test )
+{
+  init_test_case ();
+  t11_notified = FALSE;
+
+  kms_http_ep_server_set_metrics_func (httpepserver, t11_append_metrics, NULL,
+                                       t11_notify);
+  kms_http_ep_server_start (httpepserver, t11_http_server_start_cb);
+
+  g_main_loop_run (loop);
+
+  /* Replacing the function releases the previous one */
+  kms_http_ep_server_set_metrics_func (httpepserver, NULL, NULL, NULL);
+  BOOST_CHECK (t11_notified);
+
+  GST_DEBUG ("Test finished");
+
+  kms_http_ep_server_stop (httpepserver);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 12 */
+/********************************************/
+
+#define T12_COALESCE_SIZE 1024
+#define T12_COALESCE_LATENCY 5 /* milliseconds */
+
+BOOST_AUTO_TEST_CASE ( coalescing_http_end_point_test )
+{
+  guint size, latency;
+  GSList *l;
+
+  init_test_case ();
+
+  /* Replace default server by one with its own coalescing defaults */
+  g_object_unref (G_OBJECT (httpepserver) );
+  httpepserver = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, DEFAULT_PORT,
+                                         KMS_HTTP_EP_SERVER_INTERFACE, DEFAULT_HOST,
+                                         KMS_HTTP_EP_SERVER_COALESCE_SIZE, T12_COALESCE_SIZE,
+                                         KMS_HTTP_EP_SERVER_COALESCE_LATENCY, T12_COALESCE_LATENCY, NULL);
+
+  g_object_get (G_OBJECT (httpepserver), KMS_HTTP_EP_SERVER_COALESCE_SIZE,
+                &size, KMS_HTTP_EP_SERVER_COALESCE_LATENCY, &latency, NULL);
+  BOOST_CHECK_EQUAL (size, T12_COALESCE_SIZE);
+  BOOST_CHECK_EQUAL (latency, T12_COALESCE_LATENCY);
+
+  register_http_end_points (MAX_REGISTERED_HTTP_END_POINTS);
+
+  /* Low latency end points write every sample */
+  for (l = urls; l != NULL; l = l->next)
+    BOOST_CHECK (kms_http_ep_server_set_end_point_coalescing (httpepserver,
+                 (const gchar *) l->data, 0, 0) );
+
+  BOOST_CHECK (!kms_http_ep_server_set_end_point_coalescing (httpepserver,
+               "/not-registered", T12_COALESCE_SIZE, T12_COALESCE_LATENCY) );
+
+  for (l = urls; l != NULL; l = l->next)
+    BOOST_CHECK (kms_http_ep_server_unregister_end_point (httpepserver,
+                 (const gchar *) l->data) );
+
+  GST_DEBUG ("Test finished");
+
+  tear_down_test_case ();
+}
+
+#define T12_BATCH_SIZE 4096
+#define T12_BATCH_LATENCY 1000 /* milliseconds */
+#define T12_CHUNKS 20
+
+static gsize t12_bytes;
+static guint t12_chunks;
+
+static void
+t12_got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
+{
+  t12_bytes += chunk->length;
+
+  if (++t12_chunks == T12_CHUNKS)
+    g_idle_add_full (G_PRIORITY_DEFAULT, t5_cancel_cb, g_object_ref (msg),
+                     g_object_unref);
+}
+
+static void
+t12_http_req_callback (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  g_main_loop_quit (loop);
+}
+
+static void
+t12_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  SoupMessage *msg;
+  const gchar *uri;
+  gchar *url;
+
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  uri = kms_http_ep_server_register_end_point (httpepserver, httpep,
+        DISCONNECTION_TIMEOUT);
+  BOOST_CHECK (uri != NULL);
+
+  if (uri == NULL) {
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  urls = g_slist_prepend (urls, (gpointer *) g_strdup (uri) );
+  url = g_strdup_printf ("http://%s:%d%s", DEFAULT_HOST, DEFAULT_PORT, uri);
+  msg = soup_message_new (HTTP_GET, url);
+  g_signal_connect (msg, "got-chunk", G_CALLBACK (t12_got_chunk_cb), NULL);
+  soup_session_queue_message (session, msg, t12_http_req_callback, NULL);
+  g_free (url);
+}
+
+static void
+t12_action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                         KmsHttpEndPointAction action, gpointer data)
+{
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+}
+
+BOOST_AUTO_TEST_CASE ( coalesced_writes_http_end_point_test )
+{
+  GstElement *videotestsrc, *encoder, *agnosticbin;
+  GSource *timeout;
+  guint bus_watch_id1;
+  GstBus *srcbus;
+
+  init_test_case ();
+  t12_bytes = 0;
+  t12_chunks = 0;
+
+  /* Writes are only flushed once they reach the size */
+  g_object_unref (G_OBJECT (httpepserver) );
+  httpepserver = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, DEFAULT_PORT,
+                                         KMS_HTTP_EP_SERVER_INTERFACE, DEFAULT_HOST,
+                                         KMS_HTTP_EP_SERVER_COALESCE_SIZE, T12_BATCH_SIZE,
+                                         KMS_HTTP_EP_SERVER_COALESCE_LATENCY, T12_BATCH_LATENCY, NULL);
+
+  pipeline = gst_pipeline_new ("src-pipeline");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  encoder = gst_element_factory_make ("vp8enc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  httpep = gst_element_factory_make ("httpendpoint", NULL);
+
+  srcbus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
+  bus_watch_id1 = gst_bus_add_watch (srcbus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (srcbus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (srcbus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, encoder, agnosticbin,
+                    httpep, NULL);
+  gst_element_link (videotestsrc, encoder);
+  gst_element_link (encoder, agnosticbin);
+  gst_element_link_pads (agnosticbin, NULL, httpep, "video_sink");
+
+  /* Encoded frames are much smaller than the batch size */
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+                "pattern", 18, NULL);
+
+  g_signal_connect (httpepserver, "action-requested",
+                    G_CALLBACK (t12_action_requested_cb), NULL);
+
+  kms_http_ep_server_start (httpepserver, t12_http_server_start_cb);
+
+  timeout = g_timeout_source_new_seconds (T7_MAX_TIME);
+  g_source_set_callback (timeout, t7_quit_cb, NULL, NULL);
+  g_source_attach (timeout, NULL);
+
+  g_main_loop_run (loop);
+
+  /* Every write carries a whole batch instead of a single frame */
+  BOOST_CHECK_EQUAL (t12_chunks, T12_CHUNKS);
+  BOOST_CHECK (t12_bytes / MAX (t12_chunks, 1) >= T12_BATCH_SIZE / 2);
+
+  GST_DEBUG ("Test finished");
+
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+  kms_http_ep_server_stop (httpepserver);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline) );
+  g_source_remove (bus_watch_id1);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 13 */
+/********************************************/
+
+/* Several read chunks */
+#define T13_FILE_SIZE (200 * 1024)
+#define T13_RANGE_START 100
+#define T13_RANGE_END 199
+
+static gchar *t13_contents;
+static const gchar *t13_uri;
+static guint t13_step;
+
+static void t13_next_request ();
+
+static void
+t13_response_cb (SoupSession *session, SoupMessage *msg, gpointer data)
+{
+  GST_DEBUG ("Step %d status code %d", t13_step, msg->status_code);
+
+  switch (t13_step) {
+  case 0:
+    /* Whole file */
+    BOOST_CHECK (msg->status_code == SOUP_STATUS_OK);
+    BOOST_CHECK_EQUAL (msg->response_body->length, T13_FILE_SIZE);
+    BOOST_CHECK (memcmp (msg->response_body->data, t13_contents,
+                         T13_FILE_SIZE) == 0);
+    break;
+
+  case 1: {
+    goffset start, end, total;
+
+    /* Seek */
+    BOOST_CHECK (msg->status_code == SOUP_STATUS_PARTIAL_CONTENT);
+    BOOST_CHECK (soup_message_headers_get_content_range (msg->response_headers,
+                 &start, &end, &total) );
+    BOOST_CHECK_EQUAL (start, T13_RANGE_START);
+    BOOST_CHECK_EQUAL (end, T13_RANGE_END);
+    BOOST_CHECK_EQUAL (total, T13_FILE_SIZE);
+    BOOST_CHECK_EQUAL (msg->response_body->length,
+                       T13_RANGE_END - T13_RANGE_START + 1);
+    BOOST_CHECK (memcmp (msg->response_body->data,
+                         t13_contents + T13_RANGE_START,
+                         T13_RANGE_END - T13_RANGE_START + 1) == 0);
+    break;
+  }
+
+  case 2:
+    /* Ranges that can not be satisfied are ignored */
+    BOOST_CHECK (msg->status_code == SOUP_STATUS_OK);
+    BOOST_CHECK_EQUAL (msg->response_body->length, T13_FILE_SIZE);
+    BOOST_CHECK (kms_http_ep_server_unregister_file (httpepserver, t13_uri) );
+    break;
+
+  default:
+    /* File is not served once it is unregistered */
+    BOOST_CHECK (msg->status_code == SOUP_STATUS_NOT_FOUND);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  t13_step++;
+  t13_next_request ();
+}
+
+static void
+t13_next_request ()
+{
+  SoupMessage *msg;
+  gchar *url;
+
+  url = g_strdup_printf ("http://%s:%d%s", DEFAULT_HOST, DEFAULT_PORT, t13_uri);
+  msg = soup_message_new (HTTP_GET, url);
+  g_free (url);
+
+  if (t13_step == 1)
+    soup_message_headers_set_range (msg->request_headers, T13_RANGE_START,
+                                    T13_RANGE_END);
+  else if (t13_step == 2)
+    soup_message_headers_set_range (msg->request_headers, T13_FILE_SIZE * 2,
+                                    T13_FILE_SIZE * 3);
+
+  soup_session_queue_message (session, msg, t13_response_cb, NULL);
+}
+
+static void
+t13_http_server_start_cb (KmsHttpEPServer *self, GError *err)
+{
+  if (err != NULL) {
+    GST_ERROR ("%s, code %d", err->message, err->code);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  t13_next_request ();
+}
+
+BOOST_AUTO_TEST_CASE ( file_http_ep_server_test )
+{
+  GError *err = NULL;
+  gchar *filename;
+  gint fd, i;
+
+  init_test_case ();
+  t13_step = 0;
+
+  t13_contents = (gchar *) g_malloc (T13_FILE_SIZE);
+
+  for (i = 0; i < T13_FILE_SIZE; i++)
+    t13_contents[i] = g_random_int_range (0, 256);
+
+  fd = g_file_open_tmp ("kms-http-ep-XXXXXX", &filename, NULL);
+  BOOST_REQUIRE (fd >= 0);
+  close (fd);
+  BOOST_REQUIRE (g_file_set_contents (filename, t13_contents, T13_FILE_SIZE,
+                                      NULL) );
+
+  BOOST_CHECK (kms_http_ep_server_register_file (httpepserver,
+               "/non/existent/file", "video/webm", &err) == NULL);
+  BOOST_CHECK (err != NULL);
+  g_clear_error (&err);
+
+  t13_uri = kms_http_ep_server_register_file (httpepserver, filename,
+            "video/webm", NULL);
+  BOOST_REQUIRE (t13_uri != NULL);
+
+  kms_http_ep_server_start (httpepserver, t13_http_server_start_cb);
+
+  g_main_loop_run (loop);
+
+  BOOST_CHECK_EQUAL (t13_step, 3);
+
+  GST_DEBUG ("Test finished");
+
+  kms_http_ep_server_stop (httpepserver);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_free (t13_contents);
+
+  tear_down_test_case ();
+}
+
+/********************************************/
+/* Functions and variables used for test 14 */
+/********************************************/
+
+#define T14_MAX_TIME 5 /* seconds */
+
+static GSList *t14_expired;
+static guint t14_released;
+
+static void
+t14_expired_cb (gpointer data)
+{
+  t14_expired = g_slist_append (t14_expired, data);
+
+  if (g_slist_length (t14_expired) == 2)
+    g_main_loop_quit (loop);
+}
+
+static void
+t14_release_cb (gpointer data)
+{
+  t14_released++;
+}
+
+BOOST_AUTO_TEST_CASE ( timer_queue_test )
+{
+  KmsHttpTimer *t1, *t2, *t3;
+  KmsHttpTimerQueue *queue;
+  GSource *timeout;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  t14_expired = NULL;
+  t14_released = 0;
+
+  queue = kms_http_timer_queue_new ();
+  t1 = kms_http_timer_new (queue, t14_expired_cb);
+  t2 = kms_http_timer_new (queue, t14_expired_cb);
+  t3 = kms_http_timer_new (queue, t14_expired_cb);
+
+  /* Timers armed before the queue is attached are not lost */
+  kms_http_timer_schedule (t1, 300, (gpointer) "t1", t14_release_cb);
+  kms_http_timer_queue_attach (queue, NULL);
+  kms_http_timer_schedule (t2, 100, (gpointer) "t2", t14_release_cb);
+  kms_http_timer_schedule (t3, 200, (gpointer) "t3", t14_release_cb);
+  BOOST_CHECK_EQUAL (kms_http_timer_queue_get_length (queue), 3);
+
+  /* Rescheduling replaces the previous expiration */
+  kms_http_timer_schedule (t1, 50, (gpointer) "t1", t14_release_cb);
+  BOOST_CHECK_EQUAL (t14_released, 1);
+  BOOST_CHECK_EQUAL (kms_http_timer_queue_get_length (queue), 3);
+
+  BOOST_CHECK (kms_http_timer_cancel (t3) );
+  BOOST_CHECK (!kms_http_timer_cancel (t3) );
+  BOOST_CHECK_EQUAL (t14_released, 2);
+
+  timeout = g_timeout_source_new_seconds (T14_MAX_TIME);
+  g_source_set_callback (timeout, t7_quit_cb, NULL, NULL);
+  g_source_attach (timeout, NULL);
+
+  g_main_loop_run (loop);
+
+  BOOST_REQUIRE_EQUAL (g_slist_length (t14_expired), 2);
+  BOOST_CHECK_EQUAL ( (const gchar *) t14_expired->data, "t1");
+  BOOST_CHECK_EQUAL ( (const gchar *) t14_expired->next->data, "t2");
+  BOOST_CHECK_EQUAL (t14_released, 4);
+  BOOST_CHECK_EQUAL (kms_http_timer_queue_get_length (queue), 0);
+
+  /* Freeing an armed timer cancels it */
+  kms_http_timer_schedule (t2, 100, (gpointer) "t2", t14_release_cb);
+  kms_http_timer_free (t1);
+  kms_http_timer_free (t2);
+  kms_http_timer_free (t3);
+  BOOST_CHECK_EQUAL (t14_released, 5);
+
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+  kms_http_timer_queue_detach (queue);
+  kms_http_timer_queue_unref (queue);
+  g_slist_free (t14_expired);
+  g_main_loop_unref (loop);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
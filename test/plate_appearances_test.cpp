@@ -0,0 +1,77 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#define BOOST_TEST_MODULE plate_appearances_test
+#include <boost/test/unit_test.hpp>
+
+#include "common/PlateAppearances.hpp"
+
+#define TIMEOUT (2 * G_TIME_SPAN_SECOND)
+
+using namespace kurento;
+
+BOOST_AUTO_TEST_SUITE (plate_appearances_test)
+
+BOOST_AUTO_TEST_CASE ( near_identical_readings )
+{
+  PlateAppearances appearances (TIMEOUT);
+  gint64 now = 0;
+
+  BOOST_CHECK (appearances.isNewAppearance ("1234ABC", now) );
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABC", now += 40000) );
+  /* A character misread, dropped or added */
+  BOOST_CHECK (!appearances.isNewAppearance ("1284ABC", now += 40000) );
+  BOOST_CHECK (!appearances.isNewAppearance ("234ABC", now += 40000) );
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABCD", now += 40000) );
+  /* Seven characters allow only one difference */
+  BOOST_CHECK (appearances.isNewAppearance ("1284ABD", now += 40000) );
+}
+
+BOOST_AUTO_TEST_CASE ( different_plates )
+{
+  PlateAppearances appearances (TIMEOUT);
+  gint64 now = 0;
+
+  BOOST_CHECK (appearances.isNewAppearance ("1234ABC", now) );
+  BOOST_CHECK (appearances.isNewAppearance ("9876XYZ", now += 40000) );
+
+  /* Both stay in view */
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABC", now += 40000) );
+  BOOST_CHECK (!appearances.isNewAppearance ("9876XYZ", now += 40000) );
+}
+
+BOOST_AUTO_TEST_CASE ( timeout_expiring )
+{
+  PlateAppearances appearances (TIMEOUT);
+  gint64 now = 0;
+
+  BOOST_CHECK (appearances.isNewAppearance ("1234ABC", now) );
+  BOOST_CHECK (appearances.isNewAppearance ("9876XYZ", now) );
+
+  /* Seeing a plate keeps it in view, just at the timeout is still in */
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABC", now += TIMEOUT) );
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABC", now += TIMEOUT) );
+
+  /* The other one went out of view */
+  BOOST_CHECK (appearances.isNewAppearance ("9876XYZ", now) );
+
+  BOOST_CHECK (appearances.isNewAppearance ("1234ABC", now += TIMEOUT + 1) );
+
+  appearances.setTimeout (0);
+  BOOST_CHECK (!appearances.isNewAppearance ("1234ABC", now) );
+  BOOST_CHECK (appearances.isNewAppearance ("1234ABC", now + 1) );
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -24,6 +24,8 @@
 #include "KmsMediaPlayerEndPointType_constants.h"
 #include "KmsMediaRecorderEndPointType_constants.h"
 #include "KmsMediaHttpEndPointType_constants.h"
+#include "KmsMediaRtpEndPointType_constants.h"
+#include "KmsMediaSdpEndPointType_constants.h"
 #include "KmsMediaZBarFilterType_constants.h"
 #include "KmsMediaJackVaderFilterType_constants.h"
 #include "KmsMediaPointerDetectorFilterType_constants.h"
@@ -38,6 +40,11 @@
 #include <glibmm/timeval.h>
 
 #include "common/MediaSet.hpp"
+#include "types/MediaPipeline.hpp"
+#include "types/Filter.hpp"
+#include "types/PlateDetectorFilter.hpp"
+#include "types/PointerDetectorFilter.hpp"
+#include "types/UriEndPoint.hpp"
 
 #define GST_CAT_DEFAULT _server_test_
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -63,6 +70,9 @@ public:
 protected:
   boost::shared_ptr<HandlerTest> handlerTest;
 
+  int countPipelineElements (const KmsMediaObjectRef &mediaPipeline,
+                             const std::string &factory);
+
   void check_version ();
   void check_use_released_media_pipeline ();
   void check_auto_released_media_pipeline ();
@@ -87,6 +97,20 @@ protected:
   void check_pointer_detector_filter ();
   void check_web_rtc_end_point ();
   void check_plate_detector_filter();
+  void check_pipeline_template ();
+  void check_pipeline_latency_mode ();
+  void check_switch_source ();
+  void check_shared_analysis_conversion ();
+  void check_filter_analysis_rate ();
+  void check_filter_async_analysis ();
+  void check_filter_analysis_area ();
+  void check_plate_appearance_timeout ();
+  void check_pointer_detector_set_windows ();
+  void check_filter_bypass ();
+  void check_player_demand ();
+  void check_player_demand_pointer_detector ();
+  void check_element_media_types ();
+  void check_pipeline_suspend ();
 };
 
 void
@@ -734,6 +758,777 @@ ClientHandler::check_plate_detector_filter()
   client->release (mediaPipeline);
 }
 
+void
+ClientHandler::check_pipeline_template ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaObjectRef> refs;
+  std::map<std::string, KmsMediaParam> params;
+  std::map<std::string, KmsMediaParam> uriParams;
+  KmsMediaInvocationReturn ret;
+  std::string definition;
+  std::string url;
+
+  definition = "[player]\n"
+               "type=" + g_KmsMediaPlayerEndPointType_constants.TYPE_NAME + "\n"
+               "connect=filter\n"
+               "[filter]\n"
+               "type=" + g_KmsMediaZBarFilterType_constants.TYPE_NAME + "\n"
+               "connect=http\n"
+               "[http]\n"
+               "type=" + g_KmsMediaHttpEndPointType_constants.TYPE_NAME + "\n";
+
+  client->createMediaPipeline (mediaPipeline);
+
+  setStringParam (params, MEDIA_PIPELINE_TEMPLATE_PARAM_NAME, "test");
+  setStringParam (params, MEDIA_PIPELINE_TEMPLATE_PARAM_DEFINITION, definition);
+  createKmsMediaUriEndPointConstructorParams (uriParams,
+      "https://ci.kurento.com/video/small.webm");
+
+  for (auto it = uriParams.begin(); it != uriParams.end(); it++)
+    params["player." + it->first] = it->second;
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline,
+                                          MEDIA_PIPELINE_REGISTER_TEMPLATE, params) );
+
+  /* A template connecting to an element it does not declare is rejected */
+  setStringParam (params, MEDIA_PIPELINE_TEMPLATE_PARAM_DEFINITION,
+                  definition + "connect=missing\n");
+  BOOST_CHECK_THROW (client->invoke (ret, mediaPipeline,
+                                     MEDIA_PIPELINE_REGISTER_TEMPLATE, params),
+                     KmsMediaServerException);
+
+  params.clear();
+  setStringParam (params, MEDIA_PIPELINE_TEMPLATE_PARAM_NAME, "test");
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline,
+                                          MEDIA_PIPELINE_CREATE_FROM_TEMPLATE, params) );
+  BOOST_REQUIRE_EQUAL (ret.dataType, MEDIA_PIPELINE_OBJECT_REF_MAP_DATA_TYPE);
+  unmarshalKmsMediaObjectRefMap (refs, ret.data);
+
+  BOOST_REQUIRE_EQUAL (refs.size(), 3u);
+  BOOST_REQUIRE (refs.find ("http") != refs.end() );
+
+  client->invoke (ret, refs["http"], g_KmsMediaHttpEndPointType_constants.GET_URL,
+                  emptyParams);
+  unmarshalStringInvocationReturn (url, ret);
+  BOOST_CHECK (!url.empty () );
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_pipeline_latency_mode ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef recorderEndPoint = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  int32_t latency;
+
+  setStringParam (params, MEDIA_PIPELINE_LATENCY_MODE_PARAM, "unknown");
+  BOOST_CHECK_THROW (client->createMediaPipelineWithParams (mediaPipeline, params),
+                     KmsMediaServerException);
+
+  setStringParam (params, MEDIA_PIPELINE_LATENCY_MODE_PARAM,
+                  MEDIA_PIPELINE_LATENCY_MODE_LOW);
+  client->createMediaPipelineWithParams (mediaPipeline, params);
+
+  /* Nothing reaches a sink yet */
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline,
+                                          MEDIA_PIPELINE_GET_LATENCY, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), -1);
+
+  params.clear();
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  params.clear();
+  createKmsMediaUriEndPointConstructorParams (params, "file:///tmp/latency.webm");
+  client->createMediaElementWithParams (recorderEndPoint, mediaPipeline, g_KmsMediaRecorderEndPointType_constants.TYPE_NAME, params);
+
+  client->connectElements (playerEndPoint, recorderEndPoint);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  client->invoke (ret, recorderEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (G_USEC_PER_SEC);
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline,
+                                          MEDIA_PIPELINE_GET_LATENCY, emptyParams) );
+  latency = unmarshalI32Param (ret);
+  GST_INFO ("Low latency pipeline measured %d ms", latency);
+  BOOST_CHECK (latency >= 0);
+  BOOST_CHECK (latency <= MEDIA_PIPELINE_LATENCY_LOW_BUDGET);
+
+  /* Each request measures again, earlier values are not reported */
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.PAUSE, emptyParams);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline,
+                                          MEDIA_PIPELINE_GET_LATENCY, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), -1);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_switch_source ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerA = KmsMediaObjectRef();
+  KmsMediaObjectRef playerB = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+  int32_t processed;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerA, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElementWithParams (playerB, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElement (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME);
+
+  /* Frames are only analysed, and so counted, while someone listens */
+  client->subscribeEvent (callbackToken, zbarFilter,
+                          g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND,
+                          HANDLER_IP, HANDLER_PORT);
+
+  client->connectElements (playerA, zbarFilter);
+  client->invoke (ret, playerA, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  client->invoke (ret, playerB, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+
+  /* The sink keeps receiving from A until B sends a key frame */
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerB, zbarFilter) );
+  g_usleep (G_USEC_PER_SEC);
+
+  /* Switching back before the first switch completes cancels it */
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerA, zbarFilter) );
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerB, zbarFilter) );
+
+  /* Only B can be feeding the sink once A is gone */
+  client->release (playerA);
+  g_usleep (G_USEC_PER_SEC);
+
+  client->invoke (ret, zbarFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams);
+  processed = unmarshalI32Param (ret);
+  g_usleep (G_USEC_PER_SEC);
+
+  client->invoke (ret, zbarFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams);
+  BOOST_CHECK (unmarshalI32Param (ret) > processed);
+
+  client->unsubscribeEvent (zbarFilter, callbackToken);
+  client->release (mediaPipeline);
+}
+
+int
+ClientHandler::countPipelineElements (const KmsMediaObjectRef &mediaPipeline,
+                                      const std::string &factory)
+{
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+
+  setStringParam (params, MEDIA_PIPELINE_COUNT_ELEMENTS_PARAM_FACTORY, factory);
+  client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_COUNT_ELEMENTS, params);
+
+  return unmarshalI32Param (ret);
+}
+
+void
+ClientHandler::check_shared_analysis_conversion ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarA = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarB = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarC = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  /* A and B share one conversion, C gets a different one */
+  params.clear();
+  client->createMediaElement (zbarA, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME);
+  client->createMediaElement (zbarB, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME);
+  setStringParam (params, FILTER_ANALYSIS_FORMAT_PARAM, "GRAY8");
+  client->createMediaElementWithParams (zbarC, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params);
+
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerEndPoint, zbarA) );
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerEndPoint, zbarB) );
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerEndPoint, zbarC) );
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "videoconvert"), 2);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "tee"), 2);
+
+  /* A keeps the conversion it shared with B */
+  BOOST_REQUIRE_NO_THROW (client->connectElements (zbarA, zbarB) );
+  client->release (zbarB);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "videoconvert"), 2);
+
+  /* Conversions nobody takes frames from are torn down */
+  client->release (zbarC);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "videoconvert"), 1);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "tee"), 1);
+
+  client->release (zbarA);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "videoconvert"), 0);
+  BOOST_CHECK_EQUAL (countPipelineElements (mediaPipeline, "tee"), 0);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_filter_analysis_rate ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+  int32_t processed;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  params.clear();
+  createI32Param (params[FILTER_SKIP_FRAMES_PARAM], -1);
+  BOOST_CHECK_THROW (client->createMediaElementWithParams (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params),
+                     KmsMediaServerException);
+
+  createI32Param (params[FILTER_SKIP_FRAMES_PARAM], 2);
+  createI32Param (params[FILTER_ANALYSIS_FPS_PARAM], 5);
+  createI32Param (params[FILTER_ADAPTIVE_ANALYSIS_PARAM], 1);
+  client->createMediaElementWithParams (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params);
+
+  /* Frames are only analysed while someone listens */
+  client->subscribeEvent (callbackToken, zbarFilter,
+                          g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND,
+                          HANDLER_IP, HANDLER_PORT);
+
+  client->connectElements (playerEndPoint, zbarFilter);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (2 * G_USEC_PER_SEC);
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, zbarFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams) );
+  processed = unmarshalI32Param (ret);
+  BOOST_CHECK (processed > 0);
+
+  /* At least two frames are skipped after every analysed one, but the */
+  /* last one may still be skipping. Dropped is read later, so it can */
+  /* only be higher */
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, zbarFilter, FILTER_GET_DROPPED_FRAMES, emptyParams) );
+  BOOST_CHECK (unmarshalI32Param (ret) >= 2 * (processed - 1) );
+
+  client->unsubscribeEvent (zbarFilter, callbackToken);
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_filter_async_analysis ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef plateDetectorFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  params.clear();
+  createI32Param (params[FILTER_ASYNC_ANALYSIS_PARAM], 1);
+  client->createMediaElementWithParams (plateDetectorFilter, mediaPipeline, g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, params);
+
+  /* Frames are only analysed while someone listens */
+  client->subscribeEvent (callbackToken, plateDetectorFilter,
+                          g_KmsMediaPlateDetectorFilterType_constants.EVENT_PLATE_DETECTED,
+                          HANDLER_IP, HANDLER_PORT);
+
+  client->connectElements (playerEndPoint, plateDetectorFilter);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (2 * G_USEC_PER_SEC);
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, plateDetectorFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams) );
+  BOOST_CHECK (unmarshalI32Param (ret) > 0);
+
+  /* Analysing a frame takes longer than a millisecond */
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, plateDetectorFilter, FILTER_GET_ANALYSIS_LAG, emptyParams) );
+  BOOST_CHECK (unmarshalI32Param (ret) > 0);
+
+  client->unsubscribeEvent (plateDetectorFilter, callbackToken);
+  /* Released while the analyser may still be analysing */
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_filter_analysis_area ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string barcodesUri = "https://ci.kurento.com/video/barcodes.webm";
+  std::string callbackToken;
+  Glib::Mutex mutex;
+  Glib::Cond cond;
+  Glib::TimeVal timeout;
+  gboolean endTimeout;
+  KmsMediaObjectRef watched = KmsMediaObjectRef();
+  int found = 0;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, barcodesUri);
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  params.clear();
+  setStringParam (params, FILTER_ANALYSIS_REGIONS_PARAM, "0,0,100");
+  BOOST_CHECK_THROW (client->createMediaElementWithParams (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params),
+                     KmsMediaServerException);
+
+  /* Cropped to the whole frame, as regions are clipped to it, and scaled */
+  setStringParam (params, FILTER_ANALYSIS_REGIONS_PARAM, "0,0,100,50;0,0,4096,4096");
+  createI32Param (params[FILTER_ANALYSIS_WIDTH_PARAM], 640);
+  client->createMediaElementWithParams (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params);
+  client->connectElements (playerEndPoint, zbarFilter);
+
+  mutex.lock();
+  watched = zbarFilter;
+  /* Late events of a released filter are not counted */
+  auto f = [&cond, &mutex, &found, &watched] (std::string cT, KmsMediaEvent e) {
+    GST_INFO ("zBarFilter: %s received", e.type.c_str() );
+    mutex.lock();
+
+    if (e.source.id == watched.id) {
+      found++;
+      cond.signal();
+    }
+
+    mutex.unlock();
+  };
+  handlerTest->setEventFunction (f, g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND);
+
+  client->subscribeEvent (callbackToken, zbarFilter,
+                          g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND,
+                          HANDLER_IP, HANDLER_PORT);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+
+  timeout.assign_current_time();
+  timeout += 20;
+  endTimeout = cond.timed_wait (mutex, timeout);
+  mutex.unlock();
+
+  BOOST_CHECK_MESSAGE (endTimeout, "No barcodes detected in the scaled area until timeout");
+
+  params.clear();
+  createI32Param (params[FILTER_ANALYSIS_HEIGHT_PARAM], 480);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, zbarFilter, FILTER_SET_ANALYSIS_AREA, params) );
+
+  client->unsubscribeEvent (zbarFilter, callbackToken);
+  client->release (mediaPipeline);
+
+  /* Regions outside the frame are clipped to its last pixel */
+  client->createMediaPipeline (mediaPipeline);
+  params.clear();
+  createKmsMediaUriEndPointConstructorParams (params, barcodesUri);
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  params.clear();
+  setStringParam (params, FILTER_ANALYSIS_REGIONS_PARAM, "4096,4096,100,100");
+  client->createMediaElementWithParams (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME, params);
+  client->connectElements (playerEndPoint, zbarFilter);
+
+  mutex.lock();
+  watched = zbarFilter;
+  found = 0;
+  mutex.unlock();
+
+  client->subscribeEvent (callbackToken, zbarFilter,
+                          g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND,
+                          HANDLER_IP, HANDLER_PORT);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (5 * G_USEC_PER_SEC);
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, zbarFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams) );
+  BOOST_CHECK (unmarshalI32Param (ret) > 0);
+
+  mutex.lock();
+  BOOST_CHECK_EQUAL (found, 0);
+  mutex.unlock();
+
+  handlerTest->deleteEventFunction();
+  client->unsubscribeEvent (zbarFilter, callbackToken);
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_plate_appearance_timeout ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef plateDetector = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+
+  client->createMediaPipeline (mediaPipeline);
+
+  createI32Param (params[PLATE_DETECTOR_APPEARANCE_TIMEOUT_PARAM], -1);
+  BOOST_CHECK_THROW (client->createMediaElementWithParams (plateDetector, mediaPipeline, g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, params),
+                     KmsMediaServerException);
+
+  createI32Param (params[PLATE_DETECTOR_APPEARANCE_TIMEOUT_PARAM], 5000);
+  BOOST_REQUIRE_NO_THROW (client->createMediaElementWithParams (plateDetector, mediaPipeline, g_KmsMediaPlateDetectorFilterType_constants.TYPE_NAME, params) );
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_pointer_detector_set_windows ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef pointerDetectorFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaPointerDetectorWindowSet windowSet;
+  KmsMediaPointerDetectorWindow moved;
+  KmsMediaInvocationReturn ret;
+  std::set<std::string> expected, layout;
+  std::string windows;
+  gchar **windowv;
+
+  client->createMediaPipeline (mediaPipeline);
+  client->createMediaElement (pointerDetectorFilter, mediaPipeline,
+                              g_KmsMediaPointerDetectorFilterType_constants.TYPE_NAME);
+
+  for (int i = 0; i < 100; i++) {
+    KmsMediaPointerDetectorWindow window;
+
+    window.topRightCornerX = (i % 10) * 20;
+    window.topRightCornerY = (i / 10) * 20;
+    window.width = 20;
+    window.height = 20;
+    window.id = "hotspot" + std::to_string (i);
+    windowSet.windows.insert (window);
+
+    /* The first two are removed and the third one moved below */
+    if (i > 2) {
+      expected.insert (window.id + "," + std::to_string (window.topRightCornerX) +
+                       "," + std::to_string (window.topRightCornerY) + ",20,20");
+    }
+  }
+
+  createStructParam (params[POINTER_DETECTOR_SET_WINDOWS_PARAM_ADD], windowSet,
+                     g_KmsMediaPointerDetectorFilterType_constants.CONSTRUCTOR_PARAMS_DATA_TYPE);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, pointerDetectorFilter,
+                                          POINTER_DETECTOR_SET_WINDOWS, params) );
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, pointerDetectorFilter,
+                                          POINTER_DETECTOR_GET_WINDOWS, emptyParams) );
+  unmarshalStringInvocationReturn (windows, ret);
+  windowv = g_strsplit (windows.c_str(), ";", -1);
+  BOOST_CHECK_EQUAL (g_strv_length (windowv), 100);
+  g_strfreev (windowv);
+
+  params.clear();
+  setStringParam (params, POINTER_DETECTOR_SET_WINDOWS_PARAM_REMOVE, "hotspot0;hotspot1;hotspot2;unknown");
+
+  moved.topRightCornerX = 300;
+  moved.topRightCornerY = 200;
+  moved.width = 40;
+  moved.height = 30;
+  moved.id = "hotspot2";
+  windowSet.windows.clear();
+  windowSet.windows.insert (moved);
+  expected.insert ("hotspot2,300,200,40,30");
+
+  createStructParam (params[POINTER_DETECTOR_SET_WINDOWS_PARAM_ADD], windowSet,
+                     g_KmsMediaPointerDetectorFilterType_constants.CONSTRUCTOR_PARAMS_DATA_TYPE);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, pointerDetectorFilter,
+                                          POINTER_DETECTOR_SET_WINDOWS, params) );
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, pointerDetectorFilter,
+                                          POINTER_DETECTOR_GET_WINDOWS, emptyParams) );
+  unmarshalStringInvocationReturn (windows, ret);
+  windowv = g_strsplit (windows.c_str(), ";", -1);
+
+  for (gchar **window = windowv; *window != NULL; window++)
+    layout.insert (*window);
+
+  g_strfreev (windowv);
+
+  BOOST_CHECK (layout == expected);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_filter_bypass ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef zbarFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+  int32_t bypassed;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElement (zbarFilter, mediaPipeline, g_KmsMediaZBarFilterType_constants.TYPE_NAME);
+
+  client->connectElements (playerEndPoint, zbarFilter);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (G_USEC_PER_SEC);
+
+  /* Nobody is subscribed, so no frame is analysed */
+  client->invoke (ret, zbarFilter, FILTER_GET_PROCESSED_FRAMES, emptyParams);
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 0);
+
+  client->subscribeEvent (callbackToken, zbarFilter,
+                          g_KmsMediaZBarFilterType_constants.EVENT_CODE_FOUND,
+                          HANDLER_IP, HANDLER_PORT);
+  client->invoke (ret, zbarFilter, FILTER_GET_BYPASSED_FRAMES, emptyParams);
+  bypassed = unmarshalI32Param (ret);
+  g_usleep (G_USEC_PER_SEC);
+
+  /* Subscribed handlers get frames analysed again, but for one that */
+  /* could be going through the filter while subscribing */
+  client->invoke (ret, zbarFilter, FILTER_GET_BYPASSED_FRAMES, emptyParams);
+  BOOST_CHECK (unmarshalI32Param (ret) <= bypassed + 1);
+
+  client->unsubscribeEvent (zbarFilter, callbackToken);
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_player_demand ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef httpEp = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElement (httpEp, mediaPipeline, g_KmsMediaHttpEndPointType_constants.TYPE_NAME);
+
+  client->connectElements (playerEndPoint, httpEp);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 1 /* start */);
+
+  /* The player pauses while nobody is connected and resumes afterwards */
+  client->release (httpEp);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 2 /* pause */);
+
+  client->createMediaElement (httpEp, mediaPipeline, g_KmsMediaHttpEndPointType_constants.TYPE_NAME);
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerEndPoint, httpEp) );
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 1 /* start */);
+
+  /* Pausing is kept while the consumer goes and comes back */
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.PAUSE, emptyParams) );
+  client->release (httpEp);
+  g_usleep (G_USEC_PER_SEC / 2);
+  client->createMediaElement (httpEp, mediaPipeline, g_KmsMediaHttpEndPointType_constants.TYPE_NAME);
+  client->connectElements (playerEndPoint, httpEp);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 2 /* pause */);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_player_demand_pointer_detector ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef pointerDetectorFilter = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElement (pointerDetectorFilter, mediaPipeline, g_KmsMediaPointerDetectorFilterType_constants.TYPE_NAME);
+  client->connectElements (playerEndPoint, pointerDetectorFilter);
+
+  /* A subscribed pointer detector is the only consumer of the player */
+  client->subscribeEvent (callbackToken, pointerDetectorFilter,
+                          g_KmsMediaPointerDetectorFilterType_constants.EVENT_WINDOW_IN,
+                          HANDLER_IP, HANDLER_PORT);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 1 /* start */);
+
+  /* Without subscribers nothing consumes the media */
+  client->unsubscribeEvent (pointerDetectorFilter, callbackToken);
+  g_usleep (G_USEC_PER_SEC / 2);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, playerEndPoint, URI_END_POINT_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), 2 /* pause */);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_element_media_types ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef audioEp = KmsMediaObjectRef();
+  KmsMediaObjectRef videoEp = KmsMediaObjectRef();
+  KmsMediaObjectRef httpEp = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  std::vector<KmsMediaObjectRef> pads;
+  KmsMediaInvocationReturn ret;
+  std::string offer;
+
+  client->createMediaPipeline (mediaPipeline);
+
+  setStringParam (params, MEDIA_ELEMENT_MEDIA_TYPES_PARAM, "unknown");
+  BOOST_CHECK_THROW (client->createMediaElementWithParams (audioEp, mediaPipeline,
+                     g_KmsMediaRtpEndPointType_constants.TYPE_NAME, params),
+                     KmsMediaServerException);
+
+  setStringParam (params, MEDIA_ELEMENT_MEDIA_TYPES_PARAM,
+                  MEDIA_ELEMENT_MEDIA_TYPE_AUDIO);
+  client->createMediaElementWithParams (audioEp, mediaPipeline,
+                                        g_KmsMediaRtpEndPointType_constants.TYPE_NAME, params);
+  setStringParam (params, MEDIA_ELEMENT_MEDIA_TYPES_PARAM,
+                  MEDIA_ELEMENT_MEDIA_TYPE_VIDEO);
+  client->createMediaElementWithParams (videoEp, mediaPipeline,
+                                        g_KmsMediaRtpEndPointType_constants.TYPE_NAME, params);
+  client->createMediaElement (httpEp, mediaPipeline, g_KmsMediaHttpEndPointType_constants.TYPE_NAME);
+
+  client->getMediaSrcs (pads, audioEp);
+  BOOST_REQUIRE_EQUAL (pads.size(), 1u);
+  BOOST_CHECK_EQUAL (pads[0].objectType.pad.mediaType, KmsMediaType::AUDIO);
+
+  /* Disabled media types are not offered */
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, audioEp, g_KmsMediaSdpEndPointType_constants.GENERATE_SDP_OFFER, emptyParams) );
+  unmarshalStringInvocationReturn (offer, ret);
+  BOOST_CHECK (offer.find ("m=audio") != std::string::npos);
+  BOOST_CHECK (offer.find ("m=video") == std::string::npos);
+
+  pads.clear ();
+  client->getMediaSinksByMediaType (pads, audioEp, KmsMediaType::VIDEO);
+  BOOST_CHECK (pads.empty() );
+
+  /* Only the media types both elements have are connected */
+  BOOST_REQUIRE_NO_THROW (client->connectElements (audioEp, httpEp) );
+  BOOST_CHECK_THROW (client->connectElements (audioEp, videoEp),
+                     KmsMediaServerException);
+  BOOST_CHECK_THROW (client->connectElementsByMediaType (videoEp, audioEp,
+                     KmsMediaType::VIDEO), KmsMediaServerException);
+
+  client->release (mediaPipeline);
+}
+
+void
+ClientHandler::check_pipeline_suspend ()
+{
+  KmsMediaObjectRef mediaPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef playerEndPoint = KmsMediaObjectRef();
+  KmsMediaObjectRef httpEp = KmsMediaObjectRef();
+  KmsMediaObjectRef recorderEp = KmsMediaObjectRef();
+  KmsMediaObjectRef checkPipeline = KmsMediaObjectRef();
+  KmsMediaObjectRef checkPlayer = KmsMediaObjectRef();
+  std::map<std::string, KmsMediaParam> params;
+  KmsMediaInvocationReturn ret;
+  std::string callbackToken;
+  Glib::Mutex mutex;
+  Glib::Cond cond;
+  Glib::TimeVal timeout;
+  gboolean eos;
+
+  client->createMediaPipeline (mediaPipeline);
+  createKmsMediaUriEndPointConstructorParams (params, "https://ci.kurento.com/video/small.webm");
+  client->createMediaElementWithParams (playerEndPoint, mediaPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+  createKmsMediaUriEndPointConstructorParams (params, "file:///tmp/suspend.webm");
+  client->createMediaElementWithParams (recorderEp, mediaPipeline, g_KmsMediaRecorderEndPointType_constants.TYPE_NAME, params);
+  client->connectElements (playerEndPoint, recorderEp);
+  client->invoke (ret, recorderEp, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (G_USEC_PER_SEC);
+
+  /* Suspending would lose the position of the player */
+  BOOST_CHECK_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_SUSPEND, emptyParams),
+                     KmsMediaServerException);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), GST_STATE_PLAYING);
+
+  /* and would restart the running times the recorder writes */
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.STOP, emptyParams);
+  BOOST_CHECK_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_SUSPEND, emptyParams),
+                     KmsMediaServerException);
+
+  client->invoke (ret, recorderEp, g_KmsMediaUriEndPointType_constants.STOP, emptyParams);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_SUSPEND, emptyParams) );
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_SUSPEND, emptyParams) );
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), GST_STATE_READY);
+
+  /* Objects and connections stay valid while suspended */
+  client->createMediaElement (httpEp, mediaPipeline, g_KmsMediaHttpEndPointType_constants.TYPE_NAME);
+  BOOST_REQUIRE_NO_THROW (client->connectElements (playerEndPoint, httpEp) );
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, httpEp, g_KmsMediaHttpEndPointType_constants.GET_URL, emptyParams) );
+
+  params.clear ();
+  createI32Param (params[MEDIA_PIPELINE_RESUME_PARAM_TIMEOUT], 500);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_RESUME, params) );
+  BOOST_CHECK (unmarshalI32Param (ret) >= 0);
+
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_GET_STATE, emptyParams) );
+  BOOST_CHECK_EQUAL (unmarshalI32Param (ret), GST_STATE_PLAYING);
+
+  /* The recording made before suspending plays to its end */
+  client->createMediaPipeline (checkPipeline);
+  params.clear ();
+  createKmsMediaUriEndPointConstructorParams (params, "file:///tmp/suspend.webm");
+  client->createMediaElementWithParams (checkPlayer, checkPipeline, g_KmsMediaPlayerEndPointType_constants.TYPE_NAME, params);
+
+  mutex.lock();
+  auto f = [&cond, &mutex, this] (std::string cT, KmsMediaEvent e) {
+    mutex.lock();
+    cond.signal();
+    handlerTest->deleteEventFunction();
+    mutex.unlock();
+  };
+  handlerTest->setEventFunction (f, g_KmsMediaPlayerEndPointType_constants.EVENT_EOS);
+  client->subscribeEvent (callbackToken, checkPlayer,
+                          g_KmsMediaPlayerEndPointType_constants.EVENT_EOS,
+                          HANDLER_IP, HANDLER_PORT);
+  client->invoke (ret, checkPlayer, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  timeout.assign_current_time();
+  timeout += 20;
+  eos = cond.timed_wait (mutex, timeout);
+  mutex.unlock();
+
+  BOOST_CHECK_MESSAGE (eos, "check_pipeline_suspend: recording did not play to its end");
+  client->unsubscribeEvent (checkPlayer, callbackToken);
+  client->release (checkPipeline);
+
+  /* Media reaches the recorder again */
+  client->invoke (ret, recorderEp, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  client->invoke (ret, playerEndPoint, g_KmsMediaUriEndPointType_constants.START, emptyParams);
+  g_usleep (G_USEC_PER_SEC);
+  BOOST_REQUIRE_NO_THROW (client->invoke (ret, mediaPipeline, MEDIA_PIPELINE_GET_LATENCY, emptyParams) );
+  BOOST_CHECK (unmarshalI32Param (ret) >= 0);
+
+  client->release (mediaPipeline);
+}
+
 BOOST_FIXTURE_TEST_SUITE ( server_test_suite, ClientHandler)
 
 BOOST_AUTO_TEST_CASE ( server_test )
@@ -765,6 +1560,20 @@ BOOST_AUTO_TEST_CASE ( server_test )
   check_pointer_detector_filter ();
   check_web_rtc_end_point ();
   check_plate_detector_filter();
+  check_pipeline_template ();
+  check_pipeline_latency_mode ();
+  check_switch_source ();
+  check_shared_analysis_conversion ();
+  check_filter_analysis_rate ();
+  check_filter_async_analysis ();
+  check_filter_analysis_area ();
+  check_plate_appearance_timeout ();
+  check_pointer_detector_set_windows ();
+  check_filter_bypass ();
+  check_player_demand ();
+  check_player_demand_pointer_detector ();
+  check_element_media_types ();
+  check_pipeline_suspend ();
 }
 
 BOOST_AUTO_TEST_SUITE_END()